@@ -0,0 +1,305 @@
+/*
+ * capture.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include "capture.h"
+
+static void *captureWriterThread(void *arg)
+{
+    // write the captures as they are queued, the file writes happen 
+    // here so the decoding never waits on the disk
+    captureWriter *writer=static_cast<captureWriter *>(arg);
+    while(true)
+    {
+        pthread_mutex_lock(&writer->lock);
+        while(writer->jobCount==0 && !writer->stop)
+        {
+            pthread_cond_wait(&writer->wake, &writer->lock);
+        }
+        if(writer->jobCount==0)
+        {
+            pthread_mutex_unlock(&writer->lock);
+            break;
+        }
+        captureJob *job=writer->jobs[writer->jobHead];
+        writer->jobHead=(writer->jobHead+1)%CAPTURE_MAX_QUEUED;
+        writer->jobCount--;
+        pthread_mutex_unlock(&writer->lock);
+
+        // the capture may wrap round the end of the buffer
+        size_t size=job->bytes.size();
+        size_t first=(job->count<size-job->first)?job->count:
+                        size-job->first;
+        FILE *out=fopen(job->filename, "w");
+        if(out && fwrite(&job->bytes[job->first], 1, first, out)==first &&
+            fwrite(&job->bytes[0], 1, job->count-first, out)==
+                    job->count-first)
+        {
+            writer->written++;
+            fprintf(stderr, "Capture written to '%s'\n", job->filename);
+        }
+        else
+        {
+            writer->failed++;
+            fprintf(stderr, "Failed, can't write capture '%s', %s\n", 
+                        job->filename, strerror(errno));
+        }
+        if(out)
+        {
+            fclose(out);
+        }
+
+        // back to its ring for the next capture
+        pthread_mutex_lock(&writer->lock);
+        job->ring->spare=job;
+        pthread_mutex_unlock(&writer->lock);
+    }
+    return(NULL);
+}
+
+bool startCaptureWriter(captureWriter *writer)
+{
+    // a decoding thread may be real time, one waiting on the lock lends
+    // its priority to the writer holding it
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&writer->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&writer->wake, 0);
+    writer->jobHead=0;
+    writer->jobCount=0;
+    writer->stop=false;
+    writer->written=0;
+    writer->failed=0;
+    writer->dropped=0;
+    int err=pthread_create(&writer->thread, NULL, &captureWriterThread, 
+                    writer);
+    if(err!=0)
+    {
+        fprintf(stderr, "Failed, can't create capture thread, %s\n", 
+                    strerror(err));
+    }
+    writer->running=(err==0);
+    return(writer->running);
+}
+
+void stopCaptureWriter(captureWriter *writer)
+{
+    if(writer->running)
+    {
+        pthread_mutex_lock(&writer->lock);
+        writer->stop=true;
+        pthread_cond_signal(&writer->wake);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, 0);
+        writer->running=false;
+    }
+    pthread_cond_destroy(&writer->wake);
+    pthread_mutex_destroy(&writer->lock);
+}
+
+void initCapture(captureRing *ring, captureWriter *writer, int source, 
+            double seconds, double sampleRate)
+{
+    ring->writer=writer;
+    ring->source=source;
+    ring->sampleRate=sampleRate;
+    ring->post=2*static_cast<unsigned long long>(CAPTURE_POST_SECONDS*
+                    sampleRate);
+    // whole samples, and always more than the part after the trigger
+    size_t size=2*static_cast<size_t>(seconds*sampleRate);
+    if(size<=ring->post)
+    {
+        size=ring->post+2;
+    }
+    ring->bytes.assign(size, 0);
+    ring->spare=new captureJob;
+    ring->spare->bytes.assign(size, 0);
+    ring->spare->ring=ring;
+    ring->total=0;
+    ring->since=0;
+    ring->pending=false;
+    ring->triggerEnd=0;
+    ring->dumped=false;
+    ring->lastDump=0;
+    ring->truncated=0;
+    ring->triggers=0;
+    ring->captures=0;
+    ring->limited=0;
+}
+
+void freeCapture(captureRing *ring)
+{
+    delete ring->spare;
+    ring->spare=0;
+}
+
+static void writeCapture(captureRing *ring)
+{
+    // hand the ring's buffer to the writer and carry on in the spare
+    ring->pending=false;
+    captureWriter *writer=ring->writer;
+    pthread_mutex_lock(&writer->lock);
+    captureJob *job=ring->spare;
+    if(!job || writer->jobCount>=CAPTURE_MAX_QUEUED)
+    {
+        // the last capture is still being written
+        writer->dropped++;
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+    ring->spare=0;
+
+    size_t size=ring->bytes.size();
+    unsigned long long start=(ring->total>size)?ring->total-size:0;
+    if(start<ring->since)
+    {
+        // the buffer was a spare not long ago
+        start=ring->since;
+    }
+    start+=start&1;     // on a sample
+    snprintf(job->filename, sizeof(job->filename), "capture%d_%llu.raw", 
+                ring->source, start/2);
+    job->bytes.swap(ring->bytes);
+    job->first=start%size;
+    job->count=ring->total-start;
+    ring->since=ring->total;
+
+    writer->jobs[(writer->jobHead+writer->jobCount)%CAPTURE_MAX_QUEUED]=job;
+    writer->jobCount++;
+    ring->captures++;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static void trigger(captureRing *ring, unsigned long long byte, 
+            const char *reason)
+{
+    // a problem at byte, capture once the samples after it are in
+    ring->triggers++;
+    if(ring->pending)
+    {
+        // already in the capture on its way
+        return;
+    }
+    unsigned long long gap=2*static_cast<unsigned long long>(
+                    CAPTURE_MIN_GAP*ring->sampleRate);
+    if(ring->dumped && byte<ring->lastDump+gap)
+    {
+        ring->limited++;
+        return;
+    }
+    ring->pending=true;
+    ring->triggerEnd=byte+ring->post;
+    ring->dumped=true;
+    ring->lastDump=byte;
+    fprintf(stderr, "Capture input %d at sample %llu, %s\n", ring->source, 
+                byte/2, reason);
+}
+
+void captureBytes(captureRing *ring, const unsigned char *bytes, 
+            size_t count)
+{
+    size_t size=ring->bytes.size();
+    if(count>size)
+    {
+        // only the end of a big push fits
+        ring->total+=count-size;
+        bytes+=count-size;
+        count=size;
+    }
+    size_t at=ring->total%size;
+    size_t first=(count<size-at)?count:size-at;
+    memcpy(&ring->bytes[at], bytes, first);
+    memcpy(&ring->bytes[0], bytes+first, count-first);
+    ring->total+=count;
+
+    if(ring->pending && ring->total>=ring->triggerEnd)
+    {
+        writeCapture(ring);
+    }
+}
+
+void capturePacket(captureRing *ring, const efergyPacket *packet)
+{
+    unsigned int key=(packet->bytes[0]<<16)|(packet->bytes[1]<<8)|
+                        packet->bytes[2];
+    std::map<unsigned int, unsigned long long>::iterator seen;
+    seen=ring->lastSeen.find(key);
+    char reason[80];
+    if(!packet->checksumOk)
+    {
+        if(seen!=ring->lastSeen.end())
+        {
+            snprintf(reason, sizeof(reason), "checksum failed from %06x", 
+                        key);
+            trigger(ring, 2*(packet->end+1), reason);
+        }
+        return;
+    }
+    if(seen!=ring->lastSeen.end() && 
+        (packet->start-seen->second)/ring->sampleRate>CAPTURE_MISSING_GAP)
+    {
+        snprintf(reason, sizeof(reason), "missing packet from %06x", key);
+        trigger(ring, 2*(packet->end+1), reason);
+    }
+    ring->lastSeen[key]=packet->start;
+}
+
+void captureDecoder(captureRing *ring, const efergyDecoder *decoder)
+{
+    efergyCounts counts;
+    counts.size=sizeof(counts);
+    efergyDecoderCounts(decoder, &counts);
+    if(counts.truncated>ring->truncated)
+    {
+        ring->truncated=counts.truncated;
+        trigger(ring, ring->total, "packet cut short by a start pulse");
+    }
+}
+
+void captureEnd(captureRing *ring)
+{
+    if(ring->pending)
+    {
+        writeCapture(ring);
+    }
+}
+
+void outputCaptureStats(FILE *out, const std::vector<captureRing *> &rings,
+            const captureWriter *writer)
+{
+    for(size_t r=0; r<rings.size(); r++)
+    {
+        fprintf(out, "Capture input %d: %llu triggers, %llu captures, "
+                    "%llu rate limited\n", rings[r]->source, 
+                    rings[r]->triggers, rings[r]->captures, 
+                    rings[r]->limited);
+    }
+    fprintf(out, "Captures written %llu, failed %llu, dropped %llu\n",
+                writer->written, writer->failed, writer->dropped);
+}
@@ -0,0 +1,134 @@
+/*
+ * capture.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Capture of the raw samples around decode problems.
+ * 
+ * Each input keeps its last few seconds of rtl_fm samples in a fixed
+ * ring. When something goes wrong the ring's buffer is swapped for a 
+ * spare of the same size, allocated with the ring, and written to a 
+ * file by a writer thread. The decoding never copies the samples, 
+ * allocates or waits on the disk. The ring starts again from the spare
+ * and a second capture can't be made until the writer hands the spare
+ * back. The triggers are
+ *  a failed checksum from an address already seen on the input
+ *  a packet from a meter that comes too long after its last one, the
+ *      missing packet is in the ring before it
+ *  a start pulse part way through a packet, a packet cut short
+ * The file takes in the samples from the ring plus a little after the
+ * trigger, it is in the rtl_fm format so it can be fed straight back
+ * in. Captures are at least CAPTURE_MIN_GAP seconds of samples apart so
+ * a noisy spell can't fill the disk.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <pthread.h>
+
+#include "efergy.h"
+
+// samples kept after the trigger, in seconds
+#define CAPTURE_POST_SECONDS (1.0)
+// seconds of samples between the starts of captures
+#define CAPTURE_MIN_GAP (60.0)
+// captures waiting for the writer before we drop them
+#define CAPTURE_MAX_QUEUED (4)
+// gap from a meter, in seconds, that means a packet went missing,
+// one and a half transmit periods
+#define CAPTURE_MISSING_GAP (9.0)
+
+struct captureRing;
+
+struct captureJob
+{
+    char filename[80];
+    std::vector<unsigned char> bytes;   // a ring's buffer
+    size_t first;                   // of the capture in bytes
+    size_t count;                   // bytes from first, wrapping
+    captureRing *ring;              // the spare goes back to once written
+};
+
+// writes the captures, shared by all the inputs
+struct captureWriter
+{
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stop;
+    captureJob *jobs[CAPTURE_MAX_QUEUED];   // a ring of them
+    size_t jobHead;
+    size_t jobCount;
+    unsigned long long written;
+    unsigned long long failed;
+    unsigned long long dropped;     // queue was full
+};
+
+struct captureRing
+{
+    captureWriter *writer;
+    int source;
+    double sampleRate;
+    std::vector<unsigned char> bytes;
+    unsigned long long total;       // bytes pushed since the start
+    unsigned long long post;        // bytes wanted after a trigger
+    unsigned long long since;       // first byte the buffer holds
+    captureJob *spare;              // 0 while the writer has it
+
+    bool pending;                   // waiting for the samples after
+    unsigned long long triggerEnd;  // write once total reaches this
+    bool dumped;                    // there has been a capture
+    unsigned long long lastDump;    // byte the last capture started
+
+    std::map<unsigned int, unsigned long long> lastSeen;  // meter, sample
+    unsigned long long truncated;   // decoder count last time
+
+    unsigned long long triggers;
+    unsigned long long captures;
+    unsigned long long limited;     // triggers too soon after a capture
+};
+
+bool startCaptureWriter(captureWriter *writer);
+// writes out what is queued then stops the thread
+void stopCaptureWriter(captureWriter *writer);
+
+void initCapture(captureRing *ring, captureWriter *writer, int source, 
+            double seconds, double sampleRate);
+// once the writer has stopped, frees the ring's spare
+void freeCapture(captureRing *ring);
+// the raw bytes, before the decoder's packets are polled
+void captureBytes(captureRing *ring, const unsigned char *bytes, 
+            size_t count);
+// each packet and then the decoder, after the push
+void capturePacket(captureRing *ring, const efergyPacket *packet);
+void captureDecoder(captureRing *ring, const efergyDecoder *decoder);
+// input has ended, write any capture waiting for more samples
+void captureEnd(captureRing *ring);
+void outputCaptureStats(FILE *out, const std::vector<captureRing *> &rings,
+            const captureWriter *writer);
+
+#endif // CAPTURE_H
@@ -0,0 +1,1392 @@
+/*
+ * check.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <ctime>
+#include <cmath>
+#include <string>
+#include <map>
+#include <vector>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "decoder.h"
+#include "efergy.h"
+#include "check.h"
+#include "recorder.h"
+#include "formats.h"
+#include "formatter.h"
+
+// Golden packet lists
+// ===================
+// A capture is decoded through every ingestion path and the packets,
+// with their sample offsets, are compared against a stored list.
+// Any change in what is found fails the check until the new list is
+// accepted with -G.
+
+struct decodedPacket
+{
+    unsigned long long start;   // sample offset of the start pulse
+    unsigned long long end;     // sample offset of the last bit
+    unsigned char bytes[LENGTH_PROTOCOL_BYTES];
+};
+
+typedef std::vector<decodedPacket> packetList;
+
+static void goldenStream(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // the path used for stdin, getPacket() on a FILE
+    FILE *input=fmemopen(const_cast<unsigned char *>(&raw[0]), 
+                    raw.size(), "r");
+    if(!input)
+    {
+        fprintf(stderr, "Failed, can't open capture in memory, %s\n", 
+                    strerror(errno));
+        exit(1);
+    }
+    decoderState state;
+    initDecoder(&state, defaultDecoderConfig);
+    decodedPacket found;
+    while(getPacket(&state, found.bytes, LENGTH_PROTOCOL_BYTES, input))
+    {
+        found.start=state.packetStart;
+        found.end=state.packetEnd;
+        packets->push_back(found);
+    }
+    fclose(input);
+}
+
+static void goldenMemory(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // samples already in memory, decodeSample() directly
+    decoderState state;
+    initDecoder(&state, defaultDecoderConfig);
+    decodedPacket found;
+    for(size_t i=0; i+1<raw.size(); i+=2)
+    {
+        short sample=static_cast<short>(raw[i]|(raw[i+1]<<8));
+        if(decodeSample(&state, sample, found.bytes, LENGTH_PROTOCOL_BYTES))
+        {
+            found.start=state.packetStart;
+            found.end=state.packetEnd;
+            packets->push_back(found);
+        }
+    }
+}
+
+static void goldenGated(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // decodeSample() only from each start pulse, scanForSync() between
+    decoderState state;
+    initDecoder(&state, defaultDecoderConfig);
+    decodedPacket found;
+    size_t count=raw.size()/2;
+    for(size_t i=0; i<count; i++)
+    {
+        i+=scanForSync(&state, &raw[2*i], count-i);
+        if(i>=count)
+            break;
+        short sample=static_cast<short>(raw[2*i]|(raw[2*i+1]<<8));
+        if(decodeSample(&state, sample, found.bytes, LENGTH_PROTOCOL_BYTES))
+        {
+            found.start=state.packetStart;
+            found.end=state.packetEnd;
+            packets->push_back(found);
+        }
+    }
+}
+
+static void decodeSignRange(decoderState *state, 
+            const unsigned long long *signs, size_t first, size_t end, 
+            packetList *packets)
+{
+    decodedPacket found;
+    bool gotPacket;
+    while(first<end)
+    {
+        first=decodeSigns(state, signs, first, end, found.bytes, 
+                    LENGTH_PROTOCOL_BYTES, &gotPacket);
+        if(gotPacket)
+        {
+            found.start=state->packetStart;
+            found.end=state->packetEnd;
+            packets->push_back(found);
+        }
+    }
+}
+
+static void goldenSliced(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // signs packed then decoded a byte at a time, in odd sized ranges 
+    // so the ends are not on a byte
+    size_t count=raw.size()/2;
+    std::vector<unsigned long long> signs(count/64+1);
+    if(count>0)
+    {
+        selectSignKernel(EFERGY_FORMAT_S16LE)(&raw[0], count, &signs[0]);
+    }
+    decoderState state;
+    initDecoder(&state, defaultDecoderConfig);
+    for(size_t at=0; at<count; at+=4093)
+    {
+        decodeSignRange(&state, &signs[0], at, 
+                    (count-at<4093)?count:at+4093, packets);
+    }
+}
+
+static void goldenLibrary(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // through the C interface, in odd sized pushes so samples are split
+    // across calls
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    efergyDecoder *decoder=efergyDecoderCreate(&config);
+    static const size_t chunks[]={1, 4093, 3, 511, 2};
+    size_t offset=0;
+    int chunk=0;
+    while(offset<raw.size())
+    {
+        size_t count=chunks[chunk++%(sizeof(chunks)/sizeof(chunks[0]))];
+        if(count>raw.size()-offset)
+            count=raw.size()-offset;
+        efergyDecoderPushBytes(decoder, &raw[offset], count);
+        offset+=count;
+
+        efergyPacket packet;
+        packet.size=sizeof(packet);
+        while(efergyDecoderPoll(decoder, &packet))
+        {
+            decodedPacket found;
+            found.start=packet.start;
+            found.end=packet.end;
+            memcpy(found.bytes, packet.bytes, LENGTH_PROTOCOL_BYTES);
+            packets->push_back(found);
+        }
+    }
+    efergyDecoderDestroy(decoder);
+}
+
+static FILE *recordCapture(const std::vector<unsigned char> &raw, 
+            bool runs)
+{
+    // a seekable file so the header and index are complete
+    FILE *input=fmemopen(const_cast<unsigned char *>(&raw[0]), 
+                    raw.size(), "r");
+    FILE *output=tmpfile();
+    if(!input || !output)
+    {
+        fprintf(stderr, "Failed, can't record capture, %s\n", 
+                    strerror(errno));
+        exit(1);
+    }
+    if(runs)
+        recordRuns(input, output, DEFAULT_SAMPLE_RATE, RUNS_INDEX_SECONDS);
+    else
+        recordPacked(input, output, DEFAULT_SAMPLE_RATE);
+    fclose(input);
+    rewind(output);
+    return(output);
+}
+
+static void pollPackets(efergyDecoder *decoder, packetList *packets, 
+            unsigned long long first, unsigned long long last)
+{
+    efergyPacket packet;
+    packet.size=sizeof(packet);
+    while(efergyDecoderPoll(decoder, &packet))
+    {
+        if(packet.start<first || packet.start>=last)
+            continue;
+        decodedPacket found;
+        found.start=packet.start;
+        found.end=packet.end;
+        memcpy(found.bytes, packet.bytes, LENGTH_PROTOCOL_BYTES);
+        packets->push_back(found);
+    }
+}
+
+static void pushInChunks(const efergyConfig *config, 
+            const std::vector<unsigned char> &bytes, packetList *packets)
+{
+    // odd sized pushes so every split of a header, word or sample is
+    // taken somewhere
+    efergyDecoder *decoder=efergyDecoderCreate(config);
+    static const size_t chunks[]={3, 4093, 1, 509, 8};
+    size_t offset=0;
+    int chunk=0;
+    while(offset<bytes.size())
+    {
+        size_t count=chunks[chunk++%(sizeof(chunks)/sizeof(chunks[0]))];
+        if(count>bytes.size()-offset)
+            count=bytes.size()-offset;
+        efergyDecoderPushStream(decoder, &bytes[offset], count);
+        offset+=count;
+        pollPackets(decoder, packets, 0, ULLONG_MAX);
+    }
+    efergyDecoderDestroy(decoder);
+}
+
+static void goldenRecorded(const std::vector<unsigned char> &raw, 
+            packetList *packets, bool runs)
+{
+    // recorded then back in through the library as a stream, so the
+    // recorder, the header and the word or run decoding are all checked
+    FILE *recorded=recordCapture(raw, runs);
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[4096];
+    size_t got;
+    while((got=fread(buffer, 1, sizeof(buffer), recorded)) > 0)
+    {
+        bytes.insert(bytes.end(), buffer, buffer+got);
+    }
+    fclose(recorded);
+
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    pushInChunks(&config, bytes, packets);
+}
+
+static void goldenPacked(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    goldenRecorded(raw, packets, false);
+}
+
+static void goldenRuns(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    goldenRecorded(raw, packets, true);
+}
+
+static void goldenIndexed(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // a run capture decoded a piece at a time between its index 
+    // entries, each started afresh from the index as -t does
+    FILE *recorded=recordCapture(raw, true);
+    runsCapture capture;
+    if(!openRuns(recorded, &capture))
+    {
+        fclose(recorded);
+        return;
+    }
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    efergyDecoder *decoder=efergyDecoderCreate(&config);
+    unsigned long long lead=static_cast<unsigned long long>(
+                            RUNS_LEAD_SECONDS*config.sampleRate);
+    for(size_t e=0; e<capture.index.size(); e++)
+    {
+        unsigned long long first=capture.index[e].sample;
+        unsigned long long last=(e+1<capture.index.size())?
+                                capture.index[e+1].sample:ULLONG_MAX;
+        unsigned long long until=(last<ULLONG_MAX-lead)?last+lead:ULLONG_MAX;
+        unsigned long long at=seekRuns(&capture, (first>lead)?first-lead:0);
+        efergyDecoderStartAt(decoder, at);
+        // a packet starting in the piece ends within a second of it
+        unsigned char buffer[509];
+        size_t got;
+        efergyCounts before;
+        efergyCounts counts;
+        before.size=sizeof(before);
+        efergyDecoderCounts(decoder, &before);
+        counts=before;
+        while(at+counts.samples-before.samples<until &&
+            (got=fread(buffer, 1, sizeof(buffer), recorded))>0)
+        {
+            efergyDecoderPushRuns(decoder, buffer, got);
+            efergyDecoderCounts(decoder, &counts);
+            pollPackets(decoder, packets, first, last);
+        }
+    }
+    efergyDecoderDestroy(decoder);
+    fclose(recorded);
+}
+
+static void putLittleEndian(std::vector<unsigned char> &bytes, 
+            unsigned int value, int count)
+{
+    for(int b=0; b<count; b++)
+    {
+        bytes.push_back((value>>(8*b))&0xff);
+    }
+}
+
+static void goldenFormat(const std::vector<unsigned char> &raw, 
+            packetList *packets, int format)
+{
+    // the capture in another sample format with the same signs, through
+    // the stream and its conversion kernel
+    std::vector<unsigned char> bytes;
+    for(size_t i=0; i+1<raw.size(); i+=2)
+    {
+        short sample=static_cast<short>(raw[i]|(raw[i+1]<<8));
+        switch(format)
+        {
+            case EFERGY_FORMAT_S16BE:
+                bytes.push_back(raw[i+1]);
+                bytes.push_back(raw[i]);
+                break;
+            case EFERGY_FORMAT_S8:
+                bytes.push_back(raw[i+1]);
+                break;
+            case EFERGY_FORMAT_U8:
+                bytes.push_back(raw[i+1]^0x80);
+                break;
+            case EFERGY_FORMAT_F32LE:
+            {
+                float value=sample/32768.0f;
+                unsigned char *at=reinterpret_cast<unsigned char *>(&value);
+                bytes.insert(bytes.end(), at, at+sizeof(value));
+                break;
+            }
+        }
+    }
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    config.format=format;
+    pushInChunks(&config, bytes, packets);
+}
+
+static void goldenS16be(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    goldenFormat(raw, packets, EFERGY_FORMAT_S16BE);
+}
+
+static void goldenS8(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    goldenFormat(raw, packets, EFERGY_FORMAT_S8);
+}
+
+static void goldenU8(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    goldenFormat(raw, packets, EFERGY_FORMAT_U8);
+}
+
+static void goldenF32le(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    goldenFormat(raw, packets, EFERGY_FORMAT_F32LE);
+}
+
+static void goldenWav(const std::vector<unsigned char> &raw, 
+            packetList *packets)
+{
+    // stereo with the capture on the left and its inverse on the right,
+    // a list chunk before the samples and one after
+    size_t samples=raw.size()/2;
+    std::vector<unsigned char> bytes;
+    bytes.insert(bytes.end(), (const unsigned char *)"RIFF", 
+                (const unsigned char *)"RIFF"+4);
+    putLittleEndian(bytes, 4+(8+16)+(8+6)+(8+4*samples)+(8+6), 4);
+    static const unsigned char wave[]={'W','A','V','E','f','m','t',' '};
+    bytes.insert(bytes.end(), wave, wave+sizeof(wave));
+    putLittleEndian(bytes, 16, 4);
+    putLittleEndian(bytes, 1, 2);       // PCM
+    putLittleEndian(bytes, 2, 2);       // channels
+    putLittleEndian(bytes, DEFAULT_SAMPLE_RATE, 4);
+    putLittleEndian(bytes, 4*DEFAULT_SAMPLE_RATE, 4);
+    putLittleEndian(bytes, 4, 2);       // frame bytes
+    putLittleEndian(bytes, 16, 2);
+    static const unsigned char list[]={'L','I','S','T',5,0,0,0,
+                                       'e','f','e','r','g',0};
+    bytes.insert(bytes.end(), list, list+sizeof(list));
+    static const unsigned char data[]={'d','a','t','a'};
+    bytes.insert(bytes.end(), data, data+sizeof(data));
+    putLittleEndian(bytes, 4*samples, 4);
+    for(size_t s=0; s<samples; s++)
+    {
+        short sample=static_cast<short>(raw[2*s]|(raw[2*s+1]<<8));
+        short inverse=(sample>=0)?-1:0;
+        bytes.push_back(raw[2*s]);
+        bytes.push_back(raw[2*s+1]);
+        putLittleEndian(bytes, static_cast<unsigned short>(inverse), 2);
+    }
+    bytes.insert(bytes.end(), list, list+sizeof(list));
+
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    pushInChunks(&config, bytes, packets);
+}
+
+struct goldenPath
+{
+    const char *name;
+    void (*decode)(const std::vector<unsigned char> &raw, 
+                packetList *packets);
+};
+
+static const goldenPath goldenPaths[]=
+{
+    {"stream", goldenStream},
+    {"memory", goldenMemory},
+    {"gated", goldenGated},
+    {"sliced", goldenSliced},
+    {"library", goldenLibrary},
+    {"packed", goldenPacked},
+    {"runs", goldenRuns},
+    {"indexed", goldenIndexed},
+    {"s16be", goldenS16be},
+    {"s8", goldenS8},
+    {"u8", goldenU8},
+    {"f32le", goldenF32le},
+    {"wav", goldenWav},
+};
+
+// most samples a byte of a run capture may give, well above a real one
+// whose runs are noise between the packets
+#define MAX_RUN_EXPANSION (4096)
+
+static void unrunCapture(std::vector<unsigned char> &raw)
+{
+    // a run capture back to rtl_fm samples, up to the end marker. The
+    // widths come from the file, so the samples are held to what the
+    // header says, and to what the file could hold, before any are made
+    efergyPackedHeader header;
+    memcpy(&header, &raw[0], sizeof(header));
+    unsigned long long limit=MAX_RUN_EXPANSION*
+                static_cast<unsigned long long>(raw.size());
+    if(header.samples>0 && header.samples<limit)
+    {
+        limit=header.samples;
+    }
+    unsigned long long samples=0;
+    std::vector<unsigned char> unpacked;
+    unsigned long long value=0;
+    int shift=0;
+    for(size_t i=header.headerBytes; i<raw.size(); i++)
+    {
+        value|=static_cast<unsigned long long>(raw[i]&0x7f)<<shift;
+        shift+=7;
+        if((raw[i]&0x80) && shift<64)
+        {
+            continue;
+        }
+        if(value==0)
+        {
+            break;
+        }
+        bool high=value&1;
+        if((value>>1)>limit-samples)
+        {
+            fprintf(stderr, "Failed, run capture has more than the %llu "
+                        "samples its header and size allow\n", limit);
+            raw.clear();
+            return;
+        }
+        samples+=value>>1;
+        for(unsigned long long w=0; w<(value>>1); w++)
+        {
+            unpacked.push_back(high?0x01:0xff);
+            unpacked.push_back(high?0x00:0xff);
+        }
+        value=0;
+        shift=0;
+    }
+    fprintf(stderr, "Run capture, %lu samples\n", 
+                static_cast<unsigned long>(unpacked.size()/2));
+    raw.swap(unpacked);
+}
+
+static void unpackCapture(std::vector<unsigned char> &raw)
+{
+    // a packed capture back to rtl_fm samples, a high is +1 and a low
+    // -1, so every path can be run on it
+    efergyPackedHeader header;
+    if(raw.size()<sizeof(header))
+    {
+        return;
+    }
+    if(memcmp(&raw[0], EFERGY_RUNS_MAGIC, sizeof(header.magic))==0)
+    {
+        unrunCapture(raw);
+        return;
+    }
+    if(memcmp(&raw[0], EFERGY_PACKED_MAGIC, sizeof(header.magic))!=0)
+    {
+        return;
+    }
+    memcpy(&header, &raw[0], sizeof(header));
+    unsigned long long samples=8ULL*(raw.size()-header.headerBytes);
+    if(header.headerBytes>raw.size())
+    {
+        samples=0;
+    }
+    if(header.samples>0 && header.samples<samples)
+    {
+        samples=header.samples;
+    }
+    std::vector<unsigned char> unpacked;
+    unpacked.reserve(2*samples);
+    for(unsigned long long s=0; s<samples; s++)
+    {
+        unsigned char byte=raw[header.headerBytes+s/8];
+        bool high=(byte>>(s%8))&1;
+        unpacked.push_back(high?0x01:0xff);
+        unpacked.push_back(high?0x00:0xff);
+    }
+    fprintf(stderr, "Packed capture, %llu samples\n", samples);
+    raw.swap(unpacked);
+}
+
+static void convertCapture(std::vector<unsigned char> &raw, int format)
+{
+    // a wav or samples in another format to rtl_fm ones with the same
+    // signs, so every path can be run on them
+    size_t start=0;
+    int frameBytes=formatBytes(format);
+    unsigned long long dataBytes=ULLONG_MAX;
+    wavInfo wav;
+    if(raw.size()>=4 && memcmp(&raw[0], "RIFF", 4)==0)
+    {
+        if(readWavHeader(&raw[0], raw.size(), &wav)!=WAV_OK)
+        {
+            fprintf(stderr, "Failed, not a wav we can read\n");
+            raw.clear();
+            return;
+        }
+        format=wav.format;
+        frameBytes=wav.frameBytes;
+        start=wav.dataOffset;
+        dataBytes=wav.dataBytes;
+    }
+    else if(format==EFERGY_FORMAT_S16LE)
+    {
+        return;
+    }
+    size_t frames=(raw.size()-start)/frameBytes;
+    if(dataBytes/frameBytes<frames)
+    {
+        frames=dataBytes/frameBytes;
+    }
+    std::vector<unsigned char> converted;
+    converted.reserve(2*frames);
+    for(size_t f=0; f<frames; f++)
+    {
+        bool high=sampleHigh(format, &raw[start+f*frameBytes]);
+        converted.push_back(high?0x01:0xff);
+        converted.push_back(high?0x00:0xff);
+    }
+    fprintf(stderr, "Converted %lu %s samples\n", 
+                static_cast<unsigned long>(frames), formatName(format));
+    raw.swap(converted);
+}
+
+static bool samePacket(const decodedPacket &a, const decodedPacket &b)
+{
+    return(a.start==b.start && a.end==b.end && 
+           memcmp(a.bytes, b.bytes, LENGTH_PROTOCOL_BYTES)==0);
+}
+
+static void printPacket(FILE *out, const char *prefix, 
+            const decodedPacket &packet)
+{
+    fprintf(out, "%s%llu %llu ", prefix, packet.start, packet.end);
+    for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
+    {
+        fprintf(out, "%02x", packet.bytes[i]);
+    }
+    fprintf(out, "\n");
+}
+
+static bool readGolden(const std::string &filename, packetList *packets)
+{
+    FILE *golden=fopen(filename.c_str(), "r");
+    if(!golden)
+    {
+        fprintf(stderr, "Failed, can't open golden file '%s', %s\n", 
+                    filename.c_str(), strerror(errno));
+        return(false);
+    }
+    char line[200];
+    while(fgets(line, sizeof(line), golden))
+    {
+        if(line[0]=='#' || line[0]=='\n')
+            continue;
+        decodedPacket packet;
+        char hex[2*LENGTH_PROTOCOL_BYTES+1]={0};
+        if(sscanf(line, "%llu %llu %16s", &packet.start, &packet.end, 
+                    hex)!=3 || strlen(hex)!=2*LENGTH_PROTOCOL_BYTES)
+        {
+            fprintf(stderr, "Failed, bad line in golden file, %s", line);
+            fclose(golden);
+            return(false);
+        }
+        for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
+        {
+            unsigned int byte;
+            sscanf(&hex[2*i], "%2x", &byte);
+            packet.bytes[i]=byte&0xff;
+        }
+        packets->push_back(packet);
+    }
+    fclose(golden);
+    return(true);
+}
+
+static int diffPackets(const char *name, const packetList &golden, 
+            const packetList &found)
+{
+    // both lists are in sample order, walk them together and report
+    // packets lost (-) and gained (+)
+    int differences=0;
+    size_t g=0;
+    size_t f=0;
+    while(g<golden.size() || f<found.size())
+    {
+        if(g<golden.size() && f<found.size() && 
+            samePacket(golden[g], found[f]))
+        {
+            g++;
+            f++;
+            continue;
+        }
+        if(differences==0)
+        {
+            fprintf(stderr, "Differences on %s path\n", name);
+        }
+        differences++;
+        if(f>=found.size() || 
+            (g<golden.size() && golden[g].start<=found[f].start))
+        {
+            printPacket(stderr, "- ", golden[g++]);
+        }
+        else
+        {
+            printPacket(stderr, "+ ", found[f++]);
+        }
+    }
+    return(differences);
+}
+
+static bool readCapture(std::vector<unsigned char> *raw, int format)
+{
+    // all of stdin as rtl_fm samples, whatever it was recorded as
+    unsigned char buffer[4096];
+    size_t got;
+    while((got=fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+    {
+        raw->insert(raw->end(), buffer, buffer+got);
+    }
+    unpackCapture(*raw);
+    convertCapture(*raw, format);
+    if(raw->size()<2)
+    {
+        fprintf(stderr, "Failed, no capture on stdin\n");
+        return(false);
+    }
+    return(true);
+}
+
+int checkGolden(const std::string &filename, bool accept, int format)
+{
+    // capture comes in on stdin, keep all of it so each path sees
+    // exactly the same samples
+    std::vector<unsigned char> raw;
+    if(!readCapture(&raw, format))
+    {
+        return(1);
+    }
+
+    packetList golden;
+    if(!accept && !readGolden(filename, &golden))
+    {
+        return(1);
+    }
+
+    const int paths=sizeof(goldenPaths)/sizeof(goldenPaths[0]);
+    int differences=0;
+    for(int p=0; p<paths; p++)
+    {
+        packetList found;
+        goldenPaths[p].decode(raw, &found);
+        fprintf(stderr, "%s path, %lu packets\n", goldenPaths[p].name, 
+                    static_cast<unsigned long>(found.size()));
+        if(accept && p==0)
+        {
+            // first path sets the list, the rest must agree with it
+            golden=found;
+            continue;
+        }
+        differences+=diffPackets(goldenPaths[p].name, golden, found);
+    }
+    if(accept && differences==0)
+    {
+        FILE *out=fopen(filename.c_str(), "w");
+        if(!out)
+        {
+            fprintf(stderr, "Failed, can't write golden file '%s', %s\n", 
+                    filename.c_str(), strerror(errno));
+            return(1);
+        }
+        fprintf(out, "# efergy golden packets, %lu samples\n", 
+                    static_cast<unsigned long>(raw.size()/2));
+        fprintf(out, "# start end bytes\n");
+        for(size_t i=0; i<golden.size(); i++)
+        {
+            printPacket(out, "", golden[i]);
+        }
+        fclose(out);
+        fprintf(stderr, "Accepted %lu packets into '%s'\n", 
+                    static_cast<unsigned long>(golden.size()), 
+                    filename.c_str());
+    }
+
+    if(differences)
+    {
+        fprintf(stderr, "Failed, %d packet differences\n", differences);
+#ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+        // a fuzzer only reports crashes and hangs
+        abort();
+#endif
+        return(1);
+    }
+    return(0);
+}
+// Number formatting
+// =================
+// The text output has its own number formatting, formatter.h, in
+// place of printf, it must give the same text.
+
+// values formatFixed() is checked on at each number of decimals
+#define FORMAT_CHECK_VALUES (20000)
+
+static bool sameAsPrintf(double value, int decimals)
+{
+    char mine[MAX_FIELD_TEXT+1];
+    char *end=formatFixed(mine, value, decimals);
+    *end=0;
+    char theirs[MAX_FIELD_TEXT];
+    snprintf(theirs, sizeof(theirs), "%.*f", decimals, value);
+    if(strcmp(mine, theirs)!=0)
+    {
+        fprintf(stderr, "%.17g to %d decimals formats as %s, printf %s\n",
+                    value, decimals, mine, theirs);
+        return(false);
+    }
+    return(true);
+}
+
+int checkFormatting()
+{
+    // the text output rounds the way printf does, over magnitudes up 
+    // to where it hands over to snprintf() and past it, at the halves
+    // and the doubles either side of them
+    int differences=0;
+    unsigned int seed=1;
+    for(int d=0; d<=MAX_FIELD_DECIMALS; d++)
+    {
+        double unit=pow(10.0, -d);
+        for(int i=0; i<FORMAT_CHECK_VALUES; i++)
+        {
+            seed=seed*1103515245+12345;
+            double magnitude=pow(10.0, (seed>>8)%20-6);
+            double value=floor(magnitude*(seed>>16)/65536.0/unit)*unit+
+                        unit/2;
+            if(i&1)
+                value=-value;
+            differences+=!sameAsPrintf(value, d);
+            differences+=!sameAsPrintf(nextafter(value, 0), d);
+            differences+=!sameAsPrintf(nextafter(value, 2*value), d);
+        }
+    }
+    differences+=!sameAsPrintf(1349646846047.0015, 3);
+    differences+=!sameAsPrintf(-0.0, 2);
+    if(differences)
+    {
+        fprintf(stderr, "Failed, %d numbers formatted unlike printf\n", 
+                    differences);
+        return(1);
+    }
+    fprintf(stderr, "Number formatting matches printf\n");
+    return(0);
+}
+
+// Benchmark of packet yield against a generated signal
+// =====================================================
+// Packets with known contents are synthesised the way rtl_fm would
+// deliver them, with noise, a dc offset from the frequency error and
+// jitter on the pulse timing. Each decoder configuration is run over the
+// same samples and we count the packets recovered and the false accepts,
+// packets that pass the checksum but were never sent.
+// The output is a table that gnuplot can read directly.
+
+#define BENCH_PACKETS (200)
+#define BENCH_AMPLITUDE (8000.0)
+#define BENCH_SYNC_WIDTH (60)
+#define BENCH_BIT_PERIOD (19)
+#define BENCH_ZERO_WIDTH (6)
+#define BENCH_ONE_WIDTH (14)
+#define BENCH_GAP (2000)
+
+// how an engine walks the samples
+enum benchMethod
+{
+    BENCH_SAMPLES,      // decodeSample() on every sample
+    BENCH_GATED,        // scanForSync() between packets
+    BENCH_WORDS,        // packed signs, a run at a time from the edges
+    BENCH_SLICED        // packed signs, a byte at a time from a table
+};
+
+struct benchEngine
+{
+    const char *name;
+    decoderConfig config;
+    benchMethod method;
+};
+
+static const benchEngine benchEngines[]=
+{
+    {"default", {MIN_SYNC_PULSE_SAMPLE_WIDTH, MIN_ONE_PULSE_WIDTH}, 
+                BENCH_SAMPLES},
+    {"gated",   {MIN_SYNC_PULSE_SAMPLE_WIDTH, MIN_ONE_PULSE_WIDTH}, 
+                BENCH_GATED},
+    {"words",   {MIN_SYNC_PULSE_SAMPLE_WIDTH, MIN_ONE_PULSE_WIDTH}, 
+                BENCH_WORDS},
+    {"sliced",  {MIN_SYNC_PULSE_SAMPLE_WIDTH, MIN_ONE_PULSE_WIDTH}, 
+                BENCH_SLICED},
+    {"sync30",  {30, MIN_ONE_PULSE_WIDTH}, BENCH_SAMPLES},
+    {"sync50",  {50, MIN_ONE_PULSE_WIDTH}, BENCH_SAMPLES},
+    {"one8",    {MIN_SYNC_PULSE_SAMPLE_WIDTH, 8}, BENCH_SAMPLES},
+    {"one12",   {MIN_SYNC_PULSE_SAMPLE_WIDTH, 12}, BENCH_SAMPLES},
+};
+
+// samples packed to signs a block at a time, as the library does
+#define BENCH_SIGN_BLOCK (4096)
+
+static void decodeSignWords(decoderState *state, 
+            const unsigned long long *signs, size_t count, 
+            packetList *packets)
+{
+    // each run found from the next edge with a count of trailing zeros
+    decodedPacket found;
+    size_t at=0;
+    while(at<count)
+    {
+        unsigned long long word=signs[at>>6];
+        int bit=at&63;
+        bool high=(word>>bit)&1;
+        unsigned long long changes=(high?~word:word)>>bit;
+        size_t end=at+(changes?__builtin_ctzll(changes):64-bit);
+        if(end>count)
+            end=count;
+        bool gotPacket;
+        at+=decodeRun(state, high, end-at, found.bytes, 
+                    LENGTH_PROTOCOL_BYTES, &gotPacket);
+        if(gotPacket)
+        {
+            found.start=state->packetStart;
+            found.end=state->packetEnd;
+            packets->push_back(found);
+        }
+    }
+}
+
+static void engineDecode(const benchEngine &engine, const short *samples,
+            size_t count, packetList *packets)
+{
+    decoderState state;
+    initDecoder(&state, engine.config);
+    decodedPacket found;
+    if(engine.method==BENCH_WORDS || engine.method==BENCH_SLICED)
+    {
+        // the kernels take the bytes as rtl_fm writes them
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+        signKernel kernel=selectSignKernel(EFERGY_FORMAT_S16BE);
+#else
+        signKernel kernel=selectSignKernel(EFERGY_FORMAT_S16LE);
+#endif
+        unsigned long long signs[BENCH_SIGN_BLOCK/64];
+        for(size_t i=0; i<count; i+=BENCH_SIGN_BLOCK)
+        {
+            size_t block=(count-i<BENCH_SIGN_BLOCK)?count-i:BENCH_SIGN_BLOCK;
+            kernel(reinterpret_cast<const unsigned char *>(&samples[i]), 
+                        block, signs);
+            if(engine.method==BENCH_WORDS)
+            {
+                decodeSignWords(&state, signs, block, packets);
+            }
+            else
+            {
+                decodeSignRange(&state, signs, 0, block, packets);
+            }
+        }
+        return;
+    }
+    for(size_t i=0; i<count; i++)
+    {
+        if(engine.method==BENCH_GATED)
+        {
+            i+=scanForSync(&state, &samples[i], count-i);
+            if(i>=count)
+                break;
+        }
+        if(decodeSample(&state, samples[i], found.bytes, 
+                    LENGTH_PROTOCOL_BYTES))
+        {
+            found.start=state.packetStart;
+            found.end=state.packetEnd;
+            packets->push_back(found);
+        }
+    }
+}
+
+// small repeatable random generator so runs can be compared
+struct benchRandom
+{
+    unsigned long long state;
+};
+
+static unsigned int benchRand(benchRandom *rnd)
+{
+    // xorshift64*
+    rnd->state^=rnd->state>>12;
+    rnd->state^=rnd->state<<25;
+    rnd->state^=rnd->state>>27;
+    return(static_cast<unsigned int>((rnd->state*2685821657736338717ULL)>>32));
+}
+
+static double benchUniform(benchRandom *rnd)
+{
+    // 0..1, never zero so it is safe for the log below
+    return((benchRand(rnd)+1.0)/4294967297.0);
+}
+
+static double benchGaussian(benchRandom *rnd)
+{
+    // Box-Muller, one value per call is plenty for this
+    return(sqrt(-2.0*log(benchUniform(rnd)))*cos(2.0*M_PI*benchUniform(rnd)));
+}
+
+static int benchJitter(benchRandom *rnd, int jitter)
+{
+    // uniform integer in -jitter..jitter
+    if(jitter<=0)
+        return(0);
+    return(static_cast<int>(benchRand(rnd)%(2*jitter+1))-jitter);
+}
+
+static void benchLevel(std::vector<short> &signal, int count, double level,
+            double sigma, benchRandom *rnd)
+{
+    // append count samples at level plus noise, clipped to 16bits
+    for(int i=0; i<count; i++)
+    {
+        double value=level+sigma*benchGaussian(rnd);
+        if(value>32767.0)
+            value=32767.0;
+        if(value<-32768.0)
+            value=-32768.0;
+        signal.push_back(static_cast<short>(value));
+    }
+}
+
+static void benchIdle(std::vector<short> &signal, int count, 
+            benchRandom *rnd)
+{
+    // no carrier, the fm demodulator gives full scale noise
+    for(int i=0; i<count; i++)
+    {
+        signal.push_back(static_cast<short>(benchRand(rnd)&0xffff));
+    }
+}
+
+static void benchPacket(std::vector<short> &signal, 
+            const unsigned char *packet, double sigma, double offset, 
+            int jitter, benchRandom *rnd)
+{
+    // start pulse then each bit as a low followed by a pulse whose 
+    // width gives the bit value, negative edge ends the bit
+    double high=BENCH_AMPLITUDE+offset;
+    double low=-BENCH_AMPLITUDE+offset;
+    
+    benchLevel(signal, 20, low, sigma, rnd);
+    benchLevel(signal, BENCH_SYNC_WIDTH+benchJitter(rnd, jitter), 
+                high, sigma, rnd);
+    for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
+    {
+        for(int b=7; b>=0; b--)
+        {
+            int width=((packet[i]>>b)&1)?BENCH_ONE_WIDTH:BENCH_ZERO_WIDTH;
+            width+=benchJitter(rnd, jitter);
+            int period=BENCH_BIT_PERIOD+benchJitter(rnd, jitter);
+            // always leave a low between pulses
+            if(period-width < 2)
+                period=width+2;
+            benchLevel(signal, period-width, low, sigma, rnd);
+            benchLevel(signal, width, high, sigma, rnd);
+        }
+    }
+    benchLevel(signal, 40, low, sigma, rnd);
+}
+
+static unsigned long long packetKey(const unsigned char *packet)
+{
+    unsigned long long key=0;
+    for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
+    {
+        key=(key<<8)|packet[i];
+    }
+    return(key);
+}
+
+static void benchSignal(std::vector<short> &signal, 
+            std::map<unsigned long long, int> *sent, double sigma, 
+            double offset, int jitter, benchRandom *rnd)
+{
+    // BENCH_PACKETS random packets with good checksums between gaps
+    signal.clear();
+    benchIdle(signal, BENCH_GAP, rnd);
+    for(int p=0; p<BENCH_PACKETS; p++)
+    {
+        unsigned char packet[LENGTH_PROTOCOL_BYTES];
+        for(int i=0; i<LENGTH_PROTOCOL_BYTES-1; i++)
+        {
+            packet[i]=benchRand(rnd)&0xff;
+        }
+        packet[LENGTH_PROTOCOL_BYTES-1]=0;
+        for(int i=0; i<LENGTH_PROTOCOL_BYTES-1; i++)
+        {
+            packet[LENGTH_PROTOCOL_BYTES-1]+=packet[i];
+        }
+        if(sent)
+        {
+            (*sent)[packetKey(packet)]++;
+        }
+        benchPacket(signal, packet, sigma, offset, jitter, rnd);
+        benchIdle(signal, BENCH_GAP, rnd);
+    }
+}
+
+void writeSynthetic(double snr)
+{
+    // generated capture to stdout in the rtl_fm format, so synthetic
+    // captures can sit alongside recorded ones for regression checks
+    benchRandom rnd={0x0230ad0230adULL};
+    std::vector<short> signal;
+    benchSignal(signal, 0, BENCH_AMPLITUDE/pow(10.0, snr/20.0), 0.0, 1, 
+                &rnd);
+    for(size_t i=0; i<signal.size(); i++)
+    {
+        fputc(signal[i]&0xff, stdout);
+        fputc((signal[i]>>8)&0xff, stdout);
+    }
+    fflush(stdout);
+}
+
+void runBenchmark()
+{
+    static const double snrs[]={30, 20, 15, 12, 10, 8, 6, 4};
+    static const double offsets[]={0.0, 0.25, 0.5};
+    static const int jitters[]={0, 1, 2, 3};
+    const int engines=sizeof(benchEngines)/sizeof(benchEngines[0]);
+
+    fprintf(stdout, "# packets per point %d\n", BENCH_PACKETS);
+    fprintf(stdout, "# engine snrDb offset jitter sent recovered "
+                    "yield%% falseAccept Msamples/s\n");
+
+    benchRandom rnd={0x0230ad0230adULL};
+    std::vector<short> signal;
+    for(unsigned int s=0; s<sizeof(snrs)/sizeof(snrs[0]); s++)
+    for(unsigned int o=0; o<sizeof(offsets)/sizeof(offsets[0]); o++)
+    for(unsigned int j=0; j<sizeof(jitters)/sizeof(jitters[0]); j++)
+    {
+        double sigma=BENCH_AMPLITUDE/pow(10.0, snrs[s]/20.0);
+        double offset=offsets[o]*BENCH_AMPLITUDE;
+
+        // generate the packets and the signal carrying them
+        std::map<unsigned long long, int> sent;
+        benchSignal(signal, &sent, sigma, offset, jitters[j], &rnd);
+
+        for(int e=0; e<engines; e++)
+        {
+            std::map<unsigned long long, int> unseen=sent;
+            unsigned long long recovered=0;
+            unsigned long long falseAccept=0;
+            packetList found;
+            struct timespec start, stop;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            engineDecode(benchEngines[e], &signal[0], signal.size(), &found);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            double seconds=(stop.tv_sec-start.tv_sec)+
+                           (stop.tv_nsec-start.tv_nsec)/1e9;
+
+            for(size_t p=0; p<found.size(); p++)
+            {
+                std::map<unsigned long long, int>::iterator match;
+                match=unseen.find(packetKey(found[p].bytes));
+                if(match!=unseen.end() && match->second>0)
+                {
+                    match->second--;
+                    recovered++;
+                }
+                else if(checksum(found[p].bytes, LENGTH_PROTOCOL_BYTES))
+                {
+                    falseAccept++;
+                }
+            }
+
+            fprintf(stdout, "%-8s %5.1f %5.2f %2d %5d %5llu %6.2f %4llu %8.1f\n",
+                    benchEngines[e].name, snrs[s], offsets[o], jitters[j],
+                    BENCH_PACKETS, recovered, 
+                    (100.0*recovered)/BENCH_PACKETS, falseAccept,
+                    (seconds>0)?(signal.size()/seconds/1e6):0.0);
+        }
+        fflush(stdout);
+    }
+    return;
+}
+
+// Comparing engines
+// =================
+// The engines of the benchmark run side by side on a capture, each on
+// its own thread and cpu, all reading the one copy of the samples. 
+// Each gives its speed and the packets it found that the first didn't,
+// and the other way round.
+
+// the same packet from two engines, their start pulses are measured
+// from where each thought the pulse was long enough
+#define COMPARE_SLACK (64)
+
+struct compareJob
+{
+    const benchEngine *engine;
+    const short *samples;       // shared, nobody writes them
+    size_t count;
+    int cpu;                    // -1 unpinned
+    packetList found;
+    double seconds;
+    double cpuSeconds;
+};
+
+static void *compareThread(void *arg)
+{
+    compareJob *job=static_cast<compareJob *>(arg);
+    if(job->cpu>=0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(job->cpu, &cpus);
+        int err=pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(err!=0)
+        {
+            fprintf(stderr, "Warning, can't pin engine %s to cpu %d, %s\n",
+                        job->engine->name, job->cpu, strerror(err));
+        }
+    }
+
+    struct timespec start, stop, used;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    engineDecode(*job->engine, job->samples, job->count, &job->found);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &used);
+    job->seconds=(stop.tv_sec-start.tv_sec)+(stop.tv_nsec-start.tv_nsec)/1e9;
+    job->cpuSeconds=used.tv_sec+used.tv_nsec/1e9;
+    return(0);
+}
+
+static bool parseEngines(const std::string &names, 
+            std::vector<const benchEngine *> *engines)
+{
+    const int count=sizeof(benchEngines)/sizeof(benchEngines[0]);
+    size_t at=0;
+    while(at<=names.size())
+    {
+        size_t comma=names.find(',', at);
+        if(comma==std::string::npos)
+            comma=names.size();
+        std::string name=names.substr(at, comma-at);
+        bool known=false;
+        for(int e=0; e<count; e++)
+        {
+            if(name=="all" || name==benchEngines[e].name)
+            {
+                engines->push_back(&benchEngines[e]);
+                known=true;
+            }
+        }
+        if(!known)
+        {
+            fprintf(stderr, "Failed, no engine '%s', engines are all", 
+                        name.c_str());
+            for(int e=0; e<count; e++)
+                fprintf(stderr, " %s", benchEngines[e].name);
+            fprintf(stderr, "\n");
+            return(false);
+        }
+        at=comma+1;
+    }
+    return(engines->size()>0);
+}
+
+static unsigned long long onlyIn(const char *name, const packetList &a, 
+            const packetList &b)
+{
+    // packets of a with no copy in b, both are in sample order
+    std::vector<bool> used(b.size(), false);
+    unsigned long long only=0;
+    size_t low=0;
+    for(size_t p=0; p<a.size(); p++)
+    {
+        while(low<b.size() && b[low].start+COMPARE_SLACK<a[p].start)
+            low++;
+        bool matched=false;
+        for(size_t q=low; q<b.size() && 
+                b[q].start<=a[p].start+COMPARE_SLACK; q++)
+        {
+            if(!used[q] && memcmp(a[p].bytes, b[q].bytes, 
+                        LENGTH_PROTOCOL_BYTES)==0)
+            {
+                used[q]=true;
+                matched=true;
+                break;
+            }
+        }
+        if(!matched)
+        {
+            fprintf(stdout, "%-8s %10llu %10llu ", name, a[p].start, a[p].end);
+            for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
+                fprintf(stdout, "%02x", a[p].bytes[i]);
+            fprintf(stdout, " %s\n", 
+                checksum(a[p].bytes, LENGTH_PROTOCOL_BYTES)?"P":"F");
+            only++;
+        }
+    }
+    return(only);
+}
+
+int compareEngines(const std::string &names, int format)
+{
+    std::vector<const benchEngine *> engines;
+    if(!parseEngines(names, &engines))
+    {
+        return(1);
+    }
+    std::vector<unsigned char> raw;
+    if(!readCapture(&raw, format))
+    {
+        return(1);
+    }
+    // one copy of the samples in host order for all of them
+    std::vector<short> samples(raw.size()/2);
+    for(size_t i=0; i<samples.size(); i++)
+    {
+        samples[i]=static_cast<short>(raw[2*i]|(raw[2*i+1]<<8));
+    }
+    std::vector<unsigned char>().swap(raw);
+
+    // the cpus the process may run on, taskset or a cgroup may allow
+    // fewer than are online
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed)==0)
+    {
+        for(int c=0; c<CPU_SETSIZE; c++)
+        {
+            if(CPU_ISSET(c, &allowed))
+                cpus.push_back(c);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Warning, can't read the cpus we may use, %s, the "
+                    "engines aren't pinned\n", strerror(errno));
+    }
+    if(cpus.size()>0 && engines.size()>cpus.size())
+    {
+        fprintf(stderr, "Warning, %lu engines on %lu cpus, some will share\n",
+                    static_cast<unsigned long>(engines.size()), 
+                    static_cast<unsigned long>(cpus.size()));
+    }
+    std::vector<compareJob> jobs(engines.size());
+    std::vector<pthread_t> threads(engines.size());
+    for(size_t e=0; e<engines.size(); e++)
+    {
+        jobs[e].engine=engines[e];
+        jobs[e].samples=&samples[0];
+        jobs[e].count=samples.size();
+        jobs[e].cpu=cpus.size()?cpus[e%cpus.size()]:-1;
+        int err=pthread_create(&threads[e], 0, compareThread, &jobs[e]);
+        if(err!=0)
+        {
+            fprintf(stderr, "Failed, can't start engine %s, %s\n",
+                        engines[e]->name, strerror(err));
+            exit(1);
+        }
+    }
+    for(size_t e=0; e<engines.size(); e++)
+    {
+        pthread_join(threads[e], 0);
+    }
+
+    // the speed is from the cpu time, it holds if engines share a cpu
+    fprintf(stdout, "# %lu samples\n", static_cast<unsigned long>(samples.size()));
+    fprintf(stdout, "# engine  cpu packets passed  seconds cpuSeconds Msamples/s\n");
+    for(size_t e=0; e<jobs.size(); e++)
+    {
+        unsigned long long passed=0;
+        for(size_t p=0; p<jobs[e].found.size(); p++)
+        {
+            if(checksum(jobs[e].found[p].bytes, LENGTH_PROTOCOL_BYTES))
+                passed++;
+        }
+        fprintf(stdout, "%-8s %4d %7lu %6llu %8.4f %10.4f %10.1f\n",
+                    jobs[e].engine->name, jobs[e].cpu, 
+                    static_cast<unsigned long>(jobs[e].found.size()), passed,
+                    jobs[e].seconds, jobs[e].cpuSeconds,
+                    (jobs[e].cpuSeconds>0)?
+                        (samples.size()/jobs[e].cpuSeconds/1e6):0.0);
+    }
+    for(size_t e=1; e<jobs.size(); e++)
+    {
+        const char *first=jobs[0].engine->name;
+        const char *other=jobs[e].engine->name;
+        fprintf(stdout, "# %s against %s, engine start end bytes\n", 
+                    other, first);
+        unsigned long long lost=onlyIn(first, jobs[0].found, jobs[e].found);
+        unsigned long long gained=onlyIn(other, jobs[e].found, jobs[0].found);
+        fprintf(stdout, "# %llu only in %s, %llu only in %s\n", 
+                    lost, first, gained, other);
+    }
+    return(0);
+}
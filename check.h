@@ -0,0 +1,44 @@
+/*
+ * check.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Checks on the decoder, the yield benchmark on generated signal, 
+ * generated captures and the golden packet lists for regression, and
+ * on the number formatting of the text output.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <string>
+
+void runBenchmark();
+void writeSynthetic(double snr);
+// format is of the capture on stdin unless it has a header
+int checkGolden(const std::string &filename, bool accept, int format);
+// the numbers of the text output against printf
+int checkFormatting();
+// names are comma separated engines of the benchmark, or all, the first
+// is the one the others are compared to
+int compareEngines(const std::string &names, int format);
+
+#endif // CHECK_H
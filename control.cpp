@@ -0,0 +1,329 @@
+/*
+ * control.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "control.h"
+
+// epoll tag of the listener, after the client slots
+#define LISTEN_TAG (CONTROL_MAX_CLIENTS)
+
+static bool socketAddress(const std::string &path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family=AF_UNIX;
+    if(path.size()>=sizeof(address->sun_path))
+    {
+        return(false);
+    }
+    memcpy(address->sun_path, path.c_str(), path.size());
+    return(true);
+}
+
+static bool removeStale(const std::string &path, 
+            const struct sockaddr_un *address)
+{
+    // a socket left by a process that died can go, one still answering
+    // is another decoder
+    struct stat status;
+    if(lstat(path.c_str(), &status)!=0)
+    {
+        return(errno==ENOENT);
+    }
+    if(!S_ISSOCK(status.st_mode))
+    {
+        fprintf(stderr, "Failed, control socket '%s' exists and isn't a "
+                    "socket\n", path.c_str());
+        return(false);
+    }
+    int probe=socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool answered=(probe>=0 && connect(probe, 
+                reinterpret_cast<const struct sockaddr *>(address), 
+                sizeof(*address))==0);
+    if(probe>=0)
+        close(probe);
+    if(answered)
+    {
+        fprintf(stderr, "Failed, control socket '%s' is in use\n", 
+                    path.c_str());
+        return(false);
+    }
+    unlink(path.c_str());
+    return(true);
+}
+
+static bool addWait(int epollFd, int fd, unsigned int tag)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events=EPOLLIN;
+    event.data.u32=tag;
+    return(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event)==0);
+}
+
+bool openControl(controlServer *server, const std::string &path,
+            controlHandler handler, void *arg)
+{
+    server->path=path;
+    server->handler=handler;
+    server->arg=arg;
+    server->commands=0;
+    server->running=false;
+    server->stop=false;
+    server->listenFd=-1;
+    server->epollFd=-1;
+    for(int c=0; c<CONTROL_MAX_CLIENTS; c++)
+    {
+        server->clients[c].fd=-1;
+        server->clients[c].length=0;
+    }
+
+    struct sockaddr_un address;
+    if(!socketAddress(path, &address))
+    {
+        fprintf(stderr, "Failed, control socket path '%s' is too long\n", 
+                    path.c_str());
+        return(false);
+    }
+    if(!removeStale(path, &address))
+    {
+        return(false);
+    }
+    server->listenFd=socket(AF_UNIX, 
+                SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server->epollFd=epoll_create1(EPOLL_CLOEXEC);
+    if(server->listenFd<0 || server->epollFd<0)
+    {
+        fprintf(stderr, "Failed, can't create control socket, %s\n", 
+                    strerror(errno));
+        return(false);
+    }
+    // only the owner can change the decoder
+    mode_t oldMask=umask(0077);
+    int bound=bind(server->listenFd, 
+                reinterpret_cast<struct sockaddr *>(&address), 
+                sizeof(address));
+    umask(oldMask);
+    if(bound!=0 || listen(server->listenFd, CONTROL_MAX_CLIENTS)!=0 ||
+        !addWait(server->epollFd, server->listenFd, LISTEN_TAG))
+    {
+        fprintf(stderr, "Failed, can't listen on control socket '%s', %s\n",
+                    path.c_str(), strerror(errno));
+        return(false);
+    }
+    return(true);
+}
+
+static void closeClient(controlClient *client)
+{
+    close(client->fd);  // also takes it out of the epoll set
+    client->fd=-1;
+    client->length=0;
+}
+
+static bool sendReply(controlClient *client, const std::string &reply)
+{
+    // the replies are short, a client that doesn't read them is dropped
+    // rather than let it hold up the decoding
+    size_t sent=0;
+    while(sent<reply.size())
+    {
+        ssize_t wrote=send(client->fd, reply.data()+sent, reply.size()-sent,
+                    MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(wrote<0 && errno==EINTR)
+            continue;
+        if(wrote<=0)
+            return(false);
+        sent+=wrote;
+    }
+    return(true);
+}
+
+static void acceptClients(controlServer *server)
+{
+    while(true)
+    {
+        int fd=accept4(server->listenFd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd<0)
+        {
+            return;
+        }
+        int slot=-1;
+        for(int c=0; c<CONTROL_MAX_CLIENTS && slot<0; c++)
+        {
+            if(server->clients[c].fd<0)
+                slot=c;
+        }
+        if(slot<0 || !addWait(server->epollFd, fd, slot))
+        {
+            controlClient busy;
+            busy.fd=fd;
+            sendReply(&busy, "error too many control clients\n");
+            close(fd);
+            continue;
+        }
+        server->clients[slot].fd=fd;
+        server->clients[slot].length=0;
+    }
+}
+
+static bool runCommand(controlServer *server, controlClient *client, 
+            char *command)
+{
+    size_t length=strlen(command);
+    if(length>0 && command[length-1]=='\r')
+    {
+        command[--length]=0;
+    }
+    if(length==0)
+    {
+        return(true);
+    }
+    std::string reply;
+    bool ok=server->handler(command, &reply, server->arg);
+    server->commands++;
+    if(ok)
+        reply+="ok\n";
+    else
+        reply="error "+reply+"\n";
+    return(sendReply(client, reply));
+}
+
+static void readClient(controlServer *server, controlClient *client)
+{
+    ssize_t got=read(client->fd, client->line+client->length, 
+                sizeof(client->line)-client->length);
+    if(got<0 && (errno==EINTR || errno==EAGAIN))
+    {
+        return;
+    }
+    if(got<=0)
+    {
+        closeClient(client);
+        return;
+    }
+    client->length+=got;
+
+    // each whole line is a command, the rest waits for more
+    size_t start=0;
+    for(size_t i=0; i<client->length; i++)
+    {
+        if(client->line[i]=='\n')
+        {
+            client->line[i]=0;
+            if(!runCommand(server, client, &client->line[start]))
+            {
+                closeClient(client);
+                return;
+            }
+            start=i+1;
+        }
+    }
+    client->length-=start;
+    memmove(client->line, client->line+start, client->length);
+    if(client->length==sizeof(client->line))
+    {
+        sendReply(client, "error command too long\n");
+        closeClient(client);
+    }
+}
+
+void serveControl(controlServer *server, int timeout)
+{
+    struct epoll_event events[CONTROL_MAX_CLIENTS+1];
+    int count=epoll_wait(server->epollFd, events, CONTROL_MAX_CLIENTS+1, 
+                timeout);
+    for(int e=0; e<count; e++)
+    {
+        unsigned int tag=events[e].data.u32;
+        if(tag==LISTEN_TAG)
+        {
+            acceptClients(server);
+        }
+        else if(tag<CONTROL_MAX_CLIENTS && server->clients[tag].fd>=0)
+        {
+            readClient(server, &server->clients[tag]);
+        }
+    }
+}
+
+static void *controlThread(void *arg)
+{
+    controlServer *server=static_cast<controlServer *>(arg);
+    while(!__atomic_load_n(&server->stop, __ATOMIC_ACQUIRE))
+    {
+        serveControl(server, CONTROL_WAKE_MS);
+    }
+    return(NULL);
+}
+
+bool startControl(controlServer *server)
+{
+    server->stop=false;
+    int err=pthread_create(&server->thread, NULL, &controlThread, server);
+    if(err!=0)
+    {
+        fprintf(stderr, "Failed, can't create control thread, %s\n", 
+                    strerror(err));
+    }
+    server->running=(err==0);
+    return(server->running);
+}
+
+void stopControl(controlServer *server)
+{
+    if(server->running)
+    {
+        __atomic_store_n(&server->stop, true, __ATOMIC_RELEASE);
+        pthread_join(server->thread, 0);
+        server->running=false;
+    }
+}
+
+void closeControl(controlServer *server)
+{
+    stopControl(server);
+    for(int c=0; c<CONTROL_MAX_CLIENTS; c++)
+    {
+        if(server->clients[c].fd>=0)
+            closeClient(&server->clients[c]);
+    }
+    if(server->listenFd>=0)
+    {
+        close(server->listenFd);
+        unlink(server->path.c_str());
+    }
+    if(server->epollFd>=0)
+        close(server->epollFd);
+    server->listenFd=-1;
+    server->epollFd=-1;
+}
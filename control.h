@@ -0,0 +1,87 @@
+/*
+ * control.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Changes to a running decoder without a restart, which would lose 
+ * the sync, the meter totals and a minute or so of packets.
+ * 
+ * A unix domain socket takes a command a line
+ *  echo "address add 0x123456" | socat - UNIX-CONNECT:/tmp/efergy.ctl
+ * and each gets its reply, the last line "ok" or "error" and why. The
+ * socket is only for its owner.
+ * 
+ * The server has its own epoll set, which the event loop waits on as 
+ * one more descriptor, or a thread waits on it for the pipeline. The
+ * commands themselves are the program's, see controlCommand() in 
+ * efergy.cpp.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <string>
+
+#include <pthread.h>
+
+#define CONTROL_MAX_CLIENTS (4)
+// longest command line, longer ones are refused
+#define CONTROL_LINE_LENGTH (256)
+// the thread wakes this often to see if it should stop
+#define CONTROL_WAKE_MS (200)
+
+// runs a command, appends the reply lines, or returns false with the
+// reason as the reply, one line without its newline
+typedef bool (*controlHandler)(const char *command, std::string *reply, 
+            void *arg);
+
+struct controlClient
+{
+    int fd;                 // -1 when the slot is free
+    size_t length;
+    char line[CONTROL_LINE_LENGTH];
+};
+
+struct controlServer
+{
+    std::string path;
+    int listenFd;
+    int epollFd;            // the listener and the clients
+    controlHandler handler;
+    void *arg;
+    controlClient clients[CONTROL_MAX_CLIENTS];
+    unsigned long long commands;
+    pthread_t thread;
+    bool running;
+    bool stop;
+};
+
+bool openControl(controlServer *server, const std::string &path,
+            controlHandler handler, void *arg);
+// answers whatever is waiting, waits up to timeout ms for it
+void serveControl(controlServer *server, int timeout);
+// a thread serving it, for when there is no event loop
+bool startControl(controlServer *server);
+void stopControl(controlServer *server);
+// removes the socket
+void closeControl(controlServer *server);
+
+#endif // CONTROL_H
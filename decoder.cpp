@@ -0,0 +1,613 @@
+/*
+ * decoder.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+
+#include "decoder.h"
+
+bool checksum(const unsigned char *bytes, int length)
+{
+    // checksum is last byte 
+    // sum bytes and test against equivelance
+    bool passed = false;
+    unsigned char checksum = 0;
+    for(int i=0; i<(length-1); i++)
+    {
+        checksum += bytes[i];
+    }
+    if (checksum == bytes[length-1])
+    {
+        passed = true;
+    }
+    return(passed);
+}
+
+unsigned long long packetWord(const unsigned char *bytes)
+{
+    unsigned long long word=0;
+    for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
+    {
+        word=(word<<8)|bytes[i];
+    }
+    return(word);
+}
+
+void wordBytes(unsigned long long word, unsigned char *bytes)
+{
+    for(int i=LENGTH_PROTOCOL_BYTES-1; i>=0; i--)
+    {
+        bytes[i]=word&0xff;
+        word>>=8;
+    }
+}
+
+bool checksumWord(unsigned long long word)
+{
+    // the seven bytes above the checksum added in pairs, then the four
+    // 16 bit sums added by the multiply into the top, none can carry
+    unsigned long long sums=word>>8;
+    sums=(sums&0x00ff00ff00ff00ffULL)+((sums>>8)&0x00ff00ff00ff00ffULL);
+    unsigned int sum=(sums*0x0001000100010001ULL)>>48;
+    return((sum&0xff)==(word&0xff));
+}
+
+unsigned int addressWord(unsigned long long word)
+{
+    return(word>>40);
+}
+
+double getPower(const unsigned char *currentBytes, float voltage)
+{
+    // currentBytes[3], 0,1 are the current and 2 is a scaling factor
+        
+    // scaling byte conversion, one entry for every value of the
+    // masked nibble so no byte from the air can index off the end
+    static const double scaling[16]={1,2,4,8,16,32,64,128,256,512,1024,
+                    2048,4096,8192,16384,32768};
+
+    double power = 0.0;
+    double current = static_cast<double>(currentBytes[0])*256.0 + 
+                     static_cast<double>(currentBytes[1]);  
+
+    power = ((voltage * current) / 32768.0 );
+    
+    unsigned char scaleByte = currentBytes[2];
+    if (scaleByte & 0x80) // MSbit set of scaling
+    {
+        // convert to +ve for index
+        scaleByte = 0xff-scaleByte+1;
+        // get the scaling factor, limit it to 0..15
+        scaleByte = scaleByte&0x0f; 
+        power = power / scaling[scaleByte];
+    }
+    else
+    {
+        // get the scaling factor, limit it to 0..15
+        scaleByte=scaleByte&0x0f; 
+        power = power * scaling[scaleByte];
+    }
+
+    return(power);
+}
+
+bool checkAddress(const unsigned char *addressBytes,  
+            const unsigned char *address, int length)
+{
+    bool match=false;
+    if(memcmp(addressBytes, address, length)==0)
+    {
+        match=true;
+    }
+    return(match);
+}
+
+const decoderConfig defaultDecoderConfig=
+{
+    MIN_SYNC_PULSE_SAMPLE_WIDTH,
+    MIN_ONE_PULSE_WIDTH
+};
+
+void resetDecoder(decoderState *state)
+{
+    // back to looking for a start pulse, keeps the config and offsets
+    state->highCount=0;
+    state->sync=false;
+    state->edge=false;
+    state->firstEdge=true;
+    state->negativeEdge=false;
+    state->accum=0;
+    state->bitCount=0;
+    state->byteCount=0;
+    state->lastSample=0;
+    state->bits=0;
+    state->byteSum=0;
+    state->marginSum=0;
+}
+
+void initDecoder(decoderState *state, const decoderConfig &config)
+{
+    state->config=config;
+    state->sampleCount=0;
+    state->syncStart=0;
+    state->packetStart=0;
+    state->packetEnd=0;
+    state->packetQuality=0;
+    state->packetBits=0;
+    state->packetChecksum=false;
+    state->truncated=0;
+    resetDecoder(state);
+}
+
+bool decodeSample(decoderState *state, short sample, 
+            unsigned char *packet, int length)
+{
+    // look for our packet in the demodulated data, one sample at a time
+    // If there are other signals on this frequency then
+    // we may find lots of bogus packets
+    // returns true when packet holds length bytes, the state is then
+    // reset ready to look for the next start pulse and packetStart, 
+    // packetEnd give the sample offsets of the packet
+    bool gotPacket=false;
+
+    // Update our state of our bit detect
+    if(sample >= 0)
+    {
+        if(state->lastSample < 0)
+        {
+            // just had a positive edge, low to high
+            state->negativeEdge=false;
+            state->edge=true;
+        }
+        state->highCount++;
+    }
+    else
+    {
+        if(state->lastSample >= 0)
+        {
+            // just had a negative edge, high to low
+            // store off the length of the previous highs
+            state->accum=state->highCount; 
+            state->negativeEdge=true;
+            state->edge=true;
+        }
+        state->highCount=0; // reset the high count
+    }
+    
+    // detect sync
+    if(state->highCount >= state->config.syncWidth)
+    {
+        if(state->highCount == state->config.syncWidth)
+        {
+            state->syncStart=state->sampleCount+1-state->highCount;
+            if(state->sync && state->byteCount>0)
+            {
+                // a start pulse part way through a packet
+                state->truncated++;
+            }
+        }
+        state->sync=true;
+        state->byteCount=0; // reset to start of protocol bytes
+        state->bitCount=0;
+        state->marginSum=0;
+        state->edge=false;
+        state->firstEdge=true;
+    }
+    
+    if( state->sync & state->edge )
+    {
+        if(state->negativeEdge)
+        {
+            // ignore the first edge after sync seen
+            if(state->firstEdge)
+            {
+                state->firstEdge=false;
+            }
+            else
+            {
+                // we have a data bit 
+                int bit=0; // default it to a zero
+                int margin=state->accum-state->config.oneWidth;
+                if(state->accum > state->config.oneWidth)
+                {
+                    bit=1;
+                }
+                else
+                {
+                    // a zero is at least one sample clear of a one
+                    margin=1-margin;
+                }
+                state->marginSum+=margin;
+                // the pulses, so the packet can be sliced again
+                int at=state->byteCount*8+state->bitCount;
+                if(at<LENGTH_PROTOCOL_BYTES*8)
+                {
+                    state->widths[at]=(state->accum>255)?255:state->accum;
+                }
+                // shift the bit into the packet word
+                state->bits=(state->bits<<1)|bit;
+
+                if(state->bitCount==7 && state->byteCount<length)
+                {
+                    // we have 8bits, the sum for the checksum is kept
+                    // as the bytes come so it is ready with the packet
+                    int index=state->byteCount++;
+                    unsigned char byte=state->bits&0xff;
+                    packet[index]=byte;
+                    if(index==length-1)
+                    {
+                        state->packetChecksum=(byte==
+                                    (index?state->byteSum:0));
+                        gotPacket=true;
+                    }
+                    else
+                    {
+                        state->byteSum=index?state->byteSum+byte:byte;
+                    }
+                }
+                state->bitCount++;
+                state->bitCount%=8;
+            }
+        } // if(negativeEdge)
+        state->edge=false;
+    } // if( sync & edge )
+    state->lastSample=sample;
+
+    if(gotPacket)
+    {
+        state->packetStart=state->syncStart;
+        state->packetEnd=state->sampleCount;
+        state->packetQuality=static_cast<double>(state->marginSum)/
+                                (length*8);
+        state->packetBits=state->bits;
+        resetDecoder(state);
+    }
+    state->sampleCount++;
+    return(gotPacket);
+}
+
+bool getPacket(decoderState *state, unsigned char *packet, int length, 
+            FILE *input)
+{
+    // read samples until we have a packet or the input ends
+    bool gotPacket=false;
+    while(!feof(input) && !gotPacket)
+    {
+        // get the input sample, little endian 16bits
+        // two statements, the order of calls within one expression is 
+        // up to the compiler
+        int low=fgetc(input);
+        int high=fgetc(input);
+        if(low==EOF || high==EOF)
+        {
+            // a part sample at the end is dropped
+            break;
+        }
+        short sample=static_cast<short>(low|(high<<8));
+        
+        // todo - some stats on input samples to spot range problems
+        
+        gotPacket=decodeSample(state, sample, packet, length);
+    } // while(!feof(input) && !gotPacket)
+    
+    return(gotPacket);
+}
+
+
+// Skipping to the start pulse
+// ===========================
+// Away from a packet the decoder only needs the count of highs, so the
+// samples can be skipped through looking for the start pulse. The pulse
+// is syncWidth highs in a row, so look at the sample that would complete
+// it. A low there rules out any pulse ending at or before it and we can
+// jump a whole pulse width. A high means looking back for the last low,
+// which in noise is only a sample or two away. The state is left just
+// as decodeSample() would have it, one sample short of the sync, so
+// nothing is lost and the packets are the same.
+
+static inline bool sampleHigh(const short *samples, size_t i)
+{
+    return(samples[i]>=0);
+}
+
+static inline short sampleValue(const short *samples, size_t i)
+{
+    return(samples[i]);
+}
+
+static inline bool sampleHigh(const unsigned char *bytes, size_t i)
+{
+    // the sign is all we need, the top bit of the high byte
+    return((bytes[2*i+1]&0x80)==0);
+}
+
+static inline short sampleValue(const unsigned char *bytes, size_t i)
+{
+    return(static_cast<short>(bytes[2*i]|(bytes[2*i+1]<<8)));
+}
+
+template<typename T> 
+static size_t skipToSync(decoderState *state, const T *samples, size_t count)
+{
+    if(state->sync || count==0)
+    {
+        return(0);
+    }
+    size_t syncWidth=state->config.syncWidth;
+    size_t highs=state->highCount;     // run of highs before sample used
+    size_t used=0;
+    while(true)
+    {
+        // the sample that would make the run a start pulse
+        size_t test=used+syncWidth-highs-1;
+        if(test>=count)
+        {
+            // not enough left for a pulse, count the highs at the end
+            size_t last=count;
+            while(last>used && sampleHigh(samples, last-1))
+                last--;
+            highs=(last==used)?highs+count-used:count-last;
+            used=count;
+            break;
+        }
+        if(!sampleHigh(samples, test))
+        {
+            highs=0;
+            used=test+1;
+            continue;
+        }
+        size_t last=test;
+        while(last>used && sampleHigh(samples, last-1))
+            last--;
+        if(last==used)
+        {
+            // highs all the way, decodeSample() takes the sync sample
+            highs+=test-used;
+            used=test;
+            break;
+        }
+        highs=test-last+1;
+        used=test+1;
+    }
+    if(used>0)
+    {
+        state->highCount=static_cast<int>(highs);
+        state->lastSample=sampleValue(samples, used-1);
+        state->sampleCount+=used;
+    }
+    return(used);
+}
+
+size_t scanForSync(decoderState *state, const short *samples, size_t count)
+{
+    return(skipToSync(state, samples, count));
+}
+
+size_t scanForSync(decoderState *state, const unsigned char *bytes, 
+            size_t count)
+{
+    return(skipToSync(state, bytes, count));
+}
+
+// Runs of samples
+// ===============
+// Only the sign of a sample matters, so a run of samples on the same 
+// side of zero can be taken in one go. The first sample of the run 
+// holds any edge and goes through decodeSample(), the rest only add to
+// the count of highs, which may reach the start pulse part way along.
+
+unsigned long long decodeRun(decoderState *state, bool high, 
+            unsigned long long width, unsigned char *packet, int length, 
+            bool *gotPacket)
+{
+    *gotPacket=false;
+    if(width==0)
+    {
+        return(0);
+    }
+    *gotPacket=decodeSample(state, high?0:-1, packet, length);
+    if(*gotPacket)
+    {
+        // the rest of the run comes after the packet
+        return(1);
+    }
+    unsigned long long rest=width-1;
+    if(high && rest>0)
+    {
+        unsigned long long highs=state->highCount;
+        unsigned long long syncWidth=state->config.syncWidth;
+        if(highs<syncWidth && highs+rest>=syncWidth)
+        {
+            // the start pulse completes on sample sampleCount+k-1
+            unsigned long long k=syncWidth-highs;
+            state->syncStart=state->sampleCount+k-syncWidth;
+            if(state->sync && state->byteCount>0)
+            {
+                state->truncated++;
+            }
+            state->sync=true;
+            state->byteCount=0;
+            state->bitCount=0;
+            state->marginSum=0;
+            state->edge=false;
+            state->firstEdge=true;
+        }
+        highs+=rest;
+        state->highCount=(highs>INT_MAX)?INT_MAX:static_cast<int>(highs);
+    }
+    state->sampleCount+=rest;
+    return(width);
+}
+
+// Sign bytes
+// ==========
+// With the signs packed, bit i of a byte set when sample i is high, the
+// runs of a byte are known before any sample is looked at. A table 
+// indexed by the sign of the sample before and the byte gives the run 
+// widths, so the decoder moves on a byte at a time and only the edges 
+// go through decodeSample(). A byte with no edge at all, most of the 
+// start pulse and the gaps, just adds to the count of highs. The table
+// is built by the compiler from the templates below, so nothing runs 
+// at start up and it lives in the read only data.
+
+// first edge at or after bit at, 8 for none
+template<int byte, int at> struct sliceEdge
+{
+    enum { value=(((byte>>at)^(byte>>(at-1)))&1)?at:
+                sliceEdge<byte, at+1>::value };
+};
+
+template<int byte> struct sliceEdge<byte, 8>
+{
+    enum { value=8 };
+};
+
+// first bit of each run, 8 past the last run
+template<int byte, int run> struct sliceStart
+{
+    enum { before=sliceStart<byte, run-1>::value,
+        value=(before<8)?sliceEdge<byte, (before<8)?before+1:8>::value:8 };
+};
+
+template<int byte> struct sliceStart<byte, 0>
+{
+    enum { value=0 };
+};
+
+template<int byte, int run> struct sliceWidth
+{
+    enum { value=sliceStart<byte, run+1>::value-sliceStart<byte, run>::value };
+};
+
+// runs of the byte after a sample of sign last, 0 when it carries on
+// the run before it with no edge
+template<int last, int byte> struct sliceRuns
+{
+    enum { value=(byte==(last?0xff:0))?0:1+(sliceStart<byte, 1>::value<8)+
+                (sliceStart<byte, 2>::value<8)+(sliceStart<byte, 3>::value<8)+
+                (sliceStart<byte, 4>::value<8)+(sliceStart<byte, 5>::value<8)+
+                (sliceStart<byte, 6>::value<8)+(sliceStart<byte, 7>::value<8) };
+};
+
+struct sliceStep
+{
+    unsigned char runs;         // 0 for no edge
+    unsigned char widths[8];    // from bit 0, the first is high if it is
+};
+
+#define SLICE_STEP(last, byte) { sliceRuns<last, (byte)>::value, { \
+    sliceWidth<(byte), 0>::value, sliceWidth<(byte), 1>::value, \
+    sliceWidth<(byte), 2>::value, sliceWidth<(byte), 3>::value, \
+    sliceWidth<(byte), 4>::value, sliceWidth<(byte), 5>::value, \
+    sliceWidth<(byte), 6>::value, sliceWidth<(byte), 7>::value } }
+#define SLICE_4(last, byte) SLICE_STEP(last, (byte)), \
+    SLICE_STEP(last, (byte)+1), SLICE_STEP(last, (byte)+2), \
+    SLICE_STEP(last, (byte)+3)
+#define SLICE_16(last, byte) SLICE_4(last, (byte)), \
+    SLICE_4(last, (byte)+4), SLICE_4(last, (byte)+8), \
+    SLICE_4(last, (byte)+12)
+#define SLICE_64(last, byte) SLICE_16(last, (byte)), \
+    SLICE_16(last, (byte)+16), SLICE_16(last, (byte)+32), \
+    SLICE_16(last, (byte)+48)
+#define SLICE_256(last) SLICE_64(last, 0), SLICE_64(last, 64), \
+    SLICE_64(last, 128), SLICE_64(last, 192)
+
+static const sliceStep sliceTable[2][256]=
+{
+    { SLICE_256(0) },
+    { SLICE_256(1) },
+};
+
+static inline bool signAt(const unsigned long long *signs, size_t at)
+{
+    return((signs[at>>6]>>(at&63))&1);
+}
+
+size_t decodeSigns(decoderState *state, const unsigned long long *signs, 
+            size_t first, size_t end, unsigned char *packet, int length, 
+            bool *gotPacket)
+{
+    *gotPacket=false;
+    size_t at=first;
+    // a sample at a time up to a whole byte
+    while(at<end && (at&7)!=0)
+    {
+        *gotPacket=decodeSample(state, signAt(signs, at)?0:-1, packet, 
+                    length);
+        at++;
+        if(*gotPacket)
+        {
+            return(at);
+        }
+    }
+
+    int syncWidth=state->config.syncWidth;
+    while(end-at>=8)
+    {
+        unsigned int byte=(signs[at>>6]>>(at&63))&0xff;
+        const sliceStep &step=sliceTable[state->lastSample>=0][byte];
+        if(step.runs==0)
+        {
+            if(byte==0)
+            {
+                // lows carry on, the count of highs is already zero
+                state->sampleCount+=8;
+                at+=8;
+                continue;
+            }
+            if(state->highCount+8<syncWidth)
+            {
+                state->highCount+=8;
+                state->sampleCount+=8;
+                at+=8;
+                continue;
+            }
+        }
+        // the start pulse completing or edges, a run at a time
+        int runs=step.runs?step.runs:1;
+        bool high=byte&1;
+        for(int r=0; r<runs; r++)
+        {
+            at+=decodeRun(state, high, step.widths[r], packet, length, 
+                        gotPacket);
+            if(*gotPacket)
+            {
+                return(at);
+            }
+            high=!high;
+        }
+    }
+
+    while(at<end)
+    {
+        *gotPacket=decodeSample(state, signAt(signs, at)?0:-1, packet, 
+                    length);
+        at++;
+        if(*gotPacket)
+        {
+            return(at);
+        }
+    }
+    return(at);
+}
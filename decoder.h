@@ -0,0 +1,118 @@
+/*
+ * decoder.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Packet recovery from the demodulated rtl_fm samples and the parsing 
+ * of the recovered protocol bytes. The algorithm and the protocol are
+ * described at the top of efergy.cpp.
+ * 
+ * This is the C++ side used inside the library and by the program, 
+ * other users should go through the C interface in efergy.h.
+ */
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <cstdio>
+
+#define LENGTH_PROTOCOL_BYTES (8)
+#define MIN_SYNC_PULSE_SAMPLE_WIDTH (40)
+#define MIN_ONE_PULSE_WIDTH (10)
+
+#define DEFAULT_VOLTAGE (230.0)
+#define DEFAULT_SAMPLE_RATE (96000.0)
+#define TRANSMIT_PERIOD (6)
+
+// decoder thresholds, in samples at the rtl_fm output rate
+struct decoderConfig
+{
+    int syncWidth;   // highs needed to detect the start pulse
+    int oneWidth;    // pulses longer than this are a one
+};
+
+extern const decoderConfig defaultDecoderConfig;
+
+// state of the bit detect, kept between samples so the decoder can be
+// fed from a file, a pipe or a block of memory
+struct decoderState
+{
+    decoderConfig config;
+    int highCount;           // count of high samples
+    bool sync;               // long pulse sync detect
+    bool edge;               // any type of edge 
+    bool firstEdge;          // first edge after a sync
+    bool negativeEdge;       // falling edge detect
+    int accum;               // store for last pulse width
+    int bitCount;            // count of bits for a byte
+    int byteCount;           // index into packet array
+    short lastSample;        // for edge detection
+    unsigned long long bits; // packet bits so far, the latest at the bottom
+    unsigned char byteSum;   // of the bytes before the checksum byte
+    int marginSum;           // distance of pulses from the threshold
+    unsigned char widths[LENGTH_PROTOCOL_BYTES*8];  // pulse of each bit,
+                             // up to 255 samples, kept to the next sync
+    unsigned long long sampleCount;  // samples seen since init
+    unsigned long long syncStart;    // sample the start pulse began
+    unsigned long long packetStart;  // offsets of the last packet
+    unsigned long long packetEnd;
+    double packetQuality;            // mean margin per bit, in samples
+    unsigned long long packetBits;   // the last packet as packetWord()
+    bool packetChecksum;             // and whether its checksum passed
+    unsigned long long truncated;    // packets cut short by a new sync
+};
+
+bool checksum(const unsigned char *bytes, int length);
+// a protocol packet in one word, the first byte at the top, so the
+// checksum, the address and comparisons are single word operations
+unsigned long long packetWord(const unsigned char *bytes);
+void wordBytes(unsigned long long word, unsigned char *bytes);
+bool checksumWord(unsigned long long word);
+unsigned int addressWord(unsigned long long word);
+double getPower(const unsigned char *currentBytes, float voltage);
+bool checkAddress(const unsigned char *addressBytes,  
+            const unsigned char *address, int length);
+
+void resetDecoder(decoderState *state);
+void initDecoder(decoderState *state, const decoderConfig &config);
+bool decodeSample(decoderState *state, short sample, 
+            unsigned char *packet, int length);
+bool getPacket(decoderState *state, unsigned char *packet, int length, 
+            FILE *input);
+// skip samples while there is no start pulse, returns the samples
+// used, they need no decodeSample(), count is in samples, the bytes are
+// little endian as rtl_fm writes them
+size_t scanForSync(decoderState *state, const short *samples, size_t count);
+size_t scanForSync(decoderState *state, const unsigned char *bytes, 
+            size_t count);
+// width samples all high or all low, returns the samples used, less
+// than width when a packet completes, the rest of the run still to do
+unsigned long long decodeRun(decoderState *state, bool high, 
+            unsigned long long width, unsigned char *packet, int length, 
+            bool *gotPacket);
+// samples first up to end of sign bits, packed as a signKernel packs
+// them, taken a byte at a time, returns the sample after the last used,
+// before end when a packet completes
+size_t decodeSigns(decoderState *state, const unsigned long long *signs, 
+            size_t first, size_t end, unsigned char *packet, int length, 
+            bool *gotPacket);
+
+#endif // DECODER_H
@@ -103,9 +103,69 @@
  * We update the power level to be the maximum in the last n seconds.
  * We write the same value out until we have a good value to log.
  * 
+ * The log line is a template, see formatter.h, the default is
+ *  {date} {power} {estimated}
+ * and -L sets another, eg with the epoch seconds and a decimal place
+ *  efergy -L"{time} {power.1}" power.log
+ * The templates are compiled at start up and the lines formatted 
+ * without allocating or going through printf.
+ * 
+ * Every packet can be kept in a binary journal, see journal.h, and 
+ * replayed later through the aggregation, logging and rrd at full 
+ * speed, eg to rebuild the log for another voltage or address
+ *  efergy -j power.journal power.log
+ *  efergy -J power.journal -v110 -a0x0230ad rebuilt.log
+ * -t picks part of the journal, seconds from when it was started.
+ * 
+ * Processing
+ * ==========
+ * The work is split into stages on their own threads, joined by 
+ * queues, see pipeline.h. ingest reads stdin, decode finds the packets,
+ * sink does the per packet output and log is the logging thread above.
+ * On a busy pi the stages can be pinned to cpus and niced, eg to keep
+ * a core for decoding
+ *  efergy -pdecode=3 -psink=2:10 -plog=2:10 power.log
+ * The cpu use of each stage is written to stats.txt with -s.
+ * 
+ * The -d and -D lines are written by a thread of their own, see 
+ * trace.h, the sink only queues them. If stdout can't keep up, a slow
+ * terminal or ssh, lines are dropped rather than holding up the 
+ * decoding, the count is in stats.txt and given at exit.
+ * 
+ * Several receivers can be decoded in one process, each input has its
+ * own ingest and decode stages and they share the address filter, 
+ * aggregation and logging. With fifos from the rtl_fm for each dongle
+ *  rtl_fm -d0 ... > /tmp/dongle0 &
+ *  rtl_fm -d1 ... > /tmp/dongle1 &
+ *  efergy -i/tmp/dongle0 -i/tmp/dongle1 -a0x0230ad power.log
+ * Copies of a transmission heard by more than one receiver are 
+ * combined, duplicates are dropped and when every copy fails its 
+ * checksum the copies are voted on bit by bit. stats.txt shows the
+ * packets gained over the best single receiver.
+ * 
+ * Between packets the decoder only scans for the next start pulse, 
+ * a low sample rules out a pulse ending there so most samples are 
+ * never looked at. The packets are the same, the golden check has a
+ * gated path, and -s gives the share of the samples skipped.
+ * 
+ * To see why packets are lost, -c keeps the last seconds of samples 
+ * from each input and writes them to capture files, see capture.h, 
+ * when a packet is damaged, cut short or missing. The captures can be
+ * fed back in for a look with -D or kept for the golden check.
+ *  efergy -c15 -a0x0230ad power.log
+ * 
+ * On the smallest boxes the threads cost more than they save, -e runs
+ * everything from one epoll loop, see eventloop.h. The logging is then
+ * a timer in the loop, signals are read from a descriptor and the
+ * process only wakes for samples, a log or a signal.
+ *  rtl_fm ... | efergy -e -a0x0230ad power.log
+ * 
  * Compile
  * =======
- *  g++ -O3 -oefergy efergy.cpp -lpthread -lrrd
+ *  g++ -O3 -oefergy efergy.cpp libefergy.cpp decoder.cpp check.cpp pipeline.cpp eventloop.cpp capture.cpp recorder.cpp formats.cpp packetindex.cpp formatter.cpp trace.cpp journal.cpp control.cpp upstream.cpp rateaudit.cpp governor.cpp -lpthread -lrrd
+ * 
+ * The decoding, packet parsing and aggregation are in libefergy, see 
+ * efergy.h for its C interface, this file is a client of it.
  * 
  * Testing
  * =======
@@ -118,6 +178,76 @@
  * Wait until some data appears then we have a file with good test data.
  * File efergy.raw can then be used for regression testing. 
  * 
+ * The decoder yield can be checked against generated signal with
+ * noise, frequency offset and timing jitter, output is a table
+ * 
+ *  efergy -B > yield.dat
+ * 
+ * and the engines compared on a real capture, side by side on their 
+ * own cpus over one copy of the samples, with their speed and the 
+ * packets each found that the first didn't
+ * 
+ *  efergy -Cdefault,gated,sync30 < efergy.raw
+ * 
+ * default takes a sample at a time, gated skips to the start pulses,
+ * words and sliced pack the signs first and decode a run at a time or 
+ * a byte at a time from a table, the rest are default with other 
+ * thresholds.
+ * 
+ * Captures can be kept as regression tests, the packets found and
+ * their sample offsets are stored once and then every change is 
+ * checked against them
+ * 
+ *  efergy -S12 > synthetic.raw
+ *  efergy -Gefergy.golden < efergy.raw
+ *  efergy -gefergy.golden < efergy.raw
+ * 
+ * golden.sh runs the check over the captures kept in golden/, and -F 
+ * checks the number formatting of the text output against printf.
+ * 
+ * The decoder only uses the sign of each sample, so captures can be 
+ * kept packed at one bit a sample, 1/16 of the size. A packed capture 
+ * can be used anywhere a recorded one can, -i, stdin or the golden 
+ * check, it is told apart by its header.
+ *  rtl_fm ... | efergy -P > efergy.bit
+ *  efergy -gefergy.golden < efergy.bit
+ * 
+ * For long recordings a run capture keeps the runs of samples on each
+ * side of zero with an index every 10 seconds, so an hour of a week 
+ * long capture can be decoded without reading the rest, -t is seconds
+ * from the start of the capture.
+ *  rtl_fm ... | efergy -R > week.run
+ *  efergy -t86400+3600 < week.run
+ * 
+ * Samples from other SDR tools can be read without a sox in between,
+ * -f gives the format of raw samples, a wav file says its own and a 
+ * SigMF recording is read from its metadata, real samples only as the
+ * fm demodulation is upstream.
+ *  efergy -fs8 -i gqrx.s8 power.log
+ *  efergy -i recording.wav power.log
+ *  efergy -i recording.sigmf-meta power.log
+ * 
+ * The sample offsets of every packet, with its checksum and address 
+ * status and quality, can be kept as a binary index, see packetindex.h,
+ * and as SigMF annotations, so a tool can go straight to the bursts.
+ * The offsets are in the samples of one input, so there can only be one.
+ *  efergy -xefergy.idx -Xefergy.sigmf-meta -i efergy.sigmf-data power.log
+ * 
+ * rtl_fm can be run by the decoder rather than piped in, it is then 
+ * restarted if it ends or stalls, as when the dongle wedges, see 
+ * upstream.h
+ *  efergy -I"rtl_fm -f433550000 -s200000 -r96000 -g10" power.log
+ * 
+ * The decoder can work harder for packets, see the engines in efergy.h,
+ * with -E the engine of a live input is stepped up to the one given 
+ * while the cpu keeps up and back down when it doesn't, see governor.h
+ *  efergy -Erepair -a0x0230ad power.log
+ * 
+ * A running decoder can be changed without a restart, which would lose
+ * the sync and the meter totals, through a unix socket, see control.h
+ *  efergy -u/tmp/efergy.ctl -a0x0230ad power.log
+ *  echo "address add 0x0230ae" | socat - UNIX-CONNECT:/tmp/efergy.ctl
+ * 
  * Run valgrind for memory leaks
  * valgrind --leak-check=full --log-file=valgrind.txt -q -v efergy tst < efergy_fm.raw
  * valgrind --leak-check=full --log-file=valgrind.txt --track-origins=yes -q -v ./efergy tst < efergy_fm.raw
@@ -125,6 +255,15 @@
  *   Linking in rrd will fail valgrind, use #define DONT_LINK_RRD and
  *   recompile to check for leaks without rrd
  * 
+ * Fuzzing, fuzz.cpp has libFuzzer targets for the stream decoder, with
+ * the input split where the fuzzer chooses, and for the packet to power
+ * path, see its header. The golden check also reads anything on stdin 
+ * and runs it through every ingestion path, built for fuzzing it aborts
+ * when they differ so afl sees it. Build with the sanitizers so bad 
+ * indexing aborts rather than passes.
+ *  g++ -g -O1 -fsanitize=address,undefined -DFUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION -oefergy *.cpp -lpthread -lrrd
+ *  afl-fuzz -i corpus -o findings ./efergy -G/dev/null
+ * 
  * Notes
  * =====
  * Found that there are other signals interfering with the expected 
@@ -138,14 +277,33 @@
 #include <cassert>
 #include <string>
 #include <cstring>
+#include <climits>
 #include <cerrno>
 #include <ctime>
 #include <csignal>
 #include <map>
-#include <cmath>
+#include <vector>
+#include <algorithm>
 
 #include <unistd.h>
+#include <sched.h>
 #include <pthread.h>
+#include <sys/stat.h>
+
+#include "efergy.h"
+#include "check.h"
+#include "pipeline.h"
+#include "eventloop.h"
+#include "capture.h"
+#include "recorder.h"
+#include "formats.h"
+#include "packetindex.h"
+#include "formatter.h"
+#include "trace.h"
+#include "journal.h"
+#include "control.h"
+#include "upstream.h"
+#include "governor.h"
 
 // comment out to use valgrind without the leaks in rrd
 #define USE_RRD
@@ -154,277 +312,215 @@
 #include <rrd.h>   // rrd may require apt-get install librrd-dev 
 #endif
 
-#define LENGTH_PROTOCOL_BYTES (8)
-#define MIN_SYNC_PULSE_SAMPLE_WIDTH (40)
-#define MIN_ONE_PULSE_WIDTH (10)
-
 #define DEFAULT_VOLTAGE (230.0)
 #define DEFAULT_LOG_PERIOD (1)
 #define DEFAULT_STAT_PACKETS (100)
+// most filter addresses a control reply lists
+#define CONTROL_ADDRESSES (64)
+// copies from different inputs this close in seconds are combined
+#define COMBINE_WINDOW (1.0)
+#define DEFAULT_LOG_LINE "{date} {power} {estimated}"
+#define LATEST_LINE "{date}, {power}"
+#define TOTAL_LINE "TOTAL: {energy} {power} {periods}"
+#define DEBUG_LINE "{power} {bytes} {check}"
+#define DEBUG_SOURCE_LINE "{power} {bytes} {check} {source}"
 
-// logging thread needs access to the power
-// so mutex lock and global variable
-pthread_mutex_t dataLock;
-double _power=0;
 // structure for passing mutliple parmaeters into thread at creation
 struct threadParams
 {
-    unsigned int delay;
+    unsigned int delay;      // minutes, the control socket may change it
     FILE *output;
     std::string rrdFilename;
+    efergyAggregator *aggregator;  // logging takes the interval maximum
+    pipeline *pipe;          // log stage placement and stats
+    lineTemplate logLine;    // compiled from -L
 };
 
 // Global for exit on signal
-bool _exitNow=false;
+volatile bool _exitNow=false;
 
 // some stats on times between packets
 typedef std::map<unsigned int, unsigned long long, 
         std::less<unsigned int> > mapOfDelayCounts;
 
+// state of the sink stage, the per packet output
+struct sinkParams
+{
+    pthread_mutex_t lock;    // held for a packet, and by control commands
+    bool debug;
+    bool debugAll;
+    bool statsOutput;
+    bool showSource;         // more than one input, add it to debug
+    efergyCombiner *combiner;
+    const std::vector<efergyDecoder *> *decoders;
+    const std::vector<captureRing *> *captures;
+    const captureWriter *captureOut;
+    pipeline *pipe;          // the threaded stages, or
+    eventLoop *loop;         // the single thread event loop
+    packetIndex *index;      // 0 unless keeping packet positions
+    traceQueue *trace;       // 0 unless debugging or controlled, the
+                             // stdout lines
+    packetJournal *journal;  // 0 unless keeping the packets
+    double replayTime;       // journal time of a replayed packet, or 0
+    const upstreamSupervisor *upstream;  // 0 unless we run rtl_fm
+    unsigned long long totalPackets;
+    unsigned long long passedPackets;
+    unsigned long long ourPackets;
+    time_t lastPacketTime;
+    mapOfDelayCounts statsGood;
+    lineTemplate latestLine;
+    lineTemplate totalLine;
+    lineTemplate debugLine;
+    lineBuffer line;         // the sink's output is formatted here
+};
+
 static void signalHandler(int signal)
 {
     _exitNow=true;
 }
 
-bool checksum(unsigned char * bytes, int length)
+void logLatest(sinkParams *params, const lineValues *values)
 {
-    // checksum is last byte 
-    // sum bytes and test against equivelance
-    bool passed = false;
-    unsigned char checksum = 0;
-    for(int i=0; i<(length-1); i++)
-    {
-        checksum += bytes[i];
-    }
-    if (checksum == bytes[length-1])
+    FILE *latest=fopen("latest.txt", "w");
+    if(latest)
     {
-        passed = true;
+        formatLine(&params->latestLine, values, &params->line);
+        fwrite(params->line.text, 1, params->line.length, latest);
+        fclose(latest);
     }
-    return(passed);
 }
 
-double getPower(unsigned char * currentBytes, float voltage)
+static void compileLine(const char *text, lineTemplate *line)
 {
-    // currentBytes[3], 0,1 are the current and 2 is a scaling factor
-        
-    // scaling byte conversion
-    static double scaling[15]={1,2,4,8,16,32,64,128,256,512,1024,
-                    2048,4096,8192,16384};
-
-    double power = 0.0;
-    double current = static_cast<double>(currentBytes[0])*256.0 + 
-                     static_cast<double>(currentBytes[1]);  
-
-    power = ((voltage * current) / 32768.0 );
-    
-    unsigned char scaleByte = currentBytes[2];
-    if (scaleByte & 0x80) // MSbit set of scaling
-    {
-        // convert to +ve for index
-        scaleByte = 0xff-scaleByte+1;
-        // get the scaling factor, limit it to 0..15
-        scaleByte = scaleByte&0x0f; 
-        power = power / scaling[scaleByte];
-    }
-    else
+    std::string error;
+    if(!compileTemplate(text, line, &error))
     {
-        // get the scaling factor, limit it to 0..15
-        scaleByte=scaleByte&0x0f; 
-        power = power * scaling[scaleByte];
+        fprintf(stderr, "Failed, line template '%s', %s\n", text, 
+                    error.c_str());
+        exit(1);
     }
-
-    return(power);
 }
 
-bool checkAddress(unsigned char *addressBytes,  
-            unsigned char *address, int length)
+
+// the logging state, kept between intervals
+struct logState
 {
-    bool match=false;
-    if(memcmp(addressBytes, address, length)==0)
-    {
-        match=true;
-    }
-    return(match);
-}
+    threadParams *params;
+    double lastPower;
+    bool rrdLogging;
+    char *rrdArgs[3];
+    char *rrdCommand;
+    char *rrdFile;
+    char rrdValue[2*MAX_FIELD_TEXT+2];  // N:power or time:power
+    lineBuffer line;
+    time_t replayTime;          // the interval when replaying, or 0
+};
 
-bool getPacket(unsigned char *packet, int length, FILE *input)
+void initLogging(logState *state, threadParams *params)
 {
-    // look for our packet in the demodulated data
-    // If there are other signals on this frequency then
-    // we may find lots of bogus packets
-    
-    // lots of variables dealing with byte extraction 
-    // from the oversampled data being read in
-    int highCount=0;         // count of high samples
-    bool sync=false;         // long pulse sync detect
-    bool edge=false;         // any type of edge 
-    bool firstEdge=true;     // first edge after a sync
-    bool negativeEdge=false; // falling edge detect
-    int accum=0;             // store for last pulse width
-    int bitCount=0;          // count of bits for a byte
-    int byteCount=0;         // index into packet arra
-    short lastSample=0;      // for edge detection
-    unsigned char byte;      // for byte building from bits
-    
-    // the recovered packet data
-    bool gotPacket=false;
-    
-    while(!feof(input) && !gotPacket)
+    state->params=params;
+    state->lastPower=0;
+    state->rrdLogging=false;
+    state->rrdCommand=0;
+    state->rrdFile=0;
+    initLineBuffer(&state->line);
+    state->replayTime=0;
+
+    if(params->rrdFilename.size() > 0)
     {
-        short sample;
-        // get the input sample, little endian 16bits
-        sample=static_cast<short>(fgetc(input)|(fgetc(input)<<8));
-        
-        // todo - some stats on input samples to spot range problems
-        
-        // Update our state of our bit detect
-        if(sample >= 0)
+        state->rrdLogging=true;
+        state->rrdCommand=new char[50];
+        state->rrdFile=new char[params->rrdFilename.size()+5];
+        if(state->rrdCommand && state->rrdFile)
         {
-            if(lastSample < 0)
-            {
-                // just had a positive edge, low to high
-                negativeEdge=false;
-                edge=true;
-            }
-            highCount++;
+            snprintf(state->rrdCommand, 49, "update");
+            snprintf(state->rrdFile, params->rrdFilename.size()+1, "%s", 
+                            params->rrdFilename.c_str());
+            state->rrdArgs[0]=state->rrdCommand;
+            state->rrdArgs[1]=state->rrdFile;
         }
         else
         {
-            if(lastSample >= 0)
-            {
-                // just had a negative edge, high to low
-                // store off the length of the previous highs
-                accum=highCount; 
-                negativeEdge=true;
-                edge=true;
-            }
-            highCount=0; // reset the high count
-        }
-        
-        // detect sync
-        if(highCount >= MIN_SYNC_PULSE_SAMPLE_WIDTH)
-        {
-            sync=true;
-            byteCount=0; // reset to start of protocol bytes
-            gotPacket=false;
-            bitCount=0;
-            edge=false;
-            firstEdge=true;
+            fprintf(stderr, "Failed on rrd arg creation\n");
+            exit(1);
         }
-        //fprintf(stdout, "sync %d high %d\n", sync, highCount);
-        
-        if( sync & edge )
-        {
-            //fprintf(stdout, "sync and edge %d %d %d\n", edge, 
-            //                  negativeEdge, accum);
-            if(negativeEdge)
-            {
-                // ignore the first edge after sync seen
-                if(firstEdge)
-                {
-                    firstEdge=false;
-                }
-                else
-                {
-                    // we have a data bit 
-                    int bit=0; // default it to a zero
-                    if(accum > MIN_ONE_PULSE_WIDTH)
-                    {
-                        bit=1;
-                    }
-                    byte=(byte<<1)|bit; // shift the byte and add bit
-
-                    if(bitCount==7)
-                    {
-                        // we have 8bits
-                        packet[byteCount++]=byte;               
-                        
-                        if(byteCount>=(length))
-                        {
-                            gotPacket=true;
-                        }
-                        byte=0;
-                    }
-                    bitCount++;
-                    bitCount%=8;
-                }
-            } // if(negativeEdge)
-            edge=false;
-        } // if( sync & edge )
-        lastSample=sample;
-    } // while(!feof(input) && !gotPacket)
-    
-    return(gotPacket);
+    }
 }
 
-std::string getDateTime()
+void freeLogging(logState *state)
 {
-    // return a date time string
-    // output is compatible with a standard rrd database input format
-    // time will be in UTC so we don't have to worry about DST changes
-    //
-    // 2013-10-12 20:25:02
-    //
-    time_t now=time(0);
-    struct tm *timeNow;
-    timeNow=gmtime(&now);
-        char buffer[80]={0};
-        strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", timeNow);
-        if(buffer[79]!=0)
-        {
-        fprintf(stderr, "Buffer overrun in strftime()\n");
-        exit(1);
-    }
-    std::string dateTime=buffer;
-    return(dateTime);
+    delete [] state->rrdCommand;
+    delete [] state->rrdFile;
 }
 
-void logLatest(double power)
+void logInterval(void *arg)
 {
-    FILE *latest=fopen("latest.txt", "w");
-    if(latest)
+    // one interval's log entry, to file and rrd
+    // takes the decoder's interval maximum every time it logs to file
+    logState *state=static_cast<logState *>(arg);
+    threadParams *params=state->params;
+
+    // maximum power since we last logged, zero if none decoded
+    double power=efergyAggregatorTakeIntervalMax(params->aggregator);
+
+    bool estimated=false;
+
+    if(power == 0)
     {
-        std::string timeNow=getDateTime(); 
-        fprintf(latest, "%s, %.0f\n", timeNow.c_str(), power);
-        fclose(latest);
+        power=state->lastPower;
+        estimated=true;
+    }
+    
+    // logging to output file
+    lineValues values;
+    initLineValues(&values);
+    values.when=state->replayTime?state->replayTime:time(0);
+    values.power=power;
+    values.estimated=estimated;
+    formatLine(&params->logLine, &values, &state->line);
+    fwrite(state->line.text, 1, state->line.length, params->output);
+    fflush(params->output);
+    
+    // logging to rrd
+    if(state->rrdLogging)
+    {
+        // a replay updates at the time of the interval, rrd wants them
+        // in order so it only fills an rrd with nothing after them
+        char *end=state->rrdValue;
+        if(state->replayTime)
+            end=formatUnsigned(end, state->replayTime);
+        else
+            *end++='N';
+        *end++=':';
+        end=formatFixed(end, power, 0);
+        *end=0;
+        state->rrdArgs[2]=state->rrdValue;
+                            
+        //fprintf(stdout, "rrd %s %s %s\n", rrdArgs[0], rrdArgs[1], rrdArgs[2]);
+        
+#ifdef USE_RRD
+        if(rrd_update(3, state->rrdArgs) == -1)
+        {
+            fprintf(stderr, "Error, rrd failed, %s\n", 
+                            rrd_get_error());
+            rrd_clear_error();
+        }
+#endif
     }
-}
 
+    state->lastPower=power;
+}
 
 void* logData(void *arg)
 {
     // thread to log powers to file
     // arg is logging threadParams
-    // logs to file every delay seconds
-    // resets the global _power to zero every time it logs to file
+    // logs to file every delay minutes, synced to the minute
     
     struct threadParams *params=static_cast<struct threadParams *>(arg);
-    double lastPower=0;
-    double power=0;
-    bool rrdLogging=false;
-    char *rrdArgs[3];
-    char *rrdCommand=0;
-    char *rrdFile=0;
-
-    if(params->rrdFilename.size() > 0)
-    {
-        rrdLogging=true;
-        rrdCommand=new char[50];
-        rrdFile=new char[params->rrdFilename.size()+5];
-        if(rrdCommand && rrdFile)
-        {
-            snprintf(rrdCommand, 49, "update");
-            snprintf(rrdFile, params->rrdFilename.size()+1, "%s", 
-                            params->rrdFilename.c_str());
-            rrdArgs[0]=rrdCommand;
-            rrdArgs[1]=rrdFile;
-        }
-        else
-        {
-            fprintf(stderr, "Failed on rrd arg creation\n");
-            exit(1);
-        }
-    }
+    applyStageSettings(params->pipe, STAGE_LOG, &params->pipe->logStats);
+    logState state;
+    initLogging(&state, params);
 
     while(!_exitNow)
     {
@@ -435,121 +531,709 @@ void* logData(void *arg)
             sleep(1);
         }
         
-        // lock access to the global _power
-        pthread_mutex_lock(&dataLock);
-        power=_power;
-        _power=0;
-        pthread_mutex_unlock(&dataLock);
-
-        bool estimated=false;
-    
-        if(power == 0)
-        {
-            power=lastPower;
-            estimated=true;
-        }
+        logInterval(&state);
         
-        // logging to output file
-        std::string timeNow=getDateTime(); 
-        fprintf(params->output, "%s %.0f %c\n", timeNow.c_str(), 
-                                power, (estimated?'e':' '));        
-        fflush(params->output);
-        
-        // logging to rrd
-        if(rrdLogging)
-        {
-            char tmp[100]={0};
-            snprintf(tmp, 99, "N:%.0f", power); 
-            rrdArgs[2]=tmp;
-                                
-            //fprintf(stdout, "rrd %s %s %s\n", rrdArgs[0], rrdArgs[1], rrdArgs[2]);
-            
-#ifdef USE_RRD
-            if(rrd_update(3, rrdArgs) == -1)
-            {
-                fprintf(stderr, "Error, rrd failed, %s\n", 
-                                rrd_get_error());
-                rrd_clear_error();
-            }
-#endif
-        }
-        
-        // wait for next logging time, but allow quick exit
-        int delay=(60*params->delay)-10; 
-        while(!_exitNow && delay--)
+        // wait for next logging time, but allow quick exit, a period
+        // changed by a control command starts on the next minute
+        unsigned int minutes=__atomic_load_n(&params->delay, 
+                                __ATOMIC_RELAXED);
+        int delay=(60*minutes)-10; 
+        while(!_exitNow && delay-- && 
+            __atomic_load_n(&params->delay, __ATOMIC_RELAXED)==minutes)
         {
             sleep(1);
         }
-        
-        lastPower=power;
     }
     fprintf(stderr, "Logging thread exit\n");
+    stageStopped(&params->pipe->logStats);
 
-    delete [] rrdCommand;
-    delete [] rrdFile;
+    freeLogging(&state);
     
     return NULL;
 }
 
-void outputStats(unsigned long long totalPackets, 
-    unsigned long long passedPackets, unsigned long long ourPackets, 
-    mapOfDelayCounts statsGood)
+void outputCombineStats(FILE *out, efergyCombiner *combiner)
+{
+    // what having more than one receiver has bought us
+    if(!combiner)
+    {
+        return;
+    }
+    efergyCombineCounts counts;
+    counts.size=sizeof(counts);
+    efergyCombinerCounts(combiner, &counts);
+    unsigned long long bestSource=0;
+    fprintf(out, "Combined copies: %llu\n", counts.copies);
+    fprintf(out, "transmissions  : %llu\n", counts.groups);
+    fprintf(out, "good           : %llu\n", counts.good);
+    fprintf(out, "duplicates     : %llu\n", counts.duplicates);
+    fprintf(out, "majority fixed : %llu\n", counts.majority);
+    fprintf(out, "weighted fixed : %llu\n", counts.weighted);
+    fprintf(out, "failed         : %llu\n", counts.failed);
+    for(int s=0; s<EFERGY_MAX_SOURCES; s++)
+    {
+        if(counts.sourceGood[s])
+        {
+            fprintf(out, "\tinput %d good alone, %llu\n", s, 
+                        counts.sourceGood[s]);
+        }
+        if(counts.sourceGood[s]>bestSource)
+        {
+            bestSource=counts.sourceGood[s];
+        }
+    }
+    fprintf(out, "diversity gain : %llu packets over the best input\n", 
+                counts.good-bestSource);
+}
+
+void outputGateStats(FILE *out, const std::vector<efergyDecoder *> &decoders,
+            pipeline *pipe)
+{
+    // the samples between packets the gate skipped through, the cpu
+    // saved as the full decoder never saw them. The pipeline's decode
+    // threads are still counting, so its are from their snapshots
+    for(size_t i=0; i<decoders.size(); i++)
+    {
+        efergyCounts counts;
+        if(pipe)
+        {
+            rateAudit audit;
+            engineGovernor governor;
+            sourceSnapshot(pipe->sources[i], &audit, &governor, &counts);
+        }
+        else
+        {
+            counts.size=sizeof(counts);
+            efergyDecoderCounts(decoders[i], &counts);
+        }
+        fprintf(out, "Gate input %lu: %llu of %llu samples skipped, %.2f%%\n",
+                    static_cast<unsigned long>(i), counts.scanned, 
+                    counts.samples, counts.samples?
+                    (100.0*counts.scanned)/counts.samples:0.0);
+        if(counts.resliced>0 || counts.repaired>0)
+        {
+            fprintf(out, "Engine input %lu: %llu packets passed at another "
+                        "threshold, %llu with weak bits flipped\n", 
+                        static_cast<unsigned long>(i), counts.resliced, 
+                        counts.repaired);
+        }
+    }
+}
+
+void outputStats(const sinkParams *params)
 {
     FILE *statsF=fopen("stats.txt", "w");
     if (statsF)
     {
-        fprintf(statsF, "Total packets: %llu\n", totalPackets);
-        fprintf(statsF, "passed cksum : %llu\n", passedPackets);
-        fprintf(statsF, "passed addr  : %llu\n", ourPackets);
+        fprintf(statsF, "Total packets: %llu\n", params->totalPackets);
+        fprintf(statsF, "passed cksum : %llu\n", params->passedPackets);
+        fprintf(statsF, "passed addr  : %llu\n", params->ourPackets);
         fprintf(statsF, "Offsets, passed address packets\n");
         std::map<unsigned int, unsigned long long>::const_iterator stat;
-        for(stat=statsGood.begin(); stat!=statsGood.end(); stat++)
+        for(stat=params->statsGood.begin(); stat!=params->statsGood.end(); 
+                    stat++)
         {
-            double pc=(100*static_cast<double>(stat->second))/ourPackets;
+            double pc=(100*static_cast<double>(stat->second))/
+                        params->ourPackets;
             fprintf(statsF, "\t%u sec, %llu, %.2f%%\n", 
                                 stat->first, stat->second, pc);
         }
+        outputCombineStats(statsF, params->combiner);
+        outputGateStats(statsF, *params->decoders, params->pipe);
+        if(params->trace)
+            fprintf(statsF, "Debug lines  : %llu packets, %llu dropped\n",
+                        params->trace->pushed, params->trace->dropped);
+        if(params->captures->size()>0)
+            outputCaptureStats(statsF, *params->captures, 
+                        params->captureOut);
+        if(params->upstream)
+            outputUpstreamStats(statsF, params->upstream);
+        if(params->pipe)
+            outputStageStats(statsF, params->pipe);
+        if(params->loop)
+            outputEventLoopStats(statsF, params->loop);
         fclose(statsF);
     }
     return;
 }
 
-void accumulatePower(double power)
+void outputPacket(const efergyPacket *packet, void *arg)
 {
-    static double _totalPower=0.0;
-    static time_t _lastTime=time(0);
-    
-    time_t now=time(0);
+    // sink stage, everything done per packet after decoding
+    // a control command sees the sink between packets
+    sinkParams *params=static_cast<sinkParams *>(arg);
+    pthread_mutex_lock(&params->lock);
+
+    // a replayed packet has the time it was first seen
+    double now=params->replayTime;
+    if(now==0)
+    {
+        struct timespec wall;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        now=wall.tv_sec+wall.tv_nsec/1e9;
+    }
+
+    params->totalPackets++;
+    if(params->index)
+        indexPacket(params->index, packet);
+    if(params->journal)
+        journalPacket(params->journal, packet, now);
+    if(packet->checksumOk)
+        params->passedPackets++;
+    if(packet->accepted)
+        params->ourPackets++;
+    if((params->totalPackets%DEFAULT_STAT_PACKETS) == 0 )
+    {
+        outputStats(params);
+    }
+   
+    lineValues values;
+    initLineValues(&values);
+    values.when=static_cast<time_t>(now);
+    values.power=packet->power;
+    values.energy=packet->energy;
+    values.periods=packet->periods;
+    values.quality=packet->quality;
+    values.bytes=packet->bytes;
+    values.checksumOk=packet->checksumOk;
+    values.source=packet->source;
+
+    if(packet->accepted)
+    {
+        if(params->statsOutput)
+        {
+            // record times between good packets
+            time_t timeNow=values.when;
+            params->statsGood[(timeNow-params->lastPacketTime)]++;
+            params->lastPacketTime=timeNow;
+        }
     
-    // number of seconds between last and current
-    double diff=difftime(now, _lastTime);
-    diff=floor( (fabs(diff)+3) /6);
-
-    // totaling in kw/hr
-    _totalPower+=(power/600000)*diff;
-    fprintf(stdout, "TOTAL: %.3f %.0f %.1f\n", _totalPower, power, diff);
-    _lastTime=now;
+        // log latest to a file
+        logLatest(params, &values);
+    }
+
+    if(params->trace && (params->debug || params->debugAll))
+    {
+        // debugging, the writer thread does the stdout lines so a slow
+        // terminal can't hold up the decoding. The ring is there for 
+        // -u as well but without debug the totals go straight out, so 
+        // a full ring can't lose them
+        traceRecord record;
+        record.lines=0;
+        if(params->debugAll)
+            record.lines|=TRACE_ALL;
+        if(packet->accepted)
+            record.lines|=TRACE_TOTAL;
+        if(params->debug && packet->checksumOk)
+            record.lines|=TRACE_PASSED;
+        if(record.lines)
+        {
+            record.checksumOk=packet->checksumOk;
+            memcpy(record.bytes, packet->bytes, EFERGY_PACKET_BYTES);
+            record.source=packet->source;
+            record.when=values.when;
+            record.power=packet->power;
+            record.energy=packet->energy;
+            record.periods=packet->periods;
+            record.quality=packet->quality;
+            tracePush(params->trace, &record);
+        }
+    }
+    else if(packet->accepted)
+    {
+        // energy total for the meter, kept by the decoder in kw/hr
+        formatLine(&params->totalLine, &values, &params->line);
+        fwrite(params->line.text, 1, params->line.length, stdout);
+    }
+    pthread_mutex_unlock(&params->lock);
     return;
 }
 
+int replayJournal(const std::string &path, double from, double seconds,
+            efergyAggregator *aggregator, sinkParams *sink, 
+            logState *logging, unsigned int logMinutes)
+{
+    // the packets back through the aggregation and the sink as fast as
+    // they can be read, the log intervals are the ones the times of
+    // the packets pass, so the log and rrd come out as they would have
+    journalReader reader;
+    if(!openJournalReader(&reader, path))
+    {
+        return(1);
+    }
+    double first=reader.header.startTime+from;
+    double last=(seconds>0)?first+seconds:0;
+    if(from>0)
+    {
+        seekJournal(&reader, first);
+    }
+    fprintf(stderr, "Replaying journal '%s'\n", path.c_str());
+
+    time_t period=60*(logMinutes?logMinutes:1);
+    time_t interval=0;
+    unsigned long long replayed=0;
+    unsigned long long intervals=0;
+    journalRecord record;
+    while(!_exitNow && readJournal(&reader, &record))
+    {
+        if(record.time<first)
+            continue;
+        if(last>0 && record.time>=last)
+            break;
+        time_t when=static_cast<time_t>(record.time);
+        if(interval==0)
+        {
+            // the first log is on the minute after the first packet
+            interval=when-(when%60)+60;
+        }
+        while(when>=interval)
+        {
+            logging->replayTime=interval;
+            logInterval(logging);
+            interval+=period;
+            intervals++;
+        }
+
+        efergyPacket packet;
+        memset(&packet, 0, sizeof(packet));
+        packet.size=sizeof(packet);
+        memcpy(packet.bytes, record.bytes, EFERGY_PACKET_BYTES);
+        packet.time=record.packetTime;
+        packet.source=record.source;
+        packet.quality=record.quality;
+        packet.checksumOk=(record.flags&JOURNAL_CHECKSUM)?1:0;
+        efergyAggregatorPush(aggregator, &packet);
+        sink->replayTime=record.time;
+        outputPacket(&packet, sink);
+        replayed++;
+    }
+    sink->replayTime=0;
+    closeJournalReader(&reader);
+    fprintf(stderr, "Replayed %llu packets, %llu log intervals\n", 
+                replayed, intervals);
+    return(0);
+}
+
+bool parseRegion(const char *text, double *from, double *seconds)
+{
+    // from[+seconds], seconds into the capture
+    *seconds=0;
+    int got=sscanf(text, "%lf+%lf", from, seconds);
+    return(got>=1 && *from>=0 && *seconds>=0);
+}
+
+static double monotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec+now.tv_nsec/1e9);
+}
+
+bool liveInput(const std::string &name)
+{
+    // stdin or a fifo from rtl_fm, rather than a recording read as
+    // fast as it will go
+    struct stat status;
+    int got=(name=="-")?fstat(STDIN_FILENO, &status):
+                stat(name.c_str(), &status);
+    return(got==0 && !S_ISREG(status.st_mode));
+}
+
+bool parseAddress(const char *text, unsigned char *address)
+{
+    // always hate doing this bit
+    // assuming the string is in the format "0x123456"
+    int tmp[3];
+    if(sscanf(text, "0x%02x%02x%02x", &tmp[0], &tmp[1], &tmp[2]) != 3)
+    {
+        return(false);
+    }
+    address[0]=tmp[0]&0xff;
+    address[1]=tmp[1]&0xff;
+    address[2]=tmp[2]&0xff;
+    return(true);
+}
+
+int decodeRegion(FILE *input, double from, double seconds, float voltage)
+{
+    // only the part of a run capture asked for, the index takes us 
+    // close to it rather than decoding the capture from the start
+    runsCapture capture;
+    if(!openRuns(input, &capture))
+    {
+        return(1);
+    }
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    config.voltage=voltage;
+    config.sampleRate=capture.header.sampleRate;
+    unsigned long long first=
+        static_cast<unsigned long long>(from*config.sampleRate);
+    unsigned long long last=(seconds>0)?
+        first+static_cast<unsigned long long>(seconds*config.sampleRate):
+        ULLONG_MAX;
+    // start a little early for a packet whose start pulse is cut by 
+    // the index entry
+    unsigned long long lead=static_cast<unsigned long long>(
+                            RUNS_LEAD_SECONDS*config.sampleRate);
+    unsigned long long at=seekRuns(&capture, (first>lead)?first-lead:0);
+    fprintf(stderr, "Decoding from sample %llu, %.1f seconds before the "
+                "region\n", at, (first-at)/config.sampleRate);
+
+    efergyDecoder *decoder=efergyDecoderCreate(&config);
+    if(!decoder)
+    {
+        fprintf(stderr, "Failed, can't create a decoder for the run "
+                    "capture\n");
+        return(1);
+    }
+    efergyDecoderStartAt(decoder, at);
+    unsigned char bytes[INPUT_BLOCK_SIZE];
+    unsigned long long found=0;
+    size_t got;
+    efergyCounts counts;
+    counts.size=sizeof(counts);
+    counts.samples=0;
+    while(at+counts.samples<last &&
+        (got=fread(bytes, 1, sizeof(bytes), input))>0)
+    {
+        efergyDecoderPushRuns(decoder, bytes, got);
+        efergyDecoderCounts(decoder, &counts);
+        efergyPacket packet;
+        packet.size=sizeof(packet);
+        while(efergyDecoderPoll(decoder, &packet))
+        {
+            if(packet.start<first || packet.start>=last)
+                continue;
+            time_t when=capture.header.startTime+
+                        static_cast<time_t>(packet.time);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", 
+                        localtime(&when));
+            fprintf(stdout, "%s %.3f %llu ", stamp, packet.time, 
+                        packet.start);
+            for(int b=0; b<EFERGY_PACKET_BYTES; b++)
+            {
+                fprintf(stdout, "%02x", packet.bytes[b]);
+            }
+            fprintf(stdout, " %s %.0f\n", packet.checksumOk?"P":"F",
+                        packet.power);
+            found++;
+        }
+    }
+    efergyDecoderDestroy(decoder);
+    fprintf(stderr, "%llu packets in the region, %llu samples decoded\n",
+                found, counts.samples);
+    return(0);
+}
+
+// what the control commands can change
+struct controlParams
+{
+    efergyAggregator *aggregator;
+    sinkParams *sink;
+    threadParams *log;
+    eventLoop *loop;         // 0 when the logging thread has the period
+    double voltage;
+};
+
+static bool setFlag(const char *text, bool *flag)
+{
+    if(strcmp(text, "on")==0)
+        *flag=true;
+    else if(strcmp(text, "off")==0)
+        *flag=false;
+    else
+        return(false);
+    return(true);
+}
+
+bool controlCommand(const char *command, std::string *reply, void *arg)
+{
+    // a line from the control socket, on the event loop between blocks
+    // or on the control thread, the aggregation and the sink are 
+    // locked while they change, so each packet sees the old settings
+    // or the new ones
+    controlParams *control=static_cast<controlParams *>(arg);
+    sinkParams *sink=control->sink;
+    char verb[CONTROL_LINE_LENGTH];
+    char first[CONTROL_LINE_LENGTH];
+    char second[CONTROL_LINE_LENGTH];
+    char text[128];
+    int words=sscanf(command, "%s %s %s", verb, first, second);
+    unsigned char address[EFERGY_ADDRESS_BYTES];
+
+    if(words<1)
+    {
+        *reply="no command";
+        return(false);
+    }
+    if(strcmp(verb, "help")==0)
+    {
+        *reply+="address [add 0x123456|remove 0x123456|all]\n";
+        *reply+="interval minutes\n";
+        *reply+="voltage volts\n";
+        *reply+="debug on|off\n";
+        *reply+="debugall on|off\n";
+        *reply+="stats\n";
+        *reply+="flush\n";
+        return(true);
+    }
+    if(strcmp(verb, "address")==0 && words==1)
+    {
+        unsigned char addresses[CONTROL_ADDRESSES][EFERGY_ADDRESS_BYTES];
+        int count=efergyAggregatorAddresses(control->aggregator, addresses,
+                    CONTROL_ADDRESSES);
+        if(count<0)
+            *reply+="all\n";
+        for(int a=0; a<count && a<CONTROL_ADDRESSES; a++)
+        {
+            snprintf(text, sizeof(text), "0x%02x%02x%02x\n", 
+                        addresses[a][0], addresses[a][1], addresses[a][2]);
+            *reply+=text;
+        }
+        return(true);
+    }
+    if(strcmp(verb, "address")==0 && words==2 && strcmp(first, "all")==0)
+    {
+        efergyAggregatorAcceptAll(control->aggregator);
+        fprintf(stderr, "Control, all meter addresses used\n");
+        return(true);
+    }
+    if(strcmp(verb, "address")==0 && words==3 && 
+        (strcmp(first, "add")==0 || strcmp(first, "remove")==0))
+    {
+        if(!parseAddress(second, address))
+        {
+            *reply="can't parse address '"+std::string(second)+
+                    "', eg 0x123456";
+            return(false);
+        }
+        bool add=(strcmp(first, "add")==0);
+        bool changed=add?
+            efergyAggregatorAddAddress(control->aggregator, address):
+            efergyAggregatorRemoveAddress(control->aggregator, address);
+        if(!changed)
+        {
+            *reply=std::string("address ")+second+
+                    (add?" is already used":" isn't used");
+            return(false);
+        }
+        fprintf(stderr, "Control, %s address '%02x%02x%02x'\n", 
+                    add?"using":"no longer using", 
+                    address[0], address[1], address[2]);
+        return(true);
+    }
+    if(strcmp(verb, "interval")==0 && words==2)
+    {
+        unsigned int minutes;
+        if(sscanf(first, "%u", &minutes)!=1 || minutes<1)
+        {
+            *reply="can't convert '"+std::string(first)+"' to minutes";
+            return(false);
+        }
+        __atomic_store_n(&control->log->delay, minutes, __ATOMIC_RELAXED);
+        if(control->loop && !setLoopInterval(control->loop, minutes))
+        {
+            *reply="can't restart the log timer";
+            return(false);
+        }
+        fprintf(stderr, "Control, logging every %u minute%c\n", 
+                    minutes, (minutes>1)?'s':' ');
+        return(true);
+    }
+    if(strcmp(verb, "voltage")==0 && words==2)
+    {
+        double voltage;
+        if(sscanf(first, "%lf", &voltage)!=1 || voltage<=0)
+        {
+            *reply="can't convert '"+std::string(first)+"' to voltage";
+            return(false);
+        }
+        efergyAggregatorSetVoltage(control->aggregator, voltage);
+        control->voltage=voltage;
+        fprintf(stderr, "Control, using %.0fvolts for power calculations\n",
+                    voltage);
+        return(true);
+    }
+    if((strcmp(verb, "debug")==0 || strcmp(verb, "debugall")==0) && 
+        words==2)
+    {
+        bool on;
+        if(!setFlag(first, &on))
+        {
+            *reply="debug is on or off";
+            return(false);
+        }
+        pthread_mutex_lock(&sink->lock);
+        if(strcmp(verb, "debug")==0)
+            sink->debug=on;
+        else
+            sink->debugAll=on;
+        pthread_mutex_unlock(&sink->lock);
+        return(true);
+    }
+    if(strcmp(verb, "stats")==0 && words==1)
+    {
+        // stats.txt as well, as -s writes it
+        pthread_mutex_lock(&sink->lock);
+        outputStats(sink);
+        snprintf(text, sizeof(text), "packets %llu passed %llu accepted "
+                    "%llu\n", sink->totalPackets, sink->passedPackets,
+                    sink->ourPackets);
+        *reply+=text;
+        snprintf(text, sizeof(text), "interval %u voltage %.0f debug %s "
+                    "debugall %s\n", 
+                    __atomic_load_n(&control->log->delay, __ATOMIC_RELAXED),
+                    control->voltage, sink->debug?"on":"off", 
+                    sink->debugAll?"on":"off");
+        *reply+=text;
+        if(sink->trace)
+        {
+            snprintf(text, sizeof(text), "debug lines %llu dropped %llu\n",
+                        sink->trace->pushed, sink->trace->dropped);
+            *reply+=text;
+        }
+        if(sink->upstream)
+        {
+            snprintf(text, sizeof(text), "upstream starts %llu stalls %llu "
+                        "ended %llu\n", sink->upstream->starts, 
+                        sink->upstream->stalls, sink->upstream->exits);
+            *reply+=text;
+        }
+        int inputs=sink->pipe?sink->pipe->sourceCount:
+                    sink->loop->sourceCount;
+        for(int i=0; i<inputs; i++)
+        {
+            // the pipeline's decode threads are still updating them, 
+            // the event loop's are on this thread
+            rateAudit auditCopy;
+            engineGovernor governorCopy;
+            const rateAudit *audit=&auditCopy;
+            const engineGovernor *governor=&governorCopy;
+            if(sink->pipe)
+            {
+                efergyCounts counts;
+                sourceSnapshot(sink->pipe->sources[i], &auditCopy, 
+                            &governorCopy, &counts);
+            }
+            else
+            {
+                audit=&sink->loop->sources[i].audit;
+                governor=&sink->loop->sources[i].governor;
+            }
+            if(audit->rate>0)
+            {
+                snprintf(text, sizeof(text), "input %d ppm %.1f%s drops "
+                            "%llu lost %.3f deviations %llu\n", i, 
+                            audit->ppm, audit->ppmReady?"":" unknown",
+                            audit->drops, audit->dropped, 
+                            audit->deviations);
+                *reply+=text;
+            }
+            if(governor->byteRate>0)
+            {
+                snprintf(text, sizeof(text), "input %d engine %s switches "
+                            "%llu load %.3f", i, 
+                            engineNames[governor->engine], 
+                            governor->switches, governor->load);
+                *reply+=text;
+                double now=monotonicTime();
+                for(int e=0; e<=governor->ceiling; e++)
+                {
+                    snprintf(text, sizeof(text), " %s %.1f", engineNames[e],
+                                governorSeconds(governor, e, now));
+                    *reply+=text;
+                }
+                *reply+="\n";
+            }
+        }
+        pthread_mutex_unlock(&sink->lock);
+        return(true);
+    }
+    if(strcmp(verb, "flush")==0 && words==1)
+    {
+        // what is buffered on its way to disk, the debug lines are the
+        // writer thread's and go out once it has them
+        pthread_mutex_lock(&sink->lock);
+        fflush(control->log->output);
+        fflush(stdout);
+        if(sink->journal)
+            fflush(sink->journal->file);
+        if(sink->index && sink->index->file)
+            fflush(sink->index->file);
+        pthread_mutex_unlock(&sink->lock);
+        return(true);
+    }
+    *reply="unknown command '"+std::string(command)+"', try help";
+    return(false);
+}
+
 void printHelp(char *programName)
 {
-    fprintf(stderr, "Usage: %s [-aAdhlrsv] logFile\n", programName);
+    fprintf(stderr, "Usage: %s [-aABcCdeEfFgGhiIjJlLpPrRsStTuvxX] logFile\n", programName);
     fprintf(stderr, "\n");
     fprintf(stderr, "Efergy meter decoder, requires rtl_fm as input\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "-a x  : Address x for filtering, eg 0x123456\n");
     fprintf(stderr, "-A    : All meter addresses used\n");
+    fprintf(stderr, "-B    : Benchmark decoder yield on generated signal\n");
+    fprintf(stderr, "-C x  : Compare decoder engines x on the capture on stdin,\n");
+    fprintf(stderr, "        comma separated or all, each on its own cpu\n");
+    fprintf(stderr, "-c x  : Keep x seconds of samples, written to a capture\n");
+    fprintf(stderr, "        file around packets lost or damaged\n");
     fprintf(stderr, "-d    : Debug, prints all cksum passed packets\n");
     fprintf(stderr, "-D    : Debug, print all packets\n");
+    fprintf(stderr, "-e    : Everything on one thread, an event loop in place\n");
+    fprintf(stderr, "        of the stages, -p is ignored\n");
+    fprintf(stderr, "-E x  : Decoder engine x, gated, full, hypothesis or repair,\n");
+    fprintf(stderr, "        a live input steps up to it as the cpu allows\n");
+    fprintf(stderr, "-f x  : Sample format of the inputs, s16le (rtl_fm), s16be,\n");
+    fprintf(stderr, "        s8, u8 or f32le, wav and SigMF inputs give their own\n");
+    fprintf(stderr, "-F    : Check the number formatting against printf\n");
+    fprintf(stderr, "-g x  : Check packets decoded from stdin against golden file x\n");
+    fprintf(stderr, "-G x  : Accept packets decoded from stdin as golden file x\n");
     fprintf(stderr, "-h    : This help\n");
+    fprintf(stderr, "-i x  : Input from file or fifo x, repeat for more inputs,\n");
+    fprintf(stderr, "        default is stdin, - for stdin as well\n");
+    fprintf(stderr, "-I x  : Run command x, eg rtl_fm, for stdin, restarted if\n");
+    fprintf(stderr, "        it ends or sends nothing for %ds\n", 
+                                UPSTREAM_STALL_SECONDS);
+    fprintf(stderr, "-j x  : Keep every packet in binary journal x, added to if\n");
+    fprintf(stderr, "        it exists\n");
+    fprintf(stderr, "-J x  : Replay journal x through the aggregation, log and\n");
+    fprintf(stderr, "        rrd in place of decoding, -t for part of it\n");
     fprintf(stderr, "-l    : Log period in minutes, default %d\n", 
                                 DEFAULT_LOG_PERIOD);
-    fprintf(stderr, "-r x  : enable rrd logging to database file x\n");     
+    fprintf(stderr, "-L x  : Log line template, default '%s', fields\n", 
+                                DEFAULT_LOG_LINE);
+    fprintf(stderr, "        {date} {time} {power} {estimated}, {power.1} for\n");
+    fprintf(stderr, "        decimals\n");
+    fprintf(stderr, "-p x  : Place a stage, x is stage=cpu[:nice[:priority]],\n");
+    fprintf(stderr, "        stages ingest decode sink log, cpu -1 for any, a\n");
+    fprintf(stderr, "        priority runs it SCHED_FIFO\n");
+    fprintf(stderr, "-P    : Pack rtl_fm samples from stdin to a 1 bit capture\n");
+    fprintf(stderr, "        on stdout, it can be read back with -i or -g\n");
+    fprintf(stderr, "-r x  : enable rrd logging to database file x\n");
+    fprintf(stderr, "-R    : Record rtl_fm samples from stdin to an indexed run\n");
+    fprintf(stderr, "        capture on stdout, for -t, -i or -g\n");     
     fprintf(stderr, "-s    : Stats every %d packets to stats.txt\n", 
                                 DEFAULT_STAT_PACKETS);
+    fprintf(stderr, "-S x  : Write a generated capture at x dB SNR to stdout\n");
+    fprintf(stderr, "-t x  : Decode only x of a run capture on stdin, x is\n");
+    fprintf(stderr, "        from[+seconds], seconds into the capture, or with\n");
+    fprintf(stderr, "        -J replay only x of the journal\n");
+    fprintf(stderr, "-T x  : Real time, memory locked and ingest and decode\n");
+    fprintf(stderr, "        at SCHED_FIFO priority x, not with -e\n");
+    fprintf(stderr, "-u x  : Take commands on unix socket x, to change the\n");
+    fprintf(stderr, "        addresses, log period, voltage and debug without\n");
+    fprintf(stderr, "        a restart, send it help for the list\n");
     fprintf(stderr, "-v x  : Voltage to use, default %0.fv\n", 
                                 DEFAULT_VOLTAGE);
+    fprintf(stderr, "-x x  : Write the position of every packet to index file x\n");
+    fprintf(stderr, "-X x  : Write them as annotations to SigMF metadata file x,\n");
+    fprintf(stderr, "        -x and -X take one input\n");
     fprintf(stderr, "\n");
     return;
 }
@@ -569,15 +1253,41 @@ int main(int argc, char **argv)
     bool debugAll=false;
     bool ignoreAddress=false;
     bool statsOutput=false;
+    bool benchmark=false;
+    bool formatCheck=false;
+    bool singleThread=false;
+    double captureSeconds=0;
+    std::string goldenFilename;
+    bool acceptGolden=false;
+    bool synthetic=false;
+    bool pack=false;
+    bool recordRun=false;
+    int inputFormat=EFERGY_FORMAT_S16LE;
+    std::string indexFilename;
+    std::string journalFilename;
+    std::string replayFilename;
+    std::string compareNames;
+    std::string sigmfFilename;
+    std::string controlPath;
+    std::string upstreamCommand;
+    bool region=false;
+    double regionFrom=0;
+    double regionSeconds=0;
+    double syntheticSnr=0;
+    int realtimePriority=0;
+    int engineCeiling=-1;
     std::string addressString;
     float voltage=DEFAULT_VOLTAGE;
     unsigned int logPeriod=DEFAULT_LOG_PERIOD;
+    std::string logLine=DEFAULT_LOG_LINE;
     std::string rrdFilename="";
+    std::vector<std::string> stagePlacements;
+    std::vector<std::string> inputs;
     
     // parse command line parameters
     opterr = 0;
     int command;
-        while ((command = getopt (argc, argv, "a:AdDhl:r:sv:")) != -1)
+        while ((command = getopt (argc, argv, "a:ABc:C:dDeE:f:Fg:G:hi:I:j:J:l:L:p:Pr:RsS:t:T:u:v:x:X:")) != -1)
         {
         switch (command)
         {
@@ -593,6 +1303,63 @@ int main(int argc, char **argv)
                 debugAll=true;
                 fprintf(stderr, "Debug of all packets to stdout enabled\n");
                 break;
+            case 'B':
+                benchmark=true;
+                break;
+            case 'F':
+                formatCheck=true;
+                break;
+            case 'c':
+            {
+                if(sscanf(optarg, "%lf", &captureSeconds)!=1 || 
+                    captureSeconds<=0)
+                {
+                    fprintf(stderr, "Failed, can't convert '%s' from -c option to seconds\n", optarg);
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                fprintf(stderr, "Keeping %.0f seconds of samples for captures\n", 
+                            captureSeconds);
+                break;
+            }
+            case 'C':
+                compareNames=optarg;
+                break;
+            case 'e':
+                singleThread=true;
+                fprintf(stderr, "Single thread event loop enabled\n");
+                break;
+            case 'E':
+            {
+                engineCeiling=parseEngine(optarg);
+                if(engineCeiling<0)
+                {
+                    fprintf(stderr, "Failed, unknown decoder engine '%s' from -E option\n", optarg);
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                fprintf(stderr, "Decoder engine %s\n", engineNames[engineCeiling]);
+                break;
+            }
+            case 'f':
+            {
+                inputFormat=parseFormat(optarg);
+                if(inputFormat<0)
+                {
+                    fprintf(stderr, "Failed, unknown sample format '%s' from -f option\n", optarg);
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                fprintf(stderr, "Input samples are %s\n", formatName(inputFormat));
+                break;
+            }
+            case 'g':
+                goldenFilename=optarg;
+                break;
+            case 'G':
+                goldenFilename=optarg;
+                acceptGolden=true;
+                break;
             case 'A':
                 ignoreAddress=true;
                 fprintf(stderr, "Ignore of efergy address bytes enabled\n");
@@ -602,6 +1369,25 @@ int main(int argc, char **argv)
                 addressString=optarg;
                 break;
             }
+            case 'i':
+            {
+                if(inputs.size()>=MAX_SOURCES)
+                {
+                    fprintf(stderr, "Failed, no more than %d inputs\n", MAX_SOURCES);
+                    exit(1);
+                }
+                inputs.push_back(optarg);
+                break;
+            }
+            case 'I':
+                upstreamCommand=optarg;
+                break;
+            case 'j':
+                journalFilename=optarg;
+                break;
+            case 'J':
+                replayFilename=optarg;
+                break;
             case 'l':
             {
                 if(sscanf(optarg, "%u", &logPeriod)!=1)
@@ -616,16 +1402,90 @@ int main(int argc, char **argv)
                 }
                 break;
             }
+            case 'L':
+            {
+                // compiled again once the logging is set up, this is
+                // only to fail before anything starts
+                lineTemplate check;
+                compileLine(optarg, &check);
+                logLine=optarg;
+                fprintf(stderr, "Log line '%s'\n", optarg);
+                break;
+            }
+            case 'p':
+            {
+                stageSettings check[STAGE_COUNT];
+                if(!parseStageSettings(optarg, check))
+                {
+                    fprintf(stderr, "Failed, can't parse stage placement '%s' from -p option\n", optarg);
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                stagePlacements.push_back(optarg);
+                break;
+            }
+            case 'P':
+            {
+                pack=true;
+                break;
+            }
             case 'r':
             {
                 rrdFilename=optarg;
                 break;
             }
+            case 'R':
+            {
+                recordRun=true;
+                break;
+            }
             case 's':
             {
                 statsOutput=true;
                 break;
             }
+            case 'S':
+            {
+                if(sscanf(optarg, "%lf", &syntheticSnr)!=1)
+                {
+                    fprintf(stderr, "Failed, can't convert '%s' from -S option to dB\n", optarg);
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                synthetic=true;
+                break;
+            }
+            case 't':
+            {
+                if(!parseRegion(optarg, &regionFrom, &regionSeconds))
+                {
+                    fprintf(stderr, "Failed, can't convert '%s' from -t option to a region\n", optarg);
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                region=true;
+                break;
+            }
+            case 'T':
+            {
+                if(sscanf(optarg, "%d", &realtimePriority)!=1 ||
+                    realtimePriority<1 || 
+                    realtimePriority>sched_get_priority_max(SCHED_FIFO))
+                {
+                    fprintf(stderr, "Failed, can't convert '%s' from -T option to a real time priority, 1 to %d\n", 
+                                optarg, sched_get_priority_max(SCHED_FIFO));
+                    printHelp(argv[0]);
+                    exit(1);
+                }
+                fprintf(stderr, "Real time priority %d for ingest and decode\n",
+                            realtimePriority);
+                break;
+            }
+            case 'u':
+            {
+                controlPath=optarg;
+                break;
+            }
             case 'v':
             {
                 if(sscanf(optarg, "%f", &voltage)!=1)
@@ -640,16 +1500,53 @@ int main(int argc, char **argv)
                 }
                 break;
             }
+            case 'x':
+            {
+                indexFilename=optarg;
+                break;
+            }
+            case 'X':
+            {
+                sigmfFilename=optarg;
+                break;
+            }
             case '?':
             {
                 if(optopt=='a')
                     fprintf(stderr, "Failed, '-a' requires argument, eg -a0xab1234\n\n");
+                if(optopt=='c')
+                    fprintf(stderr, "Failed, '-c' requires argument, eg -c15\n\n");
+                if(optopt=='C')
+                    fprintf(stderr, "Failed, '-C' requires argument, eg -Cdefault,gated\n\n");
+                if(optopt=='E')
+                    fprintf(stderr, "Failed, '-E' requires argument, eg -Erepair\n\n");
+                if(optopt=='f')
+                    fprintf(stderr, "Failed, '-f' requires argument, eg -fs8\n\n");
+                if(optopt=='g' || optopt=='G')
+                    fprintf(stderr, "Failed, '-%c' requires argument, eg -%cgolden.txt\n\n", optopt, optopt);
+                if(optopt=='i')
+                    fprintf(stderr, "Failed, '-i' requires argument, eg -i/tmp/dongle1\n\n");
+                if(optopt=='I')
+                    fprintf(stderr, "Failed, '-I' requires argument, eg -I\"rtl_fm -f433550000 -r96000\"\n\n");
                 if(optopt=='l')
                     fprintf(stderr, "Failed, '-l' requires argument, eg -l10\n\n");
+                if(optopt=='p')
+                    fprintf(stderr, "Failed, '-p' requires argument, eg -pdecode=2\n\n");
                 if(optopt=='r')
                     fprintf(stderr, "Failed, '-r' requires argument, eg -rpowers.rrd\n\n");
+                if(optopt=='S')
+                    fprintf(stderr, "Failed, '-S' requires argument, eg -S12\n\n");
+                if(optopt=='t')
+                    fprintf(stderr, "Failed, '-t' requires argument, eg -t3600+60\n\n");
+                if(optopt=='T')
+                    fprintf(stderr, "Failed, '-T' requires argument, eg -T20\n\n");
+                if(optopt=='u')
+                    fprintf(stderr, "Failed, '-u' requires argument, eg -u/tmp/efergy.ctl\n\n");
                 if(optopt=='v')
                     fprintf(stderr, "Failed, '-v' requires argument, eg -v240\n\n");
+                if(optopt=='x' || optopt=='X')
+                    fprintf(stderr, "Failed, '-%c' requires argument, eg -%cpackets.%s\n\n", 
+                                optopt, optopt, (optopt=='x')?"idx":"sigmf-meta");
                 printHelp(argv[0]);
                 exit(1);
                 break;
@@ -659,6 +1556,88 @@ int main(int argc, char **argv)
         }
     }
     
+    // benchmark runs on generated data, no log file needed
+    if(benchmark)
+    {
+        runBenchmark();
+        exit(0);
+    }
+    if(formatCheck)
+    {
+        exit(checkFormatting());
+    }
+
+    if(synthetic)
+    {
+        writeSynthetic(syntheticSnr);
+        exit(0);
+    }
+
+    if(pack)
+    {
+        efergyConfig defaults;
+        defaults.size=sizeof(defaults);
+        efergyDefaultConfig(&defaults);
+        unsigned long long samples=recordPacked(stdin, stdout, 
+                                    defaults.sampleRate);
+        fprintf(stderr, "Packed %llu samples\n", samples);
+        exit(0);
+    }
+
+    if(recordRun)
+    {
+        efergyConfig defaults;
+        defaults.size=sizeof(defaults);
+        efergyDefaultConfig(&defaults);
+        unsigned long long samples=recordRuns(stdin, stdout, 
+                                    defaults.sampleRate, RUNS_INDEX_SECONDS);
+        fprintf(stderr, "Recorded %llu samples as runs\n", samples);
+        exit(0);
+    }
+
+    // a region of a journal is replayed, otherwise of a run capture
+    bool replaying=(replayFilename.size()>0);
+    if(region && !replaying)
+    {
+        exit(decodeRegion(stdin, regionFrom, regionSeconds, voltage));
+    }
+    if(replaying && (inputs.size()>0 || captureSeconds>0 || 
+        indexFilename.size()>0 || sigmfFilename.size()>0 ||
+        controlPath.size()>0 || upstreamCommand.size()>0 || 
+        engineCeiling>=0))
+    {
+        fprintf(stderr, "Failed, -J replays a journal in place of inputs, "
+                    "no -i, -I, -c, -E, -u, -x or -X\n");
+        exit(1);
+    }
+
+    if(inputs.size()>1 && 
+        (indexFilename.size()>0 || sigmfFilename.size()>0))
+    {
+        // the offsets are each in their own input's samples
+        fprintf(stderr, "Failed, -x and -X index the samples of one input, "
+                    "not %lu\n", static_cast<unsigned long>(inputs.size()));
+        exit(1);
+    }
+
+    if(realtimePriority>0 && (singleThread || replaying))
+    {
+        // the sink and log would share the real time thread
+        fprintf(stderr, "Failed, -T is for the stages, not -e or -J\n");
+        exit(1);
+    }
+
+    if(compareNames.size()>0)
+    {
+        exit(compareEngines(compareNames, inputFormat));
+    }
+
+    // regression check of a capture, no log file needed
+    if(goldenFilename.size()>0)
+    {
+        exit(checkGolden(goldenFilename, acceptGolden, inputFormat));
+    }
+
     // get the output log filename
     if((argc-optind) != 1)
     {
@@ -707,15 +1686,8 @@ int main(int argc, char **argv)
     }
     else
     {
-        // always hate doing this bit
-        // assuming the string is in the format "0x123456"
-        int tmp[3];
-        if(sscanf(addressString.c_str(), "0x%02x%02x%02x", 
-                            &tmp[0], &tmp[1], &tmp[2]) == 3)
+        if(parseAddress(addressString.c_str(), address))
         {
-            address[0]=tmp[0]&0xff;
-            address[1]=tmp[1]&0xff;
-            address[2]=tmp[2]&0xff;
             fprintf(stderr, "Using address '%02x%02x%02x' for filtering\n", 
                             address[0], address[1], address[2]);
         }
@@ -728,120 +1700,443 @@ int main(int argc, char **argv)
         }
     }
     
-    // create a thread to perform the logging
-    int ptherr;
-    pthread_t loggingTid=0;
+    // the address filter and aggregation shared by all the inputs
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    config.voltage=voltage;
+    config.filterAddress=!ignoreAddress;
+    memcpy(config.address, address, sizeof(address));
+    efergyAggregator *aggregator=efergyAggregatorCreate(&config);
+
+    // the command's output comes in as stdin
+    bool supervised=(upstreamCommand.size()>0);
+    if(supervised && inputs.size()>0 && 
+        std::find(inputs.begin(), inputs.end(), "-")==inputs.end())
+    {
+        fprintf(stderr, "Failed, -I is read as stdin, add -i- to the "
+                    "inputs\n");
+        exit(1);
+    }
+
+    // a decoder for each input, stdin if none given
+    // several inputs may hear the same transmission, so their decoders
+    // feed a combiner in front of the aggregation
+    if(inputs.size()==0 && !replaying)
+    {
+        inputs.push_back("-");
+    }
+    efergyCombiner *combiner=0;
+    if(inputs.size()>1)
+    {
+        combiner=efergyCombinerCreate(COMBINE_WINDOW, aggregator);
+        if(engineCeiling>EFERGY_ENGINE_FULL)
+        {
+            // the decoders have no aggregation to check a meter against
+            fprintf(stderr, "Warning, with more than one input the combiner "
+                        "repairs the packets, -E %s decodes as full\n", 
+                        engineNames[engineCeiling]);
+        }
+    }
+
+    // the stages of the processing, placement from -p options, or the
+    // event loop doing it all on this thread
+    pipeline *pipe=0;
+    eventLoop *loop=0;
+    if(replaying)
+    {
+        // the packets come from the journal, no decoding
+    }
+    else if(singleThread)
+    {
+        // the loop reads SIGINT and SIGTERM from a descriptor, blocked
+        // here before any thread starts so every thread inherits it and
+        // none of them takes the signal for the handler
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, 0);
+        loop=new eventLoop;
+        initEventLoop(loop);
+        loop->combiner=combiner;
+    }
+    else
+    {
+        pipe=new pipeline;
+        initPipeline(pipe);
+        pipe->exitNow=&_exitNow;
+        pipe->combiner=combiner;
+        for(size_t p=0; p<stagePlacements.size(); p++)
+        {
+            parseStageSettings(stagePlacements[p].c_str(), pipe->settings);
+        }
+        if(realtimePriority>0)
+        {
+            // a priority from -p stands, the sink and log stay normal
+            for(int s=STAGE_INGEST; s<=STAGE_DECODE; s++)
+            {
+                if(pipe->settings[s].priority==0)
+                    pipe->settings[s].priority=realtimePriority;
+            }
+            // before any thread starts so their stacks are small, a 
+            // real time decode that can page fault isn't real time
+            if(!startRealtime())
+            {
+                exit(1);
+            }
+        }
+    }
+
+    std::vector<efergyDecoder *> decoders;
+    std::vector<efergyConfig> inputConfigs;
+    bool rtlFmInputs=(inputFormat==EFERGY_FORMAT_S16LE);
+    for(size_t i=0; i<inputs.size(); i++)
+    {
+        efergyConfig inputConfig=config;
+        inputConfig.source=i;
+        inputConfig.format=inputFormat;
+        if(inputs[i].find(".sigmf-")!=std::string::npos)
+        {
+            // the metadata says what the samples are, read its data
+            std::string dataPath;
+            if(!readSigmfMeta(inputs[i], &inputConfig.format, 
+                        &inputConfig.sampleRate, &dataPath))
+            {
+                exit(1);
+            }
+            fprintf(stderr, "Input %lu is SigMF, %s at %.0f samples/s\n",
+                        static_cast<unsigned long>(i), 
+                        formatName(inputConfig.format), 
+                        inputConfig.sampleRate);
+            inputs[i]=dataPath;
+            rtlFmInputs=rtlFmInputs && 
+                        (inputConfig.format==EFERGY_FORMAT_S16LE);
+        }
+        efergyDecoder *decoder=efergyDecoderCreateShared(&inputConfig, 
+                                combiner?0:aggregator);
+        bool added=false;
+        if(decoder)
+        {
+            added=loop?addLoopSource(loop, inputs[i].c_str(), decoder):
+                        addSource(pipe, inputs[i].c_str(), decoder);
+        }
+        if(!added)
+        {
+            fprintf(stderr, "Failed, can't create decoder for input '%s'\n", 
+                        inputs[i].c_str());
+            exit(1);
+        }
+        double byteRate=0;
+        if(liveInput(inputs[i]))
+        {
+            // decode is held to the rate the samples arrive, and the 
+            // rate they arrive at is checked
+            int frameBytes=formatBytes(inputConfig.format);
+            rateAudit *audit=loop?&loop->sources[i].audit:
+                        &pipe->sources[i]->audit;
+            initRateAudit(audit, i, inputConfig.sampleRate, frameBytes);
+            byteRate=inputConfig.sampleRate*frameBytes;
+            if(pipe)
+                pipe->sources[i]->byteRate=byteRate;
+        }
+        if(engineCeiling>=0)
+        {
+            // a live input has a budget the engine is governed by
+            engineGovernor *governor=loop?&loop->sources[i].governor:
+                        &pipe->sources[i]->governor;
+            initGovernor(governor, i, decoder, byteRate, engineCeiling);
+        }
+        decoders.push_back(decoder);
+        inputConfigs.push_back(inputConfig);
+        fprintf(stderr, "Input %lu from '%s'\n", static_cast<unsigned long>(i),
+                    (inputs[i]=="-")?"stdin":inputs[i].c_str());
+    }
+
+    // the raw samples kept for captures, a ring for each input
+    captureWriter captureOut;
+    std::vector<captureRing *> captures;
+    if(captureSeconds>0 && !rtlFmInputs)
+    {
+        // the rings and the capture files are rtl_fm samples
+        fprintf(stderr, "Failed, -c needs rtl_fm samples, not -f or SigMF\n");
+        exit(1);
+    }
+    if(captureSeconds>0)
+    {
+        if(!startCaptureWriter(&captureOut))
+        {
+            exit(1);
+        }
+        for(size_t i=0; i<inputs.size(); i++)
+        {
+            captureRing *ring=new captureRing;
+            initCapture(ring, &captureOut, i, captureSeconds, 
+                        config.sampleRate);
+            captures.push_back(ring);
+            if(loop)
+                loop->sources[i].capture=ring;
+            else
+                pipe->sources[i]->capture=ring;
+        }
+    }
+
+    // the packet positions, in the samples of the one input
+    packetIndex *index=0;
+    if(indexFilename.size()>0 || sigmfFilename.size()>0)
+    {
+        index=new packetIndex;
+        if(!openPacketIndex(index, indexFilename, sigmfFilename, 
+                    inputConfigs[0].format, inputConfigs[0].sampleRate))
+        {
+            exit(1);
+        }
+    }
+
     struct threadParams params;
     params.delay=logPeriod;
     params.output=output;
     params.rrdFilename=rrdFilename;
-    ptherr=pthread_create(&loggingTid, NULL, &logData, &params);
-    if(ptherr != 0)
+    params.aggregator=aggregator;
+    params.pipe=pipe;
+    compileLine(logLine.c_str(), &params.logLine);
+
+    sinkParams sink;
+    pthread_mutex_init(&sink.lock, 0);
+    sink.debug=debug;
+    sink.debugAll=debugAll;
+    sink.statsOutput=statsOutput;
+    sink.showSource=(inputs.size()>1);
+    sink.combiner=combiner;
+    sink.decoders=&decoders;
+    sink.captures=&captures;
+    sink.captureOut=&captureOut;
+    sink.pipe=pipe;
+    sink.loop=loop;
+    sink.index=index;
+    sink.totalPackets=0;
+    sink.passedPackets=0;
+    sink.ourPackets=0;
+    sink.lastPacketTime=time(0);
+    compileLine(LATEST_LINE, &sink.latestLine);
+    compileLine(TOTAL_LINE, &sink.totalLine);
+    compileLine(sink.showSource?DEBUG_SOURCE_LINE:DEBUG_LINE, 
+                &sink.debugLine);
+    initLineBuffer(&sink.line);
+    sink.trace=0;
+    sink.journal=0;
+    sink.replayTime=0;
+    sink.upstream=0;
+    if(journalFilename.size()>0)
     {
-        fprintf(stderr, "Failed, can't create logging thread, %s\n", 
-                            strerror(ptherr));
-        exit(1);
+        sink.journal=new packetJournal;
+        if(!openJournal(sink.journal, journalFilename))
+        {
+            exit(1);
+        }
     }
-    else
+    if(debug || debugAll || controlPath.size()>0)
     {
-        fprintf(stderr, "created logging thread, logging every %u minute%c\n", 
-                            logPeriod, (logPeriod>1)?'s':' ');
+        // debug may be turned on later by a control command
+        sink.trace=new traceQueue;
+        if(!startTrace(sink.trace, stdout, &sink.totalLine, &sink.debugLine,
+                    sink.showSource))
+        {
+            exit(1);
+        }
     }
-    
-    // packet holds extracted packet data protocol bytes
-    unsigned char packet[LENGTH_PROTOCOL_BYTES]; 
-    unsigned long long totalPackets=0;
-    unsigned long long ourPackets=0;
-    unsigned long long passedPackets=0;
-    time_t lastPacketTime=time(0);
-    mapOfDelayCounts statsGood;
 
+    // commands to the running decoder, served by the event loop or a
+    // thread of its own
+    controlParams controlled;
+    controlled.aggregator=aggregator;
+    controlled.sink=&sink;
+    controlled.log=&params;
+    controlled.loop=loop;
+    controlled.voltage=voltage;
+    controlServer *control=0;
+    if(controlPath.size()>0)
+    {
+        control=new controlServer;
+        if(!openControl(control, controlPath, controlCommand, &controlled))
+        {
+            exit(1);
+        }
+        fprintf(stderr, "Taking commands on '%s'\n", controlPath.c_str());
+        if(loop)
+            loop->control=control;
+        else if(!startControl(control))
+            exit(1);
+    }
 
-    // the core of the program, loop until input ends
-    // reading from stdin, if there is nothing coming in we will hang
-    fprintf(stdout, "Reading from stdin, ctrl-d to close stdin\n");
-    while (!_exitNow && 
-        !feof(stdin) &&
-        getPacket(packet, LENGTH_PROTOCOL_BYTES, stdin)
-         )
-    {       
-        totalPackets++;
-        if((totalPackets%DEFAULT_STAT_PACKETS) == 0 )
+    // rtl_fm run here rather than piped in, so it can be restarted
+    upstreamSupervisor upstream;
+    if(supervised)
+    {
+        if(!startUpstream(&upstream, upstreamCommand, 
+                    formatBytes(inputFormat), &_exitNow))
         {
-            outputStats(totalPackets, passedPackets, ourPackets, statsGood);
+            exit(1);
         }
-       
-        if(debugAll)
+        sink.upstream=&upstream;
+    }
+
+    // the core of the program, loop until all the inputs end
+    // if there is nothing coming in we will hang, unless we run the 
+    // upstream command and can restart it
+    if(supervised)
+    {
+        fprintf(stdout, "Reading from '%s', ctrl-c to stop\n", 
+                    upstreamCommand.c_str());
+    }
+    else if(!replaying)
+    {
+        fprintf(stdout, "Reading from %s, ctrl-d to close stdin\n", 
+                    (inputs.size()>1)?"inputs":"stdin");
+    }
+    if(replaying)
+    {
+        logState logging;
+        initLogging(&logging, &params);
+        replayJournal(replayFilename, regionFrom, regionSeconds, aggregator,
+                    &sink, &logging, logPeriod);
+        freeLogging(&logging);
+    }
+    else if(loop)
+    {
+        // the log interval is a timer in the loop, not a thread
+        logState logging;
+        initLogging(&logging, &params);
+        loop->sink=outputPacket;
+        loop->sinkArg=&sink;
+        loop->interval=logInterval;
+        loop->intervalArg=&logging;
+        loop->intervalMinutes=logPeriod;
+        fprintf(stderr, "logging every %u minute%c\n", 
+                            logPeriod, (logPeriod>1)?'s':' ');
+        runEventLoop(loop);
+        freeLogging(&logging);
+    }
+    else
+    {
+        // create a thread to perform the logging
+        int ptherr;
+        pthread_t loggingTid=0;
+        ptherr=pthread_create(&loggingTid, NULL, &logData, &params);
+        if(ptherr != 0)
         {
-            fprintf(stdout, "Packet: ");
-            for(int b=0; b<LENGTH_PROTOCOL_BYTES; b++)
-                fprintf(stdout, "%02x ", packet[b]);
-            fprintf(stdout, "\n");
+            fprintf(stderr, "Failed, can't create logging thread, %s\n", 
+                                strerror(ptherr));
+            exit(1);
         }
- 
-        double power=0.0;
-        bool passed=checksum(packet, LENGTH_PROTOCOL_BYTES);
-        if(passed)
+        else
         {
-            passedPackets++;
-            if(ignoreAddress || checkAddress(packet, address, sizeof(address)))
-            {
-                ourPackets++;
-                
-                if(statsOutput)
-                {
-                    // record times between good packets
-                    time_t timeNow=time(0);
-                    statsGood[(timeNow-lastPacketTime)]++;
-                    lastPacketTime=timeNow;
-                }
-            
-                // extract the power 
-                power = getPower(&packet[LENGTH_PROTOCOL_BYTES-4], voltage);
-            
-                // log latest to a file
-                logLatest(power);
+            fprintf(stderr, "created logging thread, logging every %u minute%c\n", 
+                                logPeriod, (logPeriod>1)?'s':' ');
+        }
+        pipe->sink=outputPacket;
+        pipe->sinkArg=&sink;
+        runPipeline(pipe);
     
-                // push the data to the logging thread
-                // we record the maximum power in the logging interval
-                // _power will be zero if it has been logged already
-                pthread_mutex_lock(&dataLock);
-                if(power>_power)
-                {
-                    _power=power;
-                }
-                pthread_mutex_unlock(&dataLock);
-                
-                accumulatePower(power);
-            }
-
-            if(debug)
+        // clean up and exit
+        _exitNow=true;
+        if(loggingTid)
+        {
+            pthread_join(loggingTid, 0);
+        }
+        for(int s=0; s<pipe->sourceCount; s++)
+        {
+            pipelineSource *source=pipe->sources[s];
+            if(source->late>0)
             {
-                fprintf(stdout, "%.0f ", power);
-                for(int i=0; i<LENGTH_PROTOCOL_BYTES; i++)
-                {
-                    fprintf(stdout, "%02x", packet[i]);
-                }
-                fprintf(stdout, " %s\n", passed?"P":"F");
+                fprintf(stderr, "Warning, input %d had %llu blocks decoded "
+                            "later than their samples span, worst %.1fms\n",
+                            s, source->late, 1000*source->maxLate);
             }
-        } // if(passed)
+        }
     }
-    
-    // clean up and exit
-    _exitNow=true;
-    if(loggingTid)
+    if(supervised)
     {
-        pthread_join(loggingTid, 0);
+        stopUpstream(&upstream);
+        fprintf(stderr, "Upstream, %llu starts, %llu stalls, %llu ended\n",
+                    upstream.starts, upstream.stalls, upstream.exits);
+    }
+    if(control)
+    {
+        fprintf(stderr, "Control, %llu commands\n", control->commands);
+        closeControl(control);
+        delete control;
     }
     fclose(output);
+    if(sink.trace)
+    {
+        // the last debug lines out before the stats
+        stopTrace(sink.trace);
+        if(sink.trace->dropped>0)
+        {
+            fprintf(stderr, "Warning, %llu packets missing from the debug "
+                        "output, stdout was too slow\n", 
+                        sink.trace->dropped);
+        }
+    }
+    if(sink.journal)
+    {
+        fprintf(stderr, "Journaled %llu packets\n", sink.journal->written);
+        closeJournal(sink.journal);
+        delete sink.journal;
+    }
+    if(index)
+    {
+        fprintf(stderr, "Indexed %llu packets\n", index->records);
+        closePacketIndex(index);
+        delete index;
+    }
+    for(size_t i=0; i<decoders.size(); i++)
+    {
+        efergyCounts counts;
+        counts.size=sizeof(counts);
+        efergyDecoderCounts(decoders[i], &counts);
+        if(counts.ignored>0)
+        {
+            fprintf(stderr, "Warning, input %lu had %llu bytes that weren't "
+                        "samples we can read\n", static_cast<unsigned long>(i), 
+                        counts.ignored);
+        }
+    }
+    if(captures.size()>0)
+    {
+        // write out the last captures before the stats
+        stopCaptureWriter(&captureOut);
+    }
     
     // stats on packets
     if(statsOutput)
     {
-        outputStats(totalPackets, passedPackets, ourPackets, statsGood);
+        outputStats(&sink);
+        if(pipe)
+            outputStageStats(stderr, pipe);
+        if(loop)
+            outputEventLoopStats(stderr, loop);
     }
+    if(pipe)
+    {
+        freePipeline(pipe);
+        delete pipe;
+    }
+    delete loop;
+    for(size_t i=0; i<captures.size(); i++)
+    {
+        freeCapture(captures[i]);
+        delete captures[i];
+    }
+    for(size_t i=0; i<decoders.size(); i++)
+    {
+        efergyDecoderDestroy(decoders[i]);
+    }
+    delete sink.trace;
+    efergyCombinerDestroy(combiner);
+    efergyAggregatorDestroy(aggregator);
+    pthread_mutex_destroy(&sink.lock);
     
     return(0);
 }
-
-
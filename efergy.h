@@ -0,0 +1,341 @@
+/*
+ * efergy.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* libefergy, the efergy decoder as a library with a C interface.
+ * 
+ * Feed it the demodulated samples from rtl_fm, in whatever size blocks
+ * arrive, and poll for the packets found. Each packet comes back with
+ * its sample offsets, checksum and address status and the power.
+ * The decoder also keeps statistics per meter address, the energy
+ * total and the maximum power for the logging interval.
+ * 
+ *  efergyConfig config;
+ *  config.size=sizeof(config);
+ *  efergyDefaultConfig(&config);
+ *  efergyDecoder *decoder=efergyDecoderCreate(&config);
+ *  packet.size=sizeof(packet);
+ *  while((got=read(fd, buffer, sizeof(buffer))) > 0)
+ *  {
+ *      efergyDecoderPushBytes(decoder, buffer, got);
+ *      while(efergyDecoderPoll(decoder, &packet))
+ *          ...
+ *  }
+ *  efergyDecoderDestroy(decoder);
+ * 
+ * Each structure given to or filled by a call starts with its size, 
+ * set it to sizeof the structure first. Fields are only ever added at
+ * the end, so a library newer than the header a caller was built with
+ * reads and fills just the fields the caller knows of, and leaves the
+ * rest of a config at their defaults.
+ * 
+ * Several receivers can share one address filter and aggregation, 
+ * create an efergyAggregator and one decoder per receiver with
+ * efergyDecoderCreateShared(), giving each config a different source.
+ * 
+ * When receivers can hear the same transmission use an efergyCombiner
+ * instead. The decoders are then created without an aggregator and
+ * their packets are pushed to the combiner. Copies of a transmission 
+ * are grouped, duplicates dropped and when no copy passes its checksum
+ * the copies are voted on bit by bit. The combined packets are then 
+ * filtered and aggregated.
+ * 
+ * Between packets a decoder only scans for the next start pulse, 
+ * which skips most of the samples, turn it off with gate=0 in the
+ * config to run every sample through the full decoder. That and the
+ * dearer engines, which also work on the packets failing their 
+ * checksum, can be switched between pushes with efergyDecoderSetEngine().
+ * 
+ * A decoder is not thread safe, push and poll must come from one 
+ * thread. The meter statistics and the interval maximum belong to the
+ * aggregation and may be read from any thread.
+ * 
+ * Compile
+ *  g++ -O3 -fPIC -shared -olibefergy.so libefergy.cpp decoder.cpp formats.cpp -lpthread
+ */
+
+#ifndef EFERGY_H
+#define EFERGY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped when a structure or call below changes, a field added to 
+ * the end of a sized structure is not a change */
+#define EFERGY_API_VERSION (12)
+
+#define EFERGY_PACKET_BYTES (8)
+#define EFERGY_ADDRESS_BYTES (3)
+#define EFERGY_MAX_SOURCES (8)
+
+/* engines a decoder can run, dearer as they go and finding more, see
+ * efergyDecoderSetEngine() */
+#define EFERGY_ENGINE_GATED (0)     /* scans between packets, gate=1 */
+#define EFERGY_ENGINE_FULL (1)      /* every sample decoded, gate=0 */
+#define EFERGY_ENGINE_HYPOTHESIS (2)    /* full, and a packet failing its
+                                       checksum sliced again at other
+                                       one/zero thresholds */
+#define EFERGY_ENGINE_REPAIR (3)    /* hypothesis, then the bits of the
+                                       weakest pulses flipped */
+#define EFERGY_ENGINE_COUNT (4)
+
+/* sample formats of an input with no header, a wav header gives its 
+ * own, only the sign of a sample is used */
+#define EFERGY_FORMAT_S16LE (0)     /* rtl_fm */
+#define EFERGY_FORMAT_S16BE (1)
+#define EFERGY_FORMAT_S8 (2)
+#define EFERGY_FORMAT_U8 (3)        /* 128 is zero */
+#define EFERGY_FORMAT_F32LE (4)
+
+typedef struct efergyDecoder efergyDecoder;
+typedef struct efergyAggregator efergyAggregator;
+
+typedef struct efergyConfig
+{
+    size_t size;        /* sizeof the structure, set by caller */
+    int syncWidth;          /* highs needed to detect the start pulse */
+    int oneWidth;           /* pulses longer than this are a one */
+    double voltage;         /* mains voltage for the power */
+    double sampleRate;      /* samples per second from rtl_fm */
+    int filterAddress;      /* non zero, only accept packets from address */
+    unsigned char address[EFERGY_ADDRESS_BYTES];
+    int source;             /* receiver number stamped on packets */
+    int gate;               /* non zero, between packets only scan for
+                               a start pulse, the packets are the same */
+    int format;             /* EFERGY_FORMAT_ of pushed stream samples */
+} efergyConfig;
+
+typedef struct efergyPacket
+{
+    size_t size;                /* sizeof the structure, set by caller */
+    unsigned char bytes[EFERGY_PACKET_BYTES];
+    unsigned long long start;   /* sample offset of the start pulse */
+    unsigned long long end;     /* sample offset of the last bit */
+    double time;                /* seconds of samples to the start */
+    int source;                 /* receiver it came from */
+    int checksumOk;             /* non zero when the checksum passed */
+    int accepted;               /* checksum passed and address matched */
+    double power;               /* VA, zero unless accepted */
+    double energy;              /* kWh total for the meter, with this */
+    double periods;             /* 6 second periods this packet covers */
+    double quality;             /* mean distance of the pulses from the 
+                                   one/zero threshold, in samples */
+} efergyPacket;
+
+typedef struct efergyCounts
+{
+    size_t size;                  /* sizeof the structure, set by caller */
+    unsigned long long total;     /* all packets found */
+    unsigned long long passed;    /* passed the checksum */
+    unsigned long long accepted;  /* passed the address filter too */
+    unsigned long long dropped;   /* lost as nobody polled for them */
+    unsigned long long samples;   /* pushed */
+    unsigned long long scanned;   /* of those, skipped by the gate */
+    unsigned long long truncated; /* packets cut short by a start pulse */
+    unsigned long long ignored;   /* stream bytes that couldn't be used,
+                                     eg a wav of an unknown format */
+    unsigned long long resliced;  /* passed at another threshold */
+    unsigned long long repaired;  /* passed with weak bits flipped */
+} efergyCounts;
+
+typedef struct efergyMeterStats
+{
+    size_t size;                    /* sizeof the structure, set by caller */
+    unsigned char address[EFERGY_ADDRESS_BYTES];
+    unsigned long long packets;     /* checksum passed from this meter */
+    unsigned long long lastSample;  /* start of the latest packet */
+    double lastTime;                /* and its time on its source */
+    int lastSource;                 /* receiver of the latest packet */
+    double lastPower;               /* VA */
+    double maxPower;                /* VA, since first seen */
+    double energy;                  /* kWh since first seen */
+    double lastPeriods;             /* 6 second periods the latest covered */
+} efergyMeterStats;
+
+int efergyVersion(void);
+
+/* set config->size first, the creates return zero for a config too
+ * short to hold the fields of API 12 */
+void efergyDefaultConfig(efergyConfig *config);
+efergyDecoder *efergyDecoderCreate(const efergyConfig *config);
+/* the aggregator must outlive the decoders sharing it, a decoder with
+ * no aggregator only decodes, its packets are never accepted */
+efergyAggregator *efergyAggregatorCreate(const efergyConfig *config);
+void efergyAggregatorDestroy(efergyAggregator *aggregator);
+double efergyAggregatorTakeIntervalMax(efergyAggregator *aggregator);
+/* a packet from elsewhere, eg read back from a journal, through the
+ * address filter and aggregation as a decoded one would go, sets
+ * accepted, power, energy and periods if it passed its checksum */
+void efergyAggregatorPush(efergyAggregator *aggregator, 
+            efergyPacket *packet);
+/* the address filter and voltage of a running aggregation, a change
+ * applies from the next packet, never part way through one. Adding an
+ * address turns the filter on, add and remove return non zero if the
+ * address wasn't and was in the filter */
+int efergyAggregatorAddAddress(efergyAggregator *aggregator, 
+            const unsigned char *address);
+int efergyAggregatorRemoveAddress(efergyAggregator *aggregator, 
+            const unsigned char *address);
+/* turns the filter off, every address accepted */
+void efergyAggregatorAcceptAll(efergyAggregator *aggregator);
+/* fills up to max addresses in the filter, returns how many there are 
+ * or -1 when the filter is off */
+int efergyAggregatorAddresses(efergyAggregator *aggregator, 
+            unsigned char (*addresses)[EFERGY_ADDRESS_BYTES], int max);
+void efergyAggregatorSetVoltage(efergyAggregator *aggregator, 
+            double voltage);
+efergyDecoder *efergyDecoderCreateShared(const efergyConfig *config, 
+            efergyAggregator *aggregator);
+void efergyDecoderDestroy(efergyDecoder *decoder);
+
+/* samples in host order */
+void efergyDecoderPush(efergyDecoder *decoder, const short *samples, 
+            size_t count);
+/* raw little endian bytes as rtl_fm writes them, any split is fine */
+void efergyDecoderPushBytes(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count);
+/* samples as sign bits, bit i of each word is a sample, set for a high
+ * one, samples need not fill the last word but the next push starts a
+ * new word */
+void efergyDecoderPushBits(efergyDecoder *decoder, 
+            const unsigned long long *words, size_t samples);
+/* runs of samples as in a run capture, without its header, decoding 
+ * stops at the end marker, any split is fine */
+void efergyDecoderPushRuns(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count);
+/* the bytes of an input as they come, samples in the config format, a 
+ * wav file, a packed or a run capture, told apart by the first bytes, 
+ * any split is fine */
+void efergyDecoderPushStream(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count);
+/* returns non zero and fills packet while there are packets waiting */
+int efergyDecoderPoll(efergyDecoder *decoder, efergyPacket *packet);
+/* start afresh with the next sample pushed at offset sample, to decode
+ * part of a capture with the packet offsets and times of the whole */
+void efergyDecoderStartAt(efergyDecoder *decoder, unsigned long long sample);
+/* between pushes, the engine for the samples from here on, it starts 
+ * as the config's gate says. The hypothesis and repair engines only 
+ * take a failed packet that then passes from a meter already heard, so
+ * they need an aggregator, without one they are the full engine.
+ * Returns zero for an unknown engine. */
+int efergyDecoderSetEngine(efergyDecoder *decoder, int engine);
+int efergyDecoderEngine(const efergyDecoder *decoder);
+
+void efergyDecoderCounts(const efergyDecoder *decoder, 
+            efergyCounts *counts);
+int efergyDecoderMeterCount(const efergyDecoder *decoder);
+/* meters from every decoder sharing the aggregation
+ * returns zero if index or address is not a known meter */
+int efergyDecoderMeterStats(const efergyDecoder *decoder, int index, 
+            efergyMeterStats *stats);
+int efergyDecoderFindMeter(const efergyDecoder *decoder, 
+            const unsigned char *address, efergyMeterStats *stats);
+/* maximum accepted power since the last call, zero if none */
+double efergyDecoderTakeIntervalMax(efergyDecoder *decoder);
+
+/* combining of the packets from several receivers */
+typedef struct efergyCombiner efergyCombiner;
+
+typedef struct efergyCombineCounts
+{
+    size_t size;                    /* sizeof the structure, set by caller */
+    unsigned long long copies;      /* packets pushed */
+    unsigned long long groups;      /* transmissions, grouped copies */
+    unsigned long long good;        /* groups giving a good packet */
+    unsigned long long duplicates;  /* good copies dropped */
+    unsigned long long majority;    /* repaired by a bitwise majority */
+    unsigned long long weighted;    /* repaired by a quality weighted 
+                                       search of the differing bits */
+    unsigned long long failed;      /* no good copy and no repair */
+    /* groups each source got right on its own, the yield from 
+       diversity is good less the best of these */
+    unsigned long long sourceGood[EFERGY_MAX_SOURCES];
+} efergyCombineCounts;
+
+/* copies arriving within window seconds of the first are grouped */
+efergyCombiner *efergyCombinerCreate(double window, 
+            efergyAggregator *aggregator);
+void efergyCombinerDestroy(efergyCombiner *combiner);
+/* now is the arrival time in seconds on any steady clock, the packet
+ * time of combined packets is on that clock */
+void efergyCombinerPush(efergyCombiner *combiner, 
+            const efergyPacket *packet, double now);
+/* a packet for each group whose window has closed, now below zero 
+ * closes them all */
+int efergyCombinerPoll(efergyCombiner *combiner, efergyPacket *packet, 
+            double now);
+int efergyCombinerPending(const efergyCombiner *combiner);
+void efergyCombinerCounts(const efergyCombiner *combiner, 
+            efergyCombineCounts *counts);
+
+/* packed captures, the decoder only uses the sign of each sample so a
+ * capture can keep one bit a sample, 1/16 of the rtl_fm size. The 
+ * header is followed by little endian words for efergyDecoderPushBits
+ */
+#define EFERGY_PACKED_MAGIC "EFB1"
+/* run captures, the same header then a run of samples at a time, each 
+ * an unsigned LEB128 varint of width<<1|high, zero marks the end of 
+ * the runs. A run index and an efergyRunsFooter end the file. */
+#define EFERGY_RUNS_MAGIC "EFR1"
+#define EFERGY_RUNS_INDEX_MAGIC "EFRI"
+
+typedef struct efergyPackedHeader
+{
+    char magic[4];              /* EFERGY_PACKED_MAGIC or RUNS_MAGIC */
+    unsigned int headerBytes;   /* size of the header, data follows */
+    double sampleRate;          /* samples per second */
+    long long startTime;        /* unix seconds at the first sample */
+    unsigned long long samples; /* zero if not known, eg a pipe */
+} efergyPackedHeader;
+
+/* a run starting at sample begins at byte offset of the file */
+typedef struct efergyRunsIndexEntry
+{
+    unsigned long long sample;
+    unsigned long long offset;
+} efergyRunsIndexEntry;
+
+/* the last bytes of a run capture, so the index is found from the end
+ * and the capture can still be written to a pipe */
+typedef struct efergyRunsFooter
+{
+    unsigned long long indexOffset; /* file offset of the first entry */
+    unsigned long long entries;
+    double indexSeconds;            /* at least this apart */
+    char magic[4];                  /* EFERGY_RUNS_INDEX_MAGIC */
+    unsigned int footerBytes;
+} efergyRunsFooter;
+
+/* parsing of a single packet of EFERGY_PACKET_BYTES */
+int efergyChecksum(const unsigned char *packet);
+int efergyCheckAddress(const unsigned char *packet, 
+            const unsigned char *address);
+double efergyPacketPower(const unsigned char *packet, double voltage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EFERGY_H */
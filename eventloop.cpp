@@ -0,0 +1,470 @@
+/*
+ * eventloop.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "eventloop.h"
+
+// epoll tags after the source indexes
+#define SIGNAL_TAG (MAX_SOURCES)
+#define TIMER_TAG (MAX_SOURCES+1)
+#define CONTROL_TAG (MAX_SOURCES+2)
+#define TIMER_SLACK_NS (20000000)
+
+static double monotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec+now.tv_nsec/1e9);
+}
+
+static double processCpuTime()
+{
+    // only the one thread, so the process time is the loop's
+    struct timespec used;
+    if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &used)!=0)
+    {
+        return(0.0);
+    }
+    return(used.tv_sec+used.tv_nsec/1e9);
+}
+
+void initEventLoop(eventLoop *loop)
+{
+    loop->sink=0;
+    loop->sinkArg=0;
+    loop->combiner=0;
+    loop->interval=0;
+    loop->intervalArg=0;
+    loop->intervalMinutes=1;
+    loop->control=0;
+    loop->timerFd=-1;
+    loop->sourceCount=0;
+    loop->wakeups=0;
+    loop->packets=0;
+    loop->intervals=0;
+    loop->startTime=0;
+    loop->stopTime=0;
+    loop->cpuTime=0;
+}
+
+bool addLoopSource(eventLoop *loop, const char *name, efergyDecoder *decoder)
+{
+    if(loop->sourceCount>=MAX_SOURCES)
+    {
+        return(false);
+    }
+    loopSource *source=&loop->sources[loop->sourceCount];
+    source->index=loop->sourceCount;
+    snprintf(source->name, sizeof(source->name), "%s", name);
+    source->decoder=decoder;
+    source->capture=0;
+    source->fd=-1;
+    source->polled=false;
+    source->ended=false;
+    source->reads=0;
+    source->bytes=0;
+    initRateAudit(&source->audit, source->index, 0, 1);
+    initGovernor(&source->governor, source->index, decoder, 0, 
+                efergyDecoderEngine(decoder));
+    loop->sourceCount++;
+    return(true);
+}
+
+static void sinkPacket(eventLoop *loop, const efergyPacket *packet)
+{
+    loop->sink(packet, loop->sinkArg);
+    loop->packets++;
+}
+
+static void combinePackets(eventLoop *loop, double now)
+{
+    // sink the packets from the groups that have closed
+    efergyPacket packet;
+    packet.size=sizeof(packet);
+    while(efergyCombinerPoll(loop->combiner, &packet, now))
+    {
+        sinkPacket(loop, &packet);
+    }
+}
+
+static bool openSource(int epollFd, loopSource *source)
+{
+    // a fifo open blocks until its writer turns up, as the ingest
+    // stage does, but here it holds up the whole loop so start rtl_fm
+    // first
+    source->fd=STDIN_FILENO;
+    if(strcmp(source->name, "-")!=0)
+    {
+        source->fd=open(source->name, O_RDONLY | O_CLOEXEC);
+        if(source->fd<0)
+        {
+            fprintf(stderr, "Failed, can't open input '%s', %s\n",
+                        source->name, strerror(errno));
+            source->ended=true;
+            return(false);
+        }
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events=EPOLLIN;
+    event.data.u32=source->index;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, source->fd, &event)!=0)
+    {
+        if(errno!=EPERM)
+        {
+            fprintf(stderr, "Failed, can't wait on input '%s', %s\n",
+                        source->name, strerror(errno));
+            return(false);
+        }
+        // a regular file is always ready, read it every time round
+        source->polled=true;
+    }
+    return(true);
+}
+
+static void closeSource(loopSource *source)
+{
+    if(source->capture && !source->ended)
+    {
+        captureEnd(source->capture);
+    }
+    source->ended=true;
+    if(source->fd>=0 && source->fd!=STDIN_FILENO)
+    {
+        close(source->fd);  // also takes it out of the epoll set
+    }
+    source->fd=-1;
+}
+
+static double pipeFill(int fd)
+{
+    // the samples still waiting in a pipe or fifo, as a share of it
+    int waiting=0;
+    int size=fcntl(fd, F_GETPIPE_SZ);
+    if(size<=0 || ioctl(fd, FIONREAD, &waiting)!=0)
+    {
+        return(0.0);
+    }
+    return(static_cast<double>(waiting)/size);
+}
+
+static void readSource(eventLoop *loop, loopSource *source)
+{
+    // one read per wakeup, epoll has said it won't block, then decode
+    // the block in place
+    unsigned char block[INPUT_BLOCK_SIZE];
+    ssize_t got=read(source->fd, block, sizeof(block));
+    if(got<0 && (errno==EINTR || errno==EAGAIN))
+    {
+        return;
+    }
+    if(got<=0)
+    {
+        if(got<0)
+        {
+            fprintf(stderr, "Failed, reading input '%s', %s\n",
+                        source->name, strerror(errno));
+        }
+        closeSource(source);
+        return;
+    }
+    source->reads++;
+    source->bytes+=got;
+    double began=monotonicTime();
+    auditBlock(&source->audit, got, began);
+    efergyDecoderPushStream(source->decoder, block, got);
+    if(source->governor.byteRate>0)
+    {
+        double now=monotonicTime();
+        governBlock(&source->governor, got, now-began, pipeFill(source->fd),
+                    now);
+    }
+    if(source->capture)
+    {
+        captureBytes(source->capture, block, got);
+    }
+
+    efergyPacket packet;
+    packet.size=sizeof(packet);
+    while(efergyDecoderPoll(source->decoder, &packet))
+    {
+        if(source->audit.ppmReady)
+        {
+            packet.time=auditedTime(&source->audit, packet.start);
+        }
+        if(source->capture)
+        {
+            capturePacket(source->capture, &packet);
+        }
+        if(loop->combiner)
+        {
+            efergyCombinerPush(loop->combiner, &packet, monotonicTime());
+        }
+        else
+        {
+            sinkPacket(loop, &packet);
+        }
+    }
+    if(source->capture)
+    {
+        captureDecoder(source->capture, source->decoder);
+    }
+}
+
+static bool startTimer(int timerFd, unsigned int minutes)
+{
+    // wall clock, first on the next minute then every interval, the
+    // same times the logging thread syncs to
+    time_t now=time(0);
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+    when.it_value.tv_sec=now-(now%60);
+    if(now%60)
+    {
+        when.it_value.tv_sec+=60;
+    }
+    // just past the minute, time() reads a coarse clock that can lag
+    // by a tick and the log would be stamped with the minute before
+    when.it_value.tv_nsec=TIMER_SLACK_NS;
+    when.it_interval.tv_sec=60*(minutes?minutes:1);
+    return(timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &when, 0)==0);
+}
+
+static bool addWait(int epollFd, int fd, unsigned int tag)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events=EPOLLIN;
+    event.data.u32=tag;
+    return(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event)==0);
+}
+
+bool setLoopInterval(eventLoop *loop, unsigned int minutes)
+{
+    loop->intervalMinutes=minutes;
+    if(loop->timerFd<0)
+    {
+        return(true);
+    }
+    return(startTimer(loop->timerFd, minutes));
+}
+
+int runEventLoop(eventLoop *loop)
+{
+    // the signals come in on a descriptor, so they must not be
+    // delivered to the handlers, a caller with other threads must 
+    // have blocked them before starting those
+    sigset_t signals;
+    sigset_t oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+
+    int epollFd=epoll_create1(EPOLL_CLOEXEC);
+    int signalFd=signalfd(-1, &signals, SFD_CLOEXEC);
+    int timerFd=timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    int err=0;
+    if(epollFd<0 || signalFd<0 || timerFd<0 ||
+        !addWait(epollFd, signalFd, SIGNAL_TAG) ||
+        !addWait(epollFd, timerFd, TIMER_TAG) ||
+        !startTimer(timerFd, loop->intervalMinutes) ||
+        (loop->control && 
+            !addWait(epollFd, loop->control->epollFd, CONTROL_TAG)))
+    {
+        fprintf(stderr, "Failed, can't set up the event loop, %s\n",
+                    strerror(errno));
+        err=1;
+    }
+
+    loop->timerFd=timerFd;
+
+    int active=0;
+    for(int s=0; s<loop->sourceCount && err==0; s++)
+    {
+        if(openSource(epollFd, &loop->sources[s]))
+        {
+            active++;
+        }
+        else
+        {
+            closeSource(&loop->sources[s]);
+        }
+    }
+
+    loop->startTime=monotonicTime();
+    bool stop=(err!=0);
+    while(!stop && active>0)
+    {
+        int timeout=-1;
+        for(int s=0; s<loop->sourceCount; s++)
+        {
+            if(loop->sources[s].polled && !loop->sources[s].ended)
+            {
+                timeout=0;
+            }
+        }
+        if(timeout<0 && loop->combiner &&
+            efergyCombinerPending(loop->combiner))
+        {
+            // groups are waiting for their window to close, so wake
+            // up to close them even if no more packets come
+            timeout=COMBINE_WAKE_NS/1000000;
+        }
+
+        struct epoll_event events[MAX_SOURCES+3];
+        int count=epoll_wait(epollFd, events, MAX_SOURCES+3, timeout);
+        loop->wakeups++;
+        if(count<0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "Failed, event loop wait, %s\n",
+                        strerror(errno));
+            err=1;
+            break;
+        }
+
+        for(int e=0; e<count; e++)
+        {
+            unsigned int tag=events[e].data.u32;
+            if(tag==SIGNAL_TAG)
+            {
+                struct signalfd_siginfo info;
+                if(read(signalFd, &info, sizeof(info))==sizeof(info))
+                {
+                    stop=true;
+                }
+            }
+            else if(tag==TIMER_TAG)
+            {
+                uint64_t expired;
+                if(read(timerFd, &expired, sizeof(expired))==sizeof(expired)
+                    && loop->interval)
+                {
+                    // a late wakeup that missed intervals logs once,
+                    // as the logging thread would
+                    loop->interval(loop->intervalArg);
+                    loop->intervals++;
+                }
+            }
+            else if(tag==CONTROL_TAG)
+            {
+                // the commands run here between blocks, so a change is
+                // never seen part way through one
+                serveControl(loop->control, 0);
+            }
+            else if(tag<static_cast<unsigned int>(loop->sourceCount) &&
+                !loop->sources[tag].ended)
+            {
+                readSource(loop, &loop->sources[tag]);
+                if(loop->sources[tag].ended)
+                {
+                    active--;
+                }
+            }
+        }
+
+        for(int s=0; s<loop->sourceCount && !stop; s++)
+        {
+            loopSource *source=&loop->sources[s];
+            if(source->polled && !source->ended)
+            {
+                readSource(loop, source);
+                if(source->ended)
+                {
+                    active--;
+                }
+            }
+        }
+
+        if(loop->combiner)
+        {
+            combinePackets(loop, monotonicTime());
+        }
+    }
+    if(loop->combiner)
+    {
+        // input has ended, close every group
+        combinePackets(loop, -1.0);
+    }
+    loop->cpuTime=processCpuTime();
+    loop->stopTime=monotonicTime();
+
+    for(int s=0; s<loop->sourceCount; s++)
+    {
+        closeSource(&loop->sources[s]);
+    }
+    loop->timerFd=-1;
+    if(timerFd>=0)
+        close(timerFd);
+    if(signalFd>=0)
+        close(signalFd);
+    if(epollFd>=0)
+        close(epollFd);
+    pthread_sigmask(SIG_SETMASK, &oldSignals, 0);
+
+    fprintf(stderr, "Event loop exit, %llu wakeups\n", loop->wakeups);
+    return(err);
+}
+
+void outputEventLoopStats(FILE *out, const eventLoop *loop)
+{
+    // the loop is the only thread, so its cpu is the whole process
+    double now=loop->stopTime;
+    double cpu=loop->cpuTime;
+    if(loop->stopTime==0)
+    {
+        now=monotonicTime();
+        cpu=processCpuTime();
+    }
+    double wall=now-loop->startTime;
+    fprintf(out, "Loop      wakeups  packets intervals  util%%\n");
+    fprintf(out, "%-8s %8llu %8llu %9llu %6.2f\n", "loop", loop->wakeups,
+                loop->packets, loop->intervals,
+                (wall>0)?(100.0*cpu/wall):0.0);
+    for(int s=0; s<loop->sourceCount; s++)
+    {
+        fprintf(out, "\tinput %d, %llu reads, %llu bytes\n", s,
+                    loop->sources[s].reads, loop->sources[s].bytes);
+        outputRateAudit(out, &loop->sources[s].audit);
+        outputGovernor(out, &loop->sources[s].governor, now);
+    }
+}
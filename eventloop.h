@@ -0,0 +1,98 @@
+/*
+ * eventloop.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* The processing on one thread, for the small boxes where the stages
+ * of pipeline.h cost more than they give.
+ * 
+ * One epoll wait covers everything
+ *  the inputs      read a block and decode it when readable
+ *  a timerfd       fires on the log interval boundaries
+ *  a signalfd      SIGINT and SIGTERM end the loop
+ *  a control       commands from control.h, the socket and its clients
+ * so the process only wakes when there are samples, a log is due or
+ * it is told to stop, and there is one block buffer in place of the
+ * stage queues. Packets go to the same sink as the pipeline and with
+ * more than one input they are combined first in the same way.
+ */
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <cstdio>
+
+#include "efergy.h"
+#include "pipeline.h"
+#include "control.h"
+#include "governor.h"
+
+// called on each log interval boundary
+typedef void (*intervalHandler)(void *arg);
+
+struct loopSource
+{
+    int index;
+    char name[256];         // "-" for stdin
+    efergyDecoder *decoder;
+    captureRing *capture;   // 0 unless keeping the raw samples
+    int fd;
+    bool polled;            // a regular file, epoll can't wait on it
+    bool ended;
+    unsigned long long reads;
+    unsigned long long bytes;
+    rateAudit audit;        // of a live input, see rateaudit.h
+    engineGovernor governor;    // of the decoder's engine, see governor.h
+};
+
+struct eventLoop
+{
+    packetSink sink;
+    void *sinkArg;
+    efergyCombiner *combiner;   // 0 unless combining receivers
+    intervalHandler interval;
+    void *intervalArg;
+    unsigned int intervalMinutes;
+    controlServer *control;     // 0 unless taking commands
+    int timerFd;                // -1 unless running
+
+    loopSource sources[MAX_SOURCES];
+    int sourceCount;
+
+    unsigned long long wakeups;     // returns from epoll_wait
+    unsigned long long packets;     // given to the sink
+    unsigned long long intervals;   // log intervals handled
+    double startTime;               // monotonic seconds
+    double stopTime;
+    double cpuTime;                 // process cpu seconds when it stopped
+};
+
+void initEventLoop(eventLoop *loop);
+// returns false if there are already MAX_SOURCES
+bool addLoopSource(eventLoop *loop, const char *name, efergyDecoder *decoder);
+// runs until every input ends or a signal, returns non zero on failure
+int runEventLoop(eventLoop *loop);
+// from the loop's own thread, eg a control command, the timer restarts
+// on the next minute
+bool setLoopInterval(eventLoop *loop, unsigned int minutes);
+void outputEventLoopStats(FILE *out, const eventLoop *loop);
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,401 @@
+/*
+ * formats.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <climits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "efergy.h"
+#include "formats.h"
+
+struct formatInfo
+{
+    const char *name;
+    const char *sigmf;      // SigMF core:datatype
+    int bytes;
+};
+
+// in the order of the EFERGY_FORMAT_ numbers
+static const formatInfo formats[]=
+{
+    {"s16le", "ri16_le", 2},
+    {"s16be", "ri16_be", 2},
+    {"s8", "ri8", 1},
+    {"u8", "ru8", 1},
+    {"f32le", "rf32_le", 4},
+};
+
+static const int formatCount=sizeof(formats)/sizeof(formats[0]);
+
+int formatBytes(int format)
+{
+    if(format<0 || format>=formatCount)
+    {
+        return(0);
+    }
+    return(formats[format].bytes);
+}
+
+int parseFormat(const char *name)
+{
+    for(int f=0; f<formatCount; f++)
+    {
+        if(strcmp(name, formats[f].name)==0 || 
+            strcmp(name, formats[f].sigmf)==0)
+        {
+            return(f);
+        }
+    }
+    return(-1);
+}
+
+const char *formatName(int format)
+{
+    if(format<0 || format>=formatCount)
+    {
+        return("unknown");
+    }
+    return(formats[format].name);
+}
+
+const char *formatSigmfName(int format)
+{
+    if(format<0 || format>=formatCount)
+    {
+        return("unknown");
+    }
+    return(formats[format].sigmf);
+}
+
+bool sampleHigh(int format, const unsigned char *sample)
+{
+    // only the sign bit is needed, wherever the format keeps it
+    switch(format)
+    {
+        case EFERGY_FORMAT_S16BE:
+        case EFERGY_FORMAT_S8:
+            return((sample[0]&0x80)==0);
+        case EFERGY_FORMAT_U8:
+            return((sample[0]&0x80)!=0);
+        case EFERGY_FORMAT_F32LE:
+            return((sample[3]&0x80)==0);
+        case EFERGY_FORMAT_S16LE:
+        default:
+            return((sample[1]&0x80)==0);
+    }
+}
+
+// Kernels
+// =======
+// Each takes whole groups of 16 samples the fast way and the rest one
+// at a time. The portable ones leave the loop to the compiler.
+
+template<int format> 
+static void signsPortable(const unsigned char *bytes, size_t samples,
+            unsigned long long *words)
+{
+    const int size=formats[format].bytes;
+    for(size_t w=0; w*64<samples; w++)
+    {
+        size_t count=(samples-w*64<64)?samples-w*64:64;
+        unsigned long long word=0;
+        for(size_t b=0; b<count; b++)
+        {
+            unsigned long long high=sampleHigh(format, &bytes[(w*64+b)*size]);
+            word|=high<<b;
+        }
+        words[w]=word;
+    }
+}
+
+#ifdef __SSE2__
+
+// sign bits of the next 16 samples, set for a low one as movemask gives
+template<int format> static inline unsigned int lowMask16(
+            const unsigned char *bytes)
+{
+    const __m128i *in=reinterpret_cast<const __m128i *>(bytes);
+    switch(format)
+    {
+        case EFERGY_FORMAT_S8:
+            return(_mm_movemask_epi8(_mm_loadu_si128(in)));
+        case EFERGY_FORMAT_U8:
+            return(~_mm_movemask_epi8(_mm_loadu_si128(in))&0xffff);
+        case EFERGY_FORMAT_S16BE:
+        {
+            // the high byte is first, move it up to the top
+            __m128i a=_mm_slli_epi16(_mm_loadu_si128(in), 8);
+            __m128i b=_mm_slli_epi16(_mm_loadu_si128(in+1), 8);
+            return(_mm_movemask_epi8(_mm_packs_epi16(a, b)));
+        }
+        case EFERGY_FORMAT_F32LE:
+        {
+            // the float sign is the int sign, saturating packs keep it
+            __m128i a=_mm_packs_epi32(_mm_loadu_si128(in), 
+                                _mm_loadu_si128(in+1));
+            __m128i b=_mm_packs_epi32(_mm_loadu_si128(in+2), 
+                                _mm_loadu_si128(in+3));
+            return(_mm_movemask_epi8(_mm_packs_epi16(a, b)));
+        }
+        case EFERGY_FORMAT_S16LE:
+        default:
+            return(_mm_movemask_epi8(_mm_packs_epi16(
+                        _mm_loadu_si128(in), _mm_loadu_si128(in+1))));
+    }
+}
+
+template<int format> 
+static void signsSse2(const unsigned char *bytes, size_t samples,
+            unsigned long long *words)
+{
+    const int size=formats[format].bytes;
+    size_t whole=samples/64;
+    for(size_t w=0; w<whole; w++)
+    {
+        const unsigned char *at=&bytes[w*64*size];
+        unsigned long long low=lowMask16<format>(at);
+        low|=static_cast<unsigned long long>(
+                lowMask16<format>(at+16*size))<<16;
+        low|=static_cast<unsigned long long>(
+                lowMask16<format>(at+32*size))<<32;
+        low|=static_cast<unsigned long long>(
+                lowMask16<format>(at+48*size))<<48;
+        words[w]=~low;
+    }
+    if(samples>whole*64)
+    {
+        signsPortable<format>(&bytes[whole*64*size], samples-whole*64, 
+                    &words[whole]);
+    }
+}
+
+#define SIGN_KERNEL(format) signsSse2<format>
+#else
+#define SIGN_KERNEL(format) signsPortable<format>
+#endif
+
+signKernel selectSignKernel(int format)
+{
+    switch(format)
+    {
+        case EFERGY_FORMAT_S16LE:
+            return(SIGN_KERNEL(EFERGY_FORMAT_S16LE));
+        case EFERGY_FORMAT_S16BE:
+            return(SIGN_KERNEL(EFERGY_FORMAT_S16BE));
+        case EFERGY_FORMAT_S8:
+            return(SIGN_KERNEL(EFERGY_FORMAT_S8));
+        case EFERGY_FORMAT_U8:
+            return(SIGN_KERNEL(EFERGY_FORMAT_U8));
+        case EFERGY_FORMAT_F32LE:
+            return(SIGN_KERNEL(EFERGY_FORMAT_F32LE));
+    }
+    return(0);
+}
+
+// Wav
+// ===
+// PCM 8 and 16 bit and 32 bit float, in a plain or an extensible fmt
+// chunk, with any number of channels.
+
+static unsigned int littleEndian(const unsigned char *bytes, int count)
+{
+    unsigned int value=0;
+    for(int b=count-1; b>=0; b--)
+    {
+        value=(value<<8)|bytes[b];
+    }
+    return(value);
+}
+
+wavStatus readWavHeader(const unsigned char *bytes, size_t count, 
+            wavInfo *wav)
+{
+    if(count<12)
+    {
+        return(WAV_MORE);
+    }
+    if(memcmp(bytes, "RIFF", 4)!=0 || memcmp(&bytes[8], "WAVE", 4)!=0)
+    {
+        return(WAV_UNUSABLE);
+    }
+    wav->format=-1;
+    size_t at=12;
+    while(at+8<=count)
+    {
+        const unsigned char *chunk=&bytes[at];
+        unsigned int size=littleEndian(&chunk[4], 4);
+        if(memcmp(chunk, "data", 4)==0)
+        {
+            if(wav->format<0)
+            {
+                return(WAV_UNUSABLE);
+            }
+            wav->dataOffset=at+8;
+            // zero or all ones when written to a pipe, the length 
+            // isn't known
+            wav->dataBytes=(size!=0 && size!=0xffffffff)?size:ULLONG_MAX;
+            return(WAV_OK);
+        }
+        if(at+8+size>count)
+        {
+            break;
+        }
+        if(memcmp(chunk, "fmt ", 4)==0 && size>=16)
+        {
+            unsigned int tag=littleEndian(&chunk[8], 2);
+            unsigned int channels=littleEndian(&chunk[10], 2);
+            unsigned int bits=littleEndian(&chunk[22], 2);
+            if(tag==0xfffe && size>=26)
+            {
+                // extensible, the real tag starts the sub format
+                tag=littleEndian(&chunk[32], 2);
+            }
+            if(tag==1 && bits==16)
+                wav->format=EFERGY_FORMAT_S16LE;
+            else if(tag==1 && bits==8)
+                wav->format=EFERGY_FORMAT_U8;
+            else if(tag==3 && bits==32)
+                wav->format=EFERGY_FORMAT_F32LE;
+            else
+                return(WAV_UNUSABLE);
+            wav->sampleRate=littleEndian(&chunk[12], 4);
+            wav->frameBytes=littleEndian(&chunk[20], 2);
+            if(channels==0 || wav->frameBytes<formatBytes(wav->format) ||
+                wav->frameBytes>MAX_FRAME_BYTES)
+            {
+                return(WAV_UNUSABLE);
+            }
+        }
+        // chunks are padded to an even length
+        at+=8+size+(size&1);
+    }
+    return(WAV_MORE);
+}
+
+// SigMF
+// =====
+// Only the few keys we need are looked for in the metadata rather than
+// parsing the JSON, "core:datatype" and "core:sample_rate" of the 
+// global object.
+
+static bool findValue(const std::string &meta, const char *key, 
+            std::string *value)
+{
+    std::string quoted=std::string("\"")+key+"\"";
+    size_t at=meta.find(quoted);
+    if(at==std::string::npos)
+    {
+        return(false);
+    }
+    at=meta.find(':', at+quoted.size());
+    if(at==std::string::npos)
+    {
+        return(false);
+    }
+    at=meta.find_first_not_of(" \t\r\n", at+1);
+    if(at==std::string::npos)
+    {
+        return(false);
+    }
+    size_t end;
+    if(meta[at]=='"')
+    {
+        at++;
+        end=meta.find('"', at);
+    }
+    else
+    {
+        end=meta.find_first_of(",} \t\r\n", at);
+    }
+    if(end==std::string::npos)
+    {
+        return(false);
+    }
+    *value=meta.substr(at, end-at);
+    return(true);
+}
+
+bool readSigmfMeta(const std::string &path, int *format, 
+            double *sampleRate, std::string *dataPath)
+{
+    std::string base=path;
+    const std::string metaEnd=".sigmf-meta";
+    const std::string dataEnd=".sigmf-data";
+    if(base.size()>metaEnd.size() && 
+        base.compare(base.size()-metaEnd.size(), metaEnd.size(), metaEnd)==0)
+    {
+        base.erase(base.size()-metaEnd.size());
+    }
+    else if(base.size()>dataEnd.size() && 
+        base.compare(base.size()-dataEnd.size(), dataEnd.size(), dataEnd)==0)
+    {
+        base.erase(base.size()-dataEnd.size());
+    }
+    std::string metaPath=base+metaEnd;
+
+    FILE *file=fopen(metaPath.c_str(), "r");
+    if(!file)
+    {
+        fprintf(stderr, "Failed, can't open SigMF metadata '%s', %s\n",
+                    metaPath.c_str(), strerror(errno));
+        return(false);
+    }
+    std::string meta;
+    char buffer[4096];
+    size_t got;
+    while((got=fread(buffer, 1, sizeof(buffer), file))>0)
+    {
+        meta.append(buffer, got);
+    }
+    fclose(file);
+
+    std::string datatype;
+    std::string rate;
+    if(!findValue(meta, "core:datatype", &datatype))
+    {
+        fprintf(stderr, "Failed, no core:datatype in '%s'\n", 
+                    metaPath.c_str());
+        return(false);
+    }
+    *format=parseFormat(datatype.c_str());
+    if(*format<0)
+    {
+        // complex samples are from before the fm demodulation
+        fprintf(stderr, "Failed, SigMF datatype '%s' isn't one we can "
+                    "decode, it needs to be real fm demodulated samples\n",
+                    datatype.c_str());
+        return(false);
+    }
+    if(findValue(meta, "core:sample_rate", &rate))
+    {
+        *sampleRate=atof(rate.c_str());
+    }
+    *dataPath=base+dataEnd;
+    return(true);
+}
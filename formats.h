@@ -0,0 +1,93 @@
+/*
+ * formats.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* The sample formats an input can be in, and the kernels taking their
+ * samples to the sign bits the decoder works on.
+ * 
+ *  s16le   signed 16 bit little endian, rtl_fm, the default
+ *  s16be   signed 16 bit big endian
+ *  s8      signed 8 bit
+ *  u8      unsigned 8 bit, 128 is zero
+ *  f32le   32 bit float little endian
+ * 
+ * A wav header or SigMF metadata gives the format and sample rate of 
+ * their samples. The kernel for a format is picked once when the 
+ * decoder is made, with SSE2 the sign bits of 16 samples at a time
+ * come from one movemask.
+ */
+
+#ifndef FORMATS_H
+#define FORMATS_H
+
+#include <cstddef>
+#include <string>
+
+// sign bits of samples, bit i of each word set when sample i is high,
+// zero or above, the last word is filled with zeros
+typedef void (*signKernel)(const unsigned char *bytes, size_t samples, 
+            unsigned long long *words);
+
+// bytes a sample, 0 for an unknown format
+int formatBytes(int format);
+signKernel selectSignKernel(int format);
+// the sign of one sample anywhere, for the odd sample and the frames of
+// a multi channel wav
+bool sampleHigh(int format, const unsigned char *sample);
+// names as in the table above or SigMF real datatypes, -1 if unknown
+int parseFormat(const char *name);
+const char *formatName(int format);
+// the SigMF core:datatype
+const char *formatSigmfName(int format);
+
+// the most bytes of a wav frame, all its channels
+#define MAX_FRAME_BYTES (64)
+// a wav header gets this long without its samples and we give up
+#define MAX_WAV_HEADER (65536)
+
+enum wavStatus
+{
+    WAV_OK,
+    WAV_MORE,           // the samples haven't started yet
+    WAV_UNUSABLE        // not a wav or not a format we have
+};
+
+struct wavInfo
+{
+    int format;
+    int frameBytes;     // all the channels, we use the first
+    double sampleRate;
+    size_t dataOffset;  // the samples start here
+    unsigned long long dataBytes;   // ULLONG_MAX if not known
+};
+
+// the header at the start of bytes, up to the data chunk
+wavStatus readWavHeader(const unsigned char *bytes, size_t count, 
+            wavInfo *wav);
+
+// SigMF metadata, path is the .sigmf-meta or .sigmf-data file, fills in
+// the format, sample rate and the data file to read, returns false with
+// a message if it can't be used
+bool readSigmfMeta(const std::string &path, int *format, 
+            double *sampleRate, std::string *dataPath);
+
+#endif // FORMATS_H
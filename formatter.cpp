@@ -0,0 +1,331 @@
+/*
+ * formatter.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include "formatter.h"
+#include "efergy.h"
+
+// scaled values from here on go to snprintf(), above it the ulp is no
+// longer well inside the window formatFixed() looks for a half in
+#define FIXED_EXACT_LIMIT (1e12)
+
+// fields by name, with the decimals a number has by default
+struct fieldName
+{
+    const char *name;
+    templateField field;
+    int decimals;       // -1 for a field that isn't a number
+};
+
+static const fieldName fieldNames[]=
+{
+    {"date", FIELD_DATE, -1},
+    {"time", FIELD_TIME, -1},
+    {"power", FIELD_POWER, 0},
+    {"energy", FIELD_ENERGY, 3},
+    {"periods", FIELD_PERIODS, 1},
+    {"estimated", FIELD_ESTIMATED, -1},
+    {"address", FIELD_ADDRESS, -1},
+    {"bytes", FIELD_BYTES, -1},
+    {"check", FIELD_CHECK, -1},
+    {"source", FIELD_SOURCE, -1},
+    {"quality", FIELD_QUALITY, 2},
+};
+
+void initLineValues(lineValues *values)
+{
+    values->when=0;
+    values->power=0;
+    values->energy=0;
+    values->periods=0;
+    values->quality=0;
+    values->estimated=false;
+    values->bytes=0;
+    values->checksumOk=false;
+    values->source=0;
+}
+
+void initLineBuffer(lineBuffer *out)
+{
+    out->length=0;
+    out->text[0]=0;
+    out->date.second=-1;
+    out->date.text[0]=0;
+}
+
+static void addText(lineTemplate *line, const char *text, size_t length)
+{
+    // literals next to each other are one op
+    if(!line->ops.empty() && line->ops.back().field==FIELD_TEXT)
+    {
+        line->ops.back().length+=length;
+    }
+    else
+    {
+        templateOp op;
+        op.field=FIELD_TEXT;
+        op.decimals=0;
+        op.offset=line->text.size();
+        op.length=length;
+        line->ops.push_back(op);
+    }
+    line->text.append(text, length);
+}
+
+bool compileTemplate(const char *text, lineTemplate *line, 
+            std::string *error)
+{
+    line->text.clear();
+    line->ops.clear();
+    size_t fields=0;
+    const char *at=text;
+    while(*at)
+    {
+        if(*at!='{')
+        {
+            size_t length=strcspn(at, "{");
+            addText(line, at, length);
+            at+=length;
+            continue;
+        }
+        if(at[1]=='{')
+        {
+            addText(line, at, 1);
+            at+=2;
+            continue;
+        }
+        const char *close=strchr(at, '}');
+        if(!close)
+        {
+            *error="no } after '"+std::string(at)+"'";
+            return(false);
+        }
+        std::string name(at+1, close-at-1);
+        int decimals=-1;
+        size_t dot=name.find('.');
+        if(dot!=std::string::npos)
+        {
+            if(sscanf(name.c_str()+dot+1, "%d", &decimals)!=1 || 
+                decimals<0 || decimals>MAX_FIELD_DECIMALS)
+            {
+                *error="bad decimals in {"+name+"}";
+                return(false);
+            }
+            name.erase(dot);
+        }
+        const int count=sizeof(fieldNames)/sizeof(fieldNames[0]);
+        int f=0;
+        while(f<count && name!=fieldNames[f].name)
+            f++;
+        if(f==count || (decimals>=0 && fieldNames[f].decimals<0))
+        {
+            *error="unknown field {"+std::string(at+1, close-at-1)+"}";
+            return(false);
+        }
+        templateOp op;
+        op.field=fieldNames[f].field;
+        op.decimals=(decimals>=0)?decimals:fieldNames[f].decimals;
+        op.offset=0;
+        op.length=0;
+        line->ops.push_back(op);
+        fields++;
+        at=close+1;
+    }
+    // every field at its widest and the newline must fit, then the
+    // formatting needs no checks
+    if(line->text.size()+fields*MAX_FIELD_TEXT+2>LINE_BUFFER_SIZE)
+    {
+        *error="template too long";
+        return(false);
+    }
+    return(true);
+}
+
+const char *cachedDate(dateCache *cache, time_t now)
+{
+    // output is compatible with a standard rrd database input format,
+    // in UTC so we don't have to worry about DST changes
+    if(now!=cache->second)
+    {
+        struct tm parts;
+        gmtime_r(&now, &parts);
+        if(strftime(cache->text, sizeof(cache->text), "%Y-%m-%d %H:%M:%S",
+                    &parts)!=DATE_TEXT_LENGTH)
+        {
+            // a year past 9999, not worth more than a blank
+            memset(cache->text, ' ', DATE_TEXT_LENGTH);
+            cache->text[DATE_TEXT_LENGTH]=0;
+        }
+        cache->second=now;
+    }
+    return(cache->text);
+}
+
+char *formatUnsigned(char *out, unsigned long long value)
+{
+    // digits come out backwards
+    char digits[20];
+    int count=0;
+    do
+    {
+        digits[count++]='0'+value%10;
+        value/=10;
+    } while(value);
+    while(count)
+    {
+        *out++=digits[--count];
+    }
+    return(out);
+}
+
+char *formatFixed(char *out, double value, int decimals)
+{
+    // as printf's %.Nf, which rounds the exact binary value with halves
+    // to even. Scaling by the decimals rounds as well, which only 
+    // matters near a half, so there fma() gives the exact side of it.
+    static const double scales[MAX_FIELD_DECIMALS+1]=
+                {1, 10, 100, 1e3, 1e4, 1e5, 1e6};
+    static const unsigned long long units[MAX_FIELD_DECIMALS+1]=
+                {1, 10, 100, 1000, 10000, 100000, 1000000};
+    double magnitude=fabs(value);
+    double scaled=magnitude*scales[decimals];
+    if(!(scaled<FIXED_EXACT_LIMIT))
+    {
+        // too big to round exactly here, or not a number
+        int length=snprintf(out, MAX_FIELD_TEXT, "%.*f", decimals, value);
+        if(length<0)
+            length=0;
+        return(out+((length<MAX_FIELD_TEXT)?length:MAX_FIELD_TEXT-1));
+    }
+    double whole=floor(scaled);
+    if(decimals>0 && scaled-whole>0.499 && scaled-whole<0.501)
+    {
+        double over=fma(magnitude, scales[decimals], -(whole+0.5));
+        if(over>0 || (over==0 && fmod(whole, 2)!=0))
+            scaled=whole+1;
+        else
+            scaled=whole;
+    }
+    else
+    {
+        scaled=rint(scaled);
+    }
+    if(value<0 || (value==0 && 1.0/value<0))
+    {
+        // printf keeps the sign of a value that rounds to zero
+        *out++='-';
+    }
+    unsigned long long fixed=static_cast<unsigned long long>(scaled);
+    out=formatUnsigned(out, fixed/units[decimals]);
+    if(decimals>0)
+    {
+        *out++='.';
+        unsigned long long fraction=fixed%units[decimals];
+        for(int d=decimals-1; d>=0; d--)
+        {
+            out[d]='0'+fraction%10;
+            fraction/=10;
+        }
+        out+=decimals;
+    }
+    return(out);
+}
+
+char *formatHex(char *out, const unsigned char *bytes, int count)
+{
+    static const char hex[]="0123456789abcdef";
+    for(int i=0; i<count; i++)
+    {
+        *out++=hex[bytes[i]>>4];
+        *out++=hex[bytes[i]&0x0f];
+    }
+    return(out);
+}
+
+size_t formatLine(const lineTemplate *line, const lineValues *values, 
+            lineBuffer *out)
+{
+    static const unsigned char noBytes[EFERGY_PACKET_BYTES]={0};
+    const unsigned char *bytes=values->bytes?values->bytes:noBytes;
+    char *at=out->text;
+    for(size_t i=0; i<line->ops.size(); i++)
+    {
+        const templateOp &op=line->ops[i];
+        switch(op.field)
+        {
+            case FIELD_TEXT:
+                memcpy(at, line->text.data()+op.offset, op.length);
+                at+=op.length;
+                break;
+            case FIELD_DATE:
+                memcpy(at, cachedDate(&out->date, values->when), 
+                            DATE_TEXT_LENGTH);
+                at+=DATE_TEXT_LENGTH;
+                break;
+            case FIELD_TIME:
+                if(values->when<0)
+                    *at++='-';
+                at=formatUnsigned(at, (values->when<0)?
+                    -static_cast<long long>(values->when):values->when);
+                break;
+            case FIELD_POWER:
+                at=formatFixed(at, values->power, op.decimals);
+                break;
+            case FIELD_ENERGY:
+                at=formatFixed(at, values->energy, op.decimals);
+                break;
+            case FIELD_PERIODS:
+                at=formatFixed(at, values->periods, op.decimals);
+                break;
+            case FIELD_ESTIMATED:
+                *at++=values->estimated?'e':' ';
+                break;
+            case FIELD_ADDRESS:
+                at=formatHex(at, bytes, EFERGY_ADDRESS_BYTES);
+                break;
+            case FIELD_BYTES:
+                at=formatHex(at, bytes, EFERGY_PACKET_BYTES);
+                break;
+            case FIELD_CHECK:
+                *at++=values->checksumOk?'P':'F';
+                break;
+            case FIELD_SOURCE:
+                if(values->source<0)
+                    *at++='-';
+                at=formatUnsigned(at, (values->source<0)?
+                            -static_cast<long long>(values->source):
+                            values->source);
+                break;
+            case FIELD_QUALITY:
+                at=formatFixed(at, values->quality, op.decimals);
+                break;
+        }
+    }
+    *at++='\n';
+    *at=0;
+    out->length=at-out->text;
+    return(out->length);
+}
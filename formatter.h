@@ -0,0 +1,140 @@
+/*
+ * formatter.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Text output without allocation, for the log file, latest.txt, the 
+ * rrd update and the per packet lines on stdout.
+ * 
+ * A line is a template compiled once at start up into a list of
+ * literal text and fields, eg the default log line
+ *  {date} {power} {estimated}
+ * Fields are
+ *  {date}       UTC date and time, 2013-10-12 20:25:02
+ *  {time}       seconds since the epoch
+ *  {power}      watts
+ *  {energy}     kW/hr total for the meter
+ *  {periods}    transmit periods the packet covered
+ *  {estimated}  e when the power is repeated from the last interval
+ *  {address}    meter address in hex
+ *  {bytes}      packet bytes in hex
+ *  {check}      P or F for the checksum
+ *  {source}     input number
+ *  {quality}    mean pulse margin of the packet, in samples
+ * and a number takes its decimals after a dot, {power.1}. {{ is a {.
+ * 
+ * Formatting fills a buffer kept by the caller, numbers are converted
+ * with integer arithmetic and the date text is only rebuilt when the 
+ * second changes, so the cost of a line doesn't grow with the number
+ * of meters or packets. A number too big to round exactly that way 
+ * goes to snprintf(), the golden check compares the two.
+ */
+
+#ifndef FORMATTER_H
+#define FORMATTER_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+// room for the longest line a template is allowed to make
+#define LINE_BUFFER_SIZE (512)
+// widest a field can format, a number with its decimals
+#define MAX_FIELD_TEXT (40)
+#define MAX_FIELD_DECIMALS (6)
+#define DATE_TEXT_LENGTH (19)
+
+enum templateField
+{
+    FIELD_TEXT,
+    FIELD_DATE,
+    FIELD_TIME,
+    FIELD_POWER,
+    FIELD_ENERGY,
+    FIELD_PERIODS,
+    FIELD_ESTIMATED,
+    FIELD_ADDRESS,
+    FIELD_BYTES,
+    FIELD_CHECK,
+    FIELD_SOURCE,
+    FIELD_QUALITY
+};
+
+struct templateOp
+{
+    templateField field;
+    int decimals;
+    size_t offset;      // literal text in the template's copy
+    size_t length;
+};
+
+struct lineTemplate
+{
+    std::string text;   // the literal parts
+    std::vector<templateOp> ops;
+};
+
+// what a line can show, a log interval fills the date and power, a 
+// packet the rest
+struct lineValues
+{
+    time_t when;
+    double power;
+    double energy;
+    double periods;
+    double quality;
+    bool estimated;
+    const unsigned char *bytes;     // EFERGY_PACKET_BYTES, or 0
+    bool checksumOk;
+    int source;
+};
+
+// the UTC date text, rebuilt once a second
+struct dateCache
+{
+    time_t second;
+    char text[DATE_TEXT_LENGTH+1];
+};
+
+struct lineBuffer
+{
+    char text[LINE_BUFFER_SIZE];
+    size_t length;
+    dateCache date;
+};
+
+void initLineValues(lineValues *values);
+void initLineBuffer(lineBuffer *out);
+// false with a message in error for an unknown field or a template 
+// that could overrun the buffer
+bool compileTemplate(const char *text, lineTemplate *line, 
+            std::string *error);
+// the line in out->text with a newline, returns its length
+size_t formatLine(const lineTemplate *line, const lineValues *values, 
+            lineBuffer *out);
+const char *cachedDate(dateCache *cache, time_t now);
+
+// the number at out, returns the end, nothing is terminated
+char *formatUnsigned(char *out, unsigned long long value);
+char *formatFixed(char *out, double value, int decimals);
+char *formatHex(char *out, const unsigned char *bytes, int count);
+
+#endif // FORMATTER_H
@@ -0,0 +1,259 @@
+/*
+ * fuzz.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Fuzz targets, for libFuzzer or afl++, which both call 
+ * LLVMFuzzerTestOneInput().
+ * 
+ * The decoder takes its samples straight off the air, so anything must
+ * go in without a crash, and every way of pushing the samples must find
+ * the same packets. Each input drives two targets
+ *  - packet to power, the first EFERGY_PACKET_BYTES are a packet parsed
+ *    at a voltage from the next two bytes
+ *  - the stream decoder, the rest of the input after a list of split 
+ *    points is pushed in the pieces the fuzzer chose, as bytes through
+ *    the gate, as sign words, and through the stream in the s16le, s8 
+ *    and u8 formats so the conversion kernels run. Each must give the 
+ *    packets of the whole input pushed at once through the full decoder.
+ * A difference aborts, so the fuzzer keeps it as a crash.
+ * 
+ *  input = packet[8] voltage[2] splits n[1] lengths[2*n] samples...
+ * 
+ * Build and run
+ *  clang++ -g -O1 -fsanitize=fuzzer,address,undefined -oefergy_fuzz fuzz.cpp libefergy.cpp decoder.cpp formats.cpp -lpthread
+ *  ./efergy_fuzz corpus
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+
+#include "efergy.h"
+
+// most split points taken from an input, they are used in turn
+#define FUZZ_MAX_SPLITS (16)
+// and the longest piece, in bytes
+#define FUZZ_MAX_PIECE (8192)
+
+typedef std::vector<efergyPacket> fuzzPackets;
+
+static void fuzzPower(const uint8_t *data)
+{
+    unsigned char packet[EFERGY_PACKET_BYTES];
+    memcpy(packet, data, sizeof(packet));
+    double voltage=(data[EFERGY_PACKET_BYTES]|
+                (data[EFERGY_PACKET_BYTES+1]<<8))/100.0;
+    efergyChecksum(packet);
+    efergyCheckAddress(packet, packet);
+    // the current is 16 bits and the scaling at most 2^15 either way
+    double power=efergyPacketPower(packet, voltage);
+    if(!(power>=0 && power<=voltage*65536.0))
+    {
+        fprintf(stderr, "Fuzz, power %g at %g volts out of range\n", power,
+                    voltage);
+        abort();
+    }
+}
+
+static void pollAll(efergyDecoder *decoder, fuzzPackets *packets)
+{
+    efergyPacket packet;
+    packet.size=sizeof(packet);
+    while(efergyDecoderPoll(decoder, &packet))
+    {
+        packets->push_back(packet);
+    }
+}
+
+static efergyDecoder *fuzzDecoder(int format, int gate)
+{
+    efergyConfig config;
+    config.size=sizeof(config);
+    efergyDefaultConfig(&config);
+    config.format=format;
+    config.gate=gate;
+    return(efergyDecoderCreate(&config));
+}
+
+static size_t pieceLength(const std::vector<size_t> &splits, size_t piece)
+{
+    return(splits.empty()?FUZZ_MAX_PIECE:splits[piece%splits.size()]);
+}
+
+static void pushBytes(const std::vector<unsigned char> &bytes, 
+            const std::vector<size_t> &splits, fuzzPackets *packets)
+{
+    efergyDecoder *decoder=fuzzDecoder(EFERGY_FORMAT_S16LE, 1);
+    for(size_t at=0, piece=0; at<bytes.size(); piece++)
+    {
+        size_t length=pieceLength(splits, piece);
+        if(length>bytes.size()-at)
+            length=bytes.size()-at;
+        efergyDecoderPushBytes(decoder, &bytes[at], length);
+        pollAll(decoder, packets);
+        at+=length;
+    }
+    efergyDecoderDestroy(decoder);
+}
+
+static void pushBits(const std::vector<short> &samples, 
+            const std::vector<size_t> &splits, fuzzPackets *packets)
+{
+    // a piece is that many samples, packed into words of its own
+    efergyDecoder *decoder=fuzzDecoder(EFERGY_FORMAT_S16LE, 1);
+    std::vector<unsigned long long> words;
+    for(size_t at=0, piece=0; at<samples.size(); piece++)
+    {
+        size_t length=pieceLength(splits, piece);
+        if(length>samples.size()-at)
+            length=samples.size()-at;
+        words.assign((length+63)/64, 0);
+        for(size_t s=0; s<length; s++)
+        {
+            if(samples[at+s]>=0)
+                words[s/64]|=1ULL<<(s%64);
+        }
+        efergyDecoderPushBits(decoder, &words[0], length);
+        pollAll(decoder, packets);
+        at+=length;
+    }
+    efergyDecoderDestroy(decoder);
+}
+
+static bool pushStream(const std::vector<unsigned char> &bytes, int format,
+            const std::vector<size_t> &splits, fuzzPackets *packets)
+{
+    // returns false when the start looks like a header, the stream is 
+    // then not plain samples and can't be compared
+    efergyDecoder *decoder=fuzzDecoder(format, 1);
+    for(size_t at=0, piece=0; at<bytes.size(); piece++)
+    {
+        size_t length=pieceLength(splits, piece);
+        if(length>bytes.size()-at)
+            length=bytes.size()-at;
+        efergyDecoderPushStream(decoder, &bytes[at], length);
+        pollAll(decoder, packets);
+        at+=length;
+    }
+    efergyDecoderDestroy(decoder);
+    const char *magics[]={EFERGY_PACKED_MAGIC, EFERGY_RUNS_MAGIC, "RIFF"};
+    for(int m=0; m<3; m++)
+    {
+        if(bytes.size()>=4 && memcmp(&bytes[0], magics[m], 4)==0)
+            return(false);
+    }
+    return(true);
+}
+
+static void comparePackets(const char *name, const fuzzPackets &expected,
+            const fuzzPackets &found)
+{
+    bool same=(expected.size()==found.size());
+    for(size_t p=0; same && p<found.size(); p++)
+    {
+        same=(expected[p].start==found[p].start && 
+              expected[p].end==found[p].end &&
+              expected[p].checksumOk==found[p].checksumOk &&
+              memcmp(expected[p].bytes, found[p].bytes, 
+                    EFERGY_PACKET_BYTES)==0);
+    }
+    if(!same)
+    {
+        fprintf(stderr, "Fuzz, %s path found %lu packets, the full decoder "
+                    "%lu, or they differ\n", name, 
+                    static_cast<unsigned long>(found.size()),
+                    static_cast<unsigned long>(expected.size()));
+        abort();
+    }
+}
+
+static void fuzzStream(const uint8_t *data, size_t size)
+{
+    if(size<1)
+    {
+        return;
+    }
+    size_t count=data[0]%(FUZZ_MAX_SPLITS+1);
+    data++;
+    size--;
+    if(size<2*count)
+    {
+        return;
+    }
+    std::vector<size_t> splits;
+    for(size_t s=0; s<count; s++)
+    {
+        splits.push_back((data[2*s]|(data[2*s+1]<<8))%FUZZ_MAX_PIECE+1);
+    }
+    data+=2*count;
+    size-=2*count;
+
+    std::vector<unsigned char> bytes(data, data+size);
+    std::vector<short> samples;
+    std::vector<unsigned char> s8;
+    std::vector<unsigned char> u8;
+    for(size_t i=0; i+1<size; i+=2)
+    {
+        samples.push_back(static_cast<short>(data[i]|(data[i+1]<<8)));
+        s8.push_back(data[i+1]);
+        u8.push_back(data[i+1]^0x80);
+    }
+
+    fuzzPackets expected;
+    efergyDecoder *decoder=fuzzDecoder(EFERGY_FORMAT_S16LE, 0);
+    if(!samples.empty())
+    {
+        efergyDecoderPush(decoder, &samples[0], samples.size());
+    }
+    pollAll(decoder, &expected);
+    efergyDecoderDestroy(decoder);
+
+    fuzzPackets found;
+    pushBytes(bytes, splits, &found);
+    comparePackets("bytes", expected, found);
+    found.clear();
+    pushBits(samples, splits, &found);
+    comparePackets("bits", expected, found);
+    found.clear();
+    if(pushStream(bytes, EFERGY_FORMAT_S16LE, splits, &found))
+        comparePackets("s16le stream", expected, found);
+    found.clear();
+    if(pushStream(s8, EFERGY_FORMAT_S8, splits, &found))
+        comparePackets("s8 stream", expected, found);
+    found.clear();
+    if(pushStream(u8, EFERGY_FORMAT_U8, splits, &found))
+        comparePackets("u8 stream", expected, found);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if(size<EFERGY_PACKET_BYTES+2)
+    {
+        return(0);
+    }
+    fuzzPower(data);
+    fuzzStream(data+EFERGY_PACKET_BYTES+2, size-EFERGY_PACKET_BYTES-2);
+    return(0);
+}
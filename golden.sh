@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# Regression check of the decoder, each capture in golden/ is decoded
+# through every ingestion path and the packets compared with its
+# stored list, see -g in efergy.cpp, then the number formatting is
+# checked with -F. Exits non-zero on any difference.
+#  ./golden.sh [efergy]
+# The captures were made with -S, the raw one as it is and the other
+# packed with -P
+#  efergy -S 10 > golden/synthetic10.raw
+#  efergy -S 4 | efergy -P > golden/synthetic4.bit
+# and a list is only replaced, with -G, once a change in the packets
+# is understood
+#  efergy -Ggolden/synthetic10.g < golden/synthetic10.raw
+
+# the one built here unless given
+EFERGY=$1
+case "$EFERGY" in
+	"") EFERGY=./efergy ;;
+	/*) ;;
+	*/*) EFERGY="$PWD/$EFERGY" ;;
+esac
+cd "$(dirname "$0")"
+
+failed=0
+for capture in golden/*.raw golden/*.bit
+do
+	[ -f "$capture" ] || continue
+	list="${capture%.*}.g"
+	if "$EFERGY" -g"$list" < "$capture" > /dev/null 2> golden.out
+	then
+		echo "ok   $capture"
+	else
+		echo "FAIL $capture"
+		cat golden.out
+		failed=1
+	fi
+done
+rm -f golden.out
+
+# and the numbers of the text output
+if ! "$EFERGY" -F
+then
+	failed=1
+fi
+exit $failed
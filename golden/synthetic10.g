@@ -0,0 +1,198 @@
+# efergy golden packets, 669029 samples
+# start end bytes
+2020 3262 87448f24387aed70
+5361 6611 19af6b4c17d0f72a
+8689 9915 a5501b23bca9e002
+12015 13287 d4745ee5cbf38fd8
+15347 16590 7963bade716e2e6c
+18686 19947 18568345a4a0b52f
+22007 23277 13bd1502dd332e25
+25337 26606 f10e30f35e224def
+28666 29921 0235059c6c457e47
+32001 33280 035c098e77109b18
+35340 36629 1da2995f16069366
+38689 39903 f889d24b18634134
+42019 43295 f2d756c84c7407ae
+45355 46635 22093ccc35d85c9c
+48695 49949 e88e201f24629a39
+52029 53310 5e3deb3a19be28bf
+55370 56629 78b1bc3388cae226
+58707 59985 e42e4edcfdbf4139
+62045 63320 6f341f0793a8484c
+65380 66654 225033396703d61e
+68714 69939 c4eb1161a739b235
+72055 73338 6eebdfca9f46f8df
+75398 76611 047ba2b44c9a4e1c
+78728 79980 aa36da49c4db34d1
+82060 83322 17c68933b3c88c36
+85401 86658 62ffa6f033ae7c26
+88737 90014 caaf9c9b1b419aa6
+92074 93334 e57d422b2100e15a
+95412 96688 42e3970948c68558
+98753 99990 759c920983394284
+102088 103370 d346b389281443d4
+105430 106676 1fbad14fbde6c56d
+108754 110020 05c9140c09880d97
+112098 113373 de8b372ced6bf81c
+115433 116687 06816f5e1f1489cd
+118776 120012 804694b8b9c2c211
+122092 123362 e5dd0d436885eceb
+125422 126683 9b820b2d2123205e
+128762 130043 a3aa87460e4e31a7
+132103 133361 ad086f447330eb73
+135441 136722 92305c467cf9a27b
+138782 140062 30f52c66299542b7
+142122 143397 37c73c41d06043ee
+145457 146737 56c0e301a528f3ba
+148797 150075 7b9dea375c136d15
+152135 153410 ffc64a59126a2f13
+155470 156715 824e6057b3e61cec
+158795 160059 058e19137a3f3ab2
+162119 163344 01fe0c6a344ac400
+165460 166735 7a533a483e2bcb83
+168795 170064 eddefb54f1d3be9c
+172124 173385 b3c5b0c5d92d089d
+175465 176736 7d7d4efa21946960
+178796 180032 43701e07d09ace1c
+182130 183374 9598be820521ea68
+185453 186704 24e626ec78edbff7
+188782 190015 85d464614460b502
+192113 193393 91eb0e5dca922a6d
+195453 196702 6a057ea88c270aee
+198780 200063 c9fa25c4cd3543f1
+202123 203404 453f6ce44f4fc537
+205464 206741 064eb4674e635878
+208801 210036 dbc5bdf9b1023efe
+212133 213393 212aaf0ce199820a
+215472 216713 e01b5055fdf7d444
+218810 220041 842730db34dbaa58
+222140 223421 3e907428fb5502bc
+225481 226748 bc0fd103806b008a
+228808 230082 f2321f02fb1f0160
+232142 233396 18c85f2ef768c9a6
+235474 236750 5b2aea838e92aec0
+238810 240043 6b3341e280744805
+242141 243411 d3f5d046df3c7069
+245471 246756 fb8a30eaa59de4c5
+248816 250085 e4373c5724df34e5
+252145 253412 4740a32898623783
+255472 256751 76eef99fab39fbdb
+258811 260069 cfac75418c35c25b
+262147 263434 776e50f4fe55b22e
+265494 266779 0d03cf562053dc84
+268839 270112 0016d8b60e5ec5d5
+272172 273465 242732d3792dc4ba
+275525 276779 4aca69a1c5d2bcd4
+278870 280090 7f496b35f3819af4
+282187 283463 c77eddcbc1afe946
+285523 286779 00aed4718e383713
+288857 290131 047295185847c98b
+292191 293437 24a0876512284d08
+295535 296800 2854385d2ac5404a
+298879 300159 c24c1f60c9d80d3b
+302219 303481 6f7096cb3796fb04
+305560 306832 6096ce390094f889
+308892 310165 7b21ebac5a9f8cb8
+312225 313478 0743a553a26bc9da
+315556 316822 b3e19d40fdb4aed0
+318882 320100 aab55bcaf234a18d
+322217 323494 717cb79e67876494
+325554 326825 1471f8da410b07aa
+328903 330155 88f3074599fa90e9
+332233 333508 f5fa88ee9b7c0a86
+335568 336823 e40494dca3dae083
+338903 340156 744a583496d798c6
+342236 343521 4295c0aeee460780
+345581 346857 21f67187734f18e9
+348917 350155 e1738fa88e469a7e
+352254 353534 a505c3e56470163c
+355594 356844 6c44f1886741ec2d
+358922 360166 202b1a73ee068667
+362265 363468 017805593249e8b5
+365603 366838 622f4ddf44dc099b
+368935 370207 ea732266a0a090b5
+372267 373522 b3971042018f99ef
+375601 376887 e38e2687178120d6
+378947 380228 a146c310432c92bb
+382288 383546 e577ebb282f34dbb
+385606 386886 befb893212367d39
+388946 390209 dc11ba9a37582421
+392289 393571 b15d934233e0160c
+395631 396887 a8661dbd66309655
+398966 400186 88c3b1a7e3b9169e
+402302 403555 5863a70c7ac49741
+405634 406914 e2c676fd29c19499
+408974 410214 16865791925c4781
+412312 413541 0742c4f651e6e44d
+415638 416894 4c26231b801439e5
+418973 420241 2dace36a530a8b0e
+422301 423563 6406300ce40d5620
+425642 426855 70a40a84ef3ef56b
+428973 430211 c20c566ddfd04934
+435637 436893 f1ef3340c3129f1e
+438973 440211 0f8c2672529708dc
+442309 443580 900c337bfd015098
+445640 446893 21a86a5d49e184a1
+448973 450231 3626ff416efe2898
+452310 453550 64f47e4559654c86
+455648 456927 76e66f19dd5e6584
+458987 460249 ea13e623ef239e6a
+462327 463608 d606d6efeb9b1b42
+465668 466936 e66359b437f741c5
+468996 470251 b8177787e418cd91
+472330 473589 71f4e6ce99932d3f
+475668 476928 31ee541714fccc33
+479007 480266 f64a94c43a5457ea
+482344 483607 a7cd401c8688dc7c
+485687 486967 c304df719c26a57e
+489027 490307 5cf8c5adcbfd9a28
+492367 493646 ac0b76e8f7530463
+495706 496974 d5b2dc9d31826417
+499034 500281 b5189679725ad178
+502358 503592 491482a33410ec40
+505688 506950 1c21ee40661d067d
+509028 510305 734d38f7c2c770e8
+512365 513616 a30d529a18091f64
+515695 516980 92eae4b4e02e5f81
+519040 520280 1f5757bc7d3e5ada
+522358 523634 a4888f9a21b71744
+525694 526944 2052176560f55bfc
+529024 530294 1795cd4d7c0a71bd
+532354 533575 70cf61ec6b30b903
+535691 536940 1a1e181e1de76ec5
+539019 540257 427c1d741029d3ac
+542337 543597 ccb75310c69ee1cd
+545677 546944 f66a2301933a4697
+549015 550280 1dc8233278d3e76c
+552340 553590 a0e829a3b35beb81
+559008 560270 aa4ac1d258694de1
+562350 563623 1614536947aa845b
+565683 566957 4c28903f9e6975bf
+569017 570267 a2b4424b054df328
+572347 573587 45ee89a4a4e3d4df
+575686 576961 6a3b3166003881f5
+579021 580279 cd1b91133bd29177
+582359 583579 6a0f36c0d39d3da8
+585686 586958 bd6e2d9d8afb930d
+589018 590300 9e184d27987aa9e5
+592360 593617 96393843018d1bf2
+595696 596936 d2cf580cd6ca5ec2
+599032 600295 e7abc56735bbf4b4
+602375 603631 986358da4d98dfa7
+605709 606971 76e41613077cee51
+609050 610280 c997b6f02f843e5b
+612388 613636 535ad36338691ea2
+619017 620293 33ebb9304d03d82f
+622353 623629 07747ee1b486687c
+625689 626950 ece34d1c6aebf9a1
+629029 630309 8e44bd3c8d1e31a7
+632369 633636 d0447d1cb81bef6f
+635696 636974 ceffdb114ea9c373
+639034 640314 518c87ef19f6de40
+642374 643651 f313589817e8a89d
+645711 646928 158ff5588aafd0c2
+652383 653657 6bddc042ffa5a694
+655717 656983 b3778e1f13ea2f03
+659043 660326 1b1e54daadda1907
+662386 663636 7ae48990361ee575
+665716 666969 ced9bbcd70334e8f
@@ -0,0 +1,49 @@
+# efergy golden packets, 669029 samples
+# start end bytes
+18695 19477 0060289010118000
+22007 22778 00041900220004c2
+48695 49467 0281050000002c90
+55378 56090 308400046a0021a0
+62064 62808 00010020012003c0
+78728 79498 08a0308d44800000
+85404 86138 6094b710402e0006
+92082 92802 6049c00000001200
+98763 99526 1010060484000004
+102098 102689 0008800082406000
+128762 129472 0006080a00042100
+132103 132849 80a0200482200014
+135459 136241 8803001701060440
+138801 139576 1804622230286000
+152135 153000 3e70601401820212
+158801 159555 802c600c20001b00
+168807 169590 406c4810b3004460
+175467 176239 1020820040d4c020
+182148 182892 8042600631000001
+195466 196176 201001223c400008
+222159 222871 04a0000080804818
+225496 226179 8820003040400100
+238810 239462 4208402000120042
+242141 242868 4432211a4000000c
+258826 259519 c962080000820004
+292191 292999 0424804020045000
+308892 309662 1410000042e48002
+315572 316276 8030000208120010
+328907 329657 8200226001104802
+335581 336251 2410000000086a84
+342236 343004 4824080080054205
+378947 379833 0102414c09000019
+395630 396370 090008600c200e88
+422301 423026 9008006100006000
+435637 436321 b800889408042004
+448972 449658 8310004118098802
+458987 459741 19400040c20081a4
+475668 476395 8040022040001380
+485698 486411 2040009918040100
+502359 503022 9082050400801030
+529037 529718 010594140c000501
+542337 543029 1080813a00310020
+579039 579728 2020040220080140
+585698 586381 00e1100804c1040a
+592360 593071 01500a001c020008
+635696 636326 c04460030c300004
+645729 646568 00210e7a25008494
@@ -0,0 +1,206 @@
+/*
+ * governor.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstring>
+
+#include "governor.h"
+
+const char *engineNames[EFERGY_ENGINE_COUNT]=
+{
+    "gated",
+    "full",
+    "hypothesis",
+    "repair"
+};
+
+int parseEngine(const char *name)
+{
+    for(int e=0; e<EFERGY_ENGINE_COUNT; e++)
+    {
+        if(strcmp(name, engineNames[e])==0)
+        {
+            return(e);
+        }
+    }
+    return(-1);
+}
+
+static void startWindow(engineGovernor *governor)
+{
+    governor->windowCost=0;
+    governor->windowSpan=0;
+    governor->windowFill=0;
+}
+
+void initGovernor(engineGovernor *governor, int index, 
+            efergyDecoder *decoder, double byteRate, int ceiling)
+{
+    governor->index=index;
+    governor->decoder=decoder;
+    governor->byteRate=byteRate;
+    governor->ceiling=ceiling;
+    governor->engine=(byteRate>0)?EFERGY_ENGINE_GATED:ceiling;
+    efergyDecoderSetEngine(decoder, governor->engine);
+    governor->since=0;
+    governor->hold=GOVERNOR_HOLD_SECONDS;
+    governor->trial=false;
+    governor->load=0;
+    governor->maxFill=0;
+    governor->fillSpan=0;
+    governor->leastFill=1;
+    governor->downFill=GOVERNOR_HIGH_FILL;
+    governor->switches=0;
+    for(int e=0; e<EFERGY_ENGINE_COUNT; e++)
+    {
+        governor->seconds[e]=0;
+    }
+    startWindow(governor);
+}
+
+static void switchEngine(engineGovernor *governor, int engine, double now,
+            const char *why)
+{
+    fprintf(stderr, "Input %d engine %s to %s after %.1fs, %s\n", 
+                governor->index, engineNames[governor->engine], 
+                engineNames[engine], now-governor->since, why);
+    governor->seconds[governor->engine]+=now-governor->since;
+    efergyDecoderSetEngine(governor->decoder, engine);
+    governor->engine=engine;
+    governor->since=now;
+    governor->switches++;
+    startWindow(governor);
+}
+
+static void stepDown(engineGovernor *governor, double now, const char *why)
+{
+    if(governor->trial)
+    {
+        // the engine above is too dear for now, wait longer to retry
+        governor->trial=false;
+        governor->hold*=2;
+        if(governor->hold>GOVERNOR_MAX_HOLD_SECONDS)
+            governor->hold=GOVERNOR_MAX_HOLD_SECONDS;
+    }
+    switchEngine(governor, governor->engine-1, now, why);
+}
+
+void governBlock(engineGovernor *governor, size_t count, double cost, 
+            double fill, double now)
+{
+    if(governor->byteRate<=0 || count==0)
+    {
+        return;
+    }
+    if(governor->since==0)
+    {
+        // the time in the engines starts with the samples
+        governor->since=now;
+    }
+    double span=count/governor->byteRate;
+    governor->windowCost+=cost;
+    governor->windowSpan+=span;
+    if(fill>governor->maxFill)
+        governor->maxFill=fill;
+    if(fill<governor->leastFill)
+        governor->leastFill=fill;
+    governor->fillSpan+=span;
+
+    char why[80];
+    if(governor->fillSpan>=GOVERNOR_FILL_SECONDS)
+    {
+        double behind=governor->leastFill;
+        governor->fillSpan=0;
+        governor->leastFill=1;
+        if(behind>governor->windowFill)
+            governor->windowFill=behind;
+        if(behind<GOVERNOR_HIGH_FILL)
+        {
+            governor->downFill=GOVERNOR_HIGH_FILL;
+        }
+        else if(behind>=governor->downFill && 
+                governor->engine>EFERGY_ENGINE_GATED)
+        {
+            // falling behind, don't wait for the window, but give the
+            // cheaper engine a chance to drain the buffer
+            governor->downFill=behind+GOVERNOR_LOW_FILL;
+            snprintf(why, sizeof(why), "buffer %.0f%% full", 100*behind);
+            stepDown(governor, now, why);
+            return;
+        }
+    }
+    if(governor->windowSpan<GOVERNOR_WINDOW_SECONDS)
+    {
+        return;
+    }
+    governor->load=governor->windowCost/governor->windowSpan;
+    snprintf(why, sizeof(why), "load %.3f of the budget", governor->load);
+    if(governor->load>GOVERNOR_HIGH_LOAD && 
+        governor->engine>EFERGY_ENGINE_GATED)
+    {
+        stepDown(governor, now, why);
+        return;
+    }
+    if(governor->trial)
+    {
+        // a window through on the engine stepped up to
+        governor->trial=false;
+        governor->hold=GOVERNOR_HOLD_SECONDS;
+    }
+    if(governor->load<GOVERNOR_LOW_LOAD && 
+        governor->windowFill<GOVERNOR_LOW_FILL &&
+        governor->engine<governor->ceiling && 
+        now-governor->since>=governor->hold)
+    {
+        governor->trial=true;
+        switchEngine(governor, governor->engine+1, now, why);
+        return;
+    }
+    startWindow(governor);
+}
+
+double governorSeconds(const engineGovernor *governor, int engine, 
+            double now)
+{
+    double seconds=governor->seconds[engine];
+    if(engine==governor->engine && governor->since>0)
+    {
+        seconds+=now-governor->since;
+    }
+    return(seconds);
+}
+
+void outputGovernor(FILE *out, const engineGovernor *governor, double now)
+{
+    if(governor->byteRate<=0)
+    {
+        return;
+    }
+    fprintf(out, "\tinput %d engine %s, %llu switches,", governor->index,
+                engineNames[governor->engine], governor->switches);
+    for(int e=0; e<=governor->ceiling; e++)
+    {
+        fprintf(out, " %s %.1fs", engineNames[e], 
+                    governorSeconds(governor, e, now));
+    }
+    fprintf(out, ", buffer at most %.0f%% full\n", 100*governor->maxFill);
+}
@@ -0,0 +1,117 @@
+/*
+ * governor.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Picking the decoder's engine for the cpu there is.
+ * 
+ * The engines of efergy.h cost more the more they find, gated skips 
+ * the samples between packets, full looks at every one, hypothesis and
+ * repair then work on the packets failing their checksum. On a box 
+ * busy with other things the dearest may not keep up with a live 
+ * input, on an idle one the cheapest leaves packets behind. The 
+ * governor of an input times decode on each block against the time 
+ * the block's samples span, its budget, and watches how full the 
+ * buffer in front of decode is, the block queue of the pipeline or the
+ * pipe of the event loop. The samples come in bursts, so a buffer 
+ * keeping up still fills, but it drains between them, the least it 
+ * holds over GOVERNOR_FILL_SECONDS of samples is how far decode is 
+ * behind
+ *  - a window of GOVERNOR_WINDOW_SECONDS of samples using more than 
+ *    GOVERNOR_HIGH_LOAD of the budget, or decode falling behind by 
+ *    GOVERNOR_HIGH_FILL of the buffer, steps down an engine at once, 
+ *    and again each time it falls behind by another GOVERNOR_LOW_FILL
+ *  - a window under GOVERNOR_LOW_LOAD, never behind by GOVERNOR_LOW_FILL,
+ *    steps up an engine, up to the one asked for, once the engine has
+ *    run for the hold
+ * A step up that comes back down within its first window doubles the
+ * hold, up to GOVERNOR_MAX_HOLD_SECONDS, one that lasts puts it back.
+ * Every switch is logged and the time in each engine kept.
+ * 
+ * An input that isn't live has no budget, its decoder just runs the 
+ * engine asked for.
+ */
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <cstdio>
+#include <cstddef>
+
+#include "efergy.h"
+
+// seconds of samples the load is taken over
+#define GOVERNOR_WINDOW_SECONDS (5.0)
+// share of the budget decode may take before stepping down
+#define GOVERNOR_HIGH_LOAD (0.5)
+// and under which it steps up
+#define GOVERNOR_LOW_LOAD (0.2)
+// seconds of samples the buffer is seen to drain over
+#define GOVERNOR_FILL_SECONDS (0.5)
+// share of the buffer decode is behind by before stepping down
+#define GOVERNOR_HIGH_FILL (0.5)
+// and that it must stay under to step up
+#define GOVERNOR_LOW_FILL (0.25)
+#define GOVERNOR_HOLD_SECONDS (10.0)
+#define GOVERNOR_MAX_HOLD_SECONDS (320.0)
+
+extern const char *engineNames[EFERGY_ENGINE_COUNT];
+
+struct engineGovernor
+{
+    int index;                  // of the input, for the log
+    efergyDecoder *decoder;
+    double byteRate;            // input bytes a second, 0 when off
+    int ceiling;                // dearest engine it may pick
+    int engine;                 // running now
+    double since;               // monotonic seconds it started, 0 
+                                // before the first block
+    double hold;                // seconds an engine runs before a step up
+    bool trial;                 // stepped up, in its first window
+    double windowCost;          // seconds decoding in the window
+    double windowSpan;          // seconds of samples in it
+    double windowFill;          // most decode was behind in it
+    double fillSpan;            // seconds of samples the buffer is 
+    double leastFill;           // watched for, and the least it held
+    double downFill;            // fill that steps down, higher while
+                                // it stays up after doing so
+    double load;                // of the last window
+    double maxFill;             // fullest the buffer has been
+    unsigned long long switches;
+    double seconds[EFERGY_ENGINE_COUNT];    // in each engine, to since
+};
+
+// returns the EFERGY_ENGINE_ of name, or -1
+int parseEngine(const char *name);
+// a byte rate of zero runs ceiling from the start, for inputs that 
+// aren't live, otherwise the cheapest engine to start
+void initGovernor(engineGovernor *governor, int index, 
+            efergyDecoder *decoder, double byteRate, int ceiling);
+// after each block, count bytes decoded in cost seconds, the buffer
+// fill from 0 to 1 and monotonic seconds now, may change the engine
+void governBlock(engineGovernor *governor, size_t count, double cost, 
+            double fill, double now);
+// seconds in engine up to now
+double governorSeconds(const engineGovernor *governor, int engine, 
+            double now);
+void outputGovernor(FILE *out, const engineGovernor *governor, double now);
+
+#endif // GOVERNOR_H
@@ -0,0 +1,272 @@
+/*
+ * journal.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include "journal.h"
+
+static bool readHeader(FILE *file, journalHeader *header, 
+            const std::string &path)
+{
+    if(fseek(file, 0, SEEK_SET)!=0 || 
+        fread(header, 1, sizeof(*header), file)!=sizeof(*header) ||
+        memcmp(header->magic, PACKET_JOURNAL_MAGIC, 
+                    sizeof(header->magic))!=0 ||
+        header->headerBytes<sizeof(*header) ||
+        header->slotBytes!=sizeof(journalRecord) ||
+        header->indexEvery==0)
+    {
+        fprintf(stderr, "Failed, '%s' isn't a packet journal\n", 
+                    path.c_str());
+        return(false);
+    }
+    return(true);
+}
+
+static unsigned long long wholeSlots(FILE *file, 
+            const journalHeader *header)
+{
+    // a slot cut short by a crash isn't counted, the next write goes
+    // over it
+    if(fseek(file, 0, SEEK_END)!=0)
+    {
+        return(0);
+    }
+    long size=ftell(file);
+    if(size<static_cast<long>(header->headerBytes))
+    {
+        return(0);
+    }
+    return((size-header->headerBytes)/header->slotBytes);
+}
+
+static long slotOffset(const journalHeader *header, unsigned long long slot)
+{
+    return(header->headerBytes+slot*header->slotBytes);
+}
+
+static void writeIndex(packetJournal *journal)
+{
+    // closes the block of records before it
+    journalIndex index;
+    memset(&index, 0, sizeof(index));
+    index.first=journal->first;
+    index.last=journal->last;
+    index.records=journal->records;
+    index.count=journal->count;
+    index.flags=JOURNAL_INDEX;
+    fwrite(&index, 1, sizeof(index), journal->file);
+    journal->count=0;
+}
+
+bool openJournal(packetJournal *journal, const std::string &path)
+{
+    journal->file=0;
+    journal->indexEvery=JOURNAL_INDEX_EVERY;
+    journal->count=0;
+    journal->first=0;
+    journal->last=0;
+    journal->records=0;
+    journal->written=0;
+
+    journalHeader header;
+    FILE *file=fopen(path.c_str(), "r+b");
+    if(!file && errno==ENOENT)
+    {
+        file=fopen(path.c_str(), "w+b");
+        if(file)
+        {
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, PACKET_JOURNAL_MAGIC, sizeof(header.magic));
+            header.headerBytes=sizeof(header);
+            header.slotBytes=sizeof(journalRecord);
+            header.indexEvery=JOURNAL_INDEX_EVERY;
+            header.startTime=time(0);
+            fwrite(&header, 1, sizeof(header), file);
+            fflush(file);
+            journal->file=file;
+            return(true);
+        }
+    }
+    if(!file)
+    {
+        fprintf(stderr, "Failed, can't open packet journal '%s', %s\n",
+                    path.c_str(), strerror(errno));
+        return(false);
+    }
+    if(!readHeader(file, &header, path))
+    {
+        fclose(file);
+        return(false);
+    }
+
+    // carry on after the last whole slot, the block still open has its
+    // times read back from its records
+    unsigned long long slots=wholeSlots(file, &header);
+    unsigned long long block=header.indexEvery+1ULL;
+    journal->indexEvery=header.indexEvery;
+    journal->count=slots%block;
+    journal->records=(slots/block)*header.indexEvery+journal->count;
+    fseek(file, slotOffset(&header, slots-journal->count), SEEK_SET);
+    for(unsigned int r=0; r<journal->count; r++)
+    {
+        journalRecord record;
+        if(fread(&record, 1, sizeof(record), file)!=sizeof(record))
+            break;
+        if(r==0)
+            journal->first=record.time;
+        journal->last=record.time;
+    }
+    fseek(file, slotOffset(&header, slots), SEEK_SET);
+    journal->file=file;
+    if(journal->count==journal->indexEvery)
+    {
+        // the last run stopped between a block's last record and its
+        // index slot
+        writeIndex(journal);
+        fflush(file);
+    }
+    fprintf(stderr, "Packet journal '%s' has %llu packets, adding to it\n",
+                path.c_str(), journal->records);
+    return(true);
+}
+
+void journalPacket(packetJournal *journal, const efergyPacket *packet,
+            double time)
+{
+    if(!journal->file)
+    {
+        return;
+    }
+    journalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.time=time;
+    record.packetTime=packet->time;
+    memcpy(record.bytes, packet->bytes, EFERGY_PACKET_BYTES);
+    record.quality=packet->quality;
+    record.source=packet->source;
+    record.flags=(packet->checksumOk?JOURNAL_CHECKSUM:0)|
+                 (packet->accepted?JOURNAL_ACCEPTED:0);
+    fwrite(&record, 1, sizeof(record), journal->file);
+    if(journal->count==0)
+        journal->first=time;
+    journal->last=time;
+    journal->count++;
+    journal->records++;
+    journal->written++;
+
+    if(journal->count==journal->indexEvery)
+    {
+        writeIndex(journal);
+    }
+    // a whole record at a time for anyone reading as it grows
+    fflush(journal->file);
+}
+
+void closeJournal(packetJournal *journal)
+{
+    if(journal->file)
+    {
+        fclose(journal->file);
+        journal->file=0;
+    }
+}
+
+bool openJournalReader(journalReader *reader, const std::string &path)
+{
+    reader->file=fopen(path.c_str(), "rb");
+    if(!reader->file)
+    {
+        fprintf(stderr, "Failed, can't open packet journal '%s', %s\n",
+                    path.c_str(), strerror(errno));
+        return(false);
+    }
+    if(!readHeader(reader->file, &reader->header, path))
+    {
+        fclose(reader->file);
+        reader->file=0;
+        return(false);
+    }
+    reader->slots=wholeSlots(reader->file, &reader->header);
+    reader->at=0;
+    fseek(reader->file, slotOffset(&reader->header, 0), SEEK_SET);
+    return(true);
+}
+
+static bool readIndex(journalReader *reader, unsigned long long block,
+            journalIndex *index)
+{
+    unsigned long long slot=(block+1)*(reader->header.indexEvery+1ULL)-1;
+    return(fseek(reader->file, slotOffset(&reader->header, slot), 
+                    SEEK_SET)==0 &&
+           fread(index, 1, sizeof(*index), reader->file)==sizeof(*index) &&
+           (index->flags&JOURNAL_INDEX));
+}
+
+void seekJournal(journalReader *reader, double time)
+{
+    // the first whole block whose last record isn't before time, or 
+    // the open block at the end
+    unsigned long long block=reader->header.indexEvery+1ULL;
+    unsigned long long low=0;
+    unsigned long long high=reader->slots/block;
+    while(low<high)
+    {
+        unsigned long long middle=low+(high-low)/2;
+        journalIndex index;
+        if(readIndex(reader, middle, &index) && index.last<time)
+            low=middle+1;
+        else
+            high=middle;
+    }
+    reader->at=low*block;
+    fseek(reader->file, slotOffset(&reader->header, reader->at), SEEK_SET);
+}
+
+bool readJournal(journalReader *reader, journalRecord *record)
+{
+    while(reader->at<reader->slots)
+    {
+        if(fread(record, 1, sizeof(*record), reader->file)!=sizeof(*record))
+        {
+            return(false);
+        }
+        reader->at++;
+        if(!(record->flags&JOURNAL_INDEX))
+        {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+void closeJournalReader(journalReader *reader)
+{
+    if(reader->file)
+    {
+        fclose(reader->file);
+        reader->file=0;
+    }
+}
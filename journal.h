@@ -0,0 +1,121 @@
+/*
+ * journal.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* A binary journal of every packet given to the sink, so the logs, 
+ * the rrd and the totals can be rebuilt with other settings without 
+ * going back to the samples.
+ * 
+ * The file is a journalHeader then fixed size slots in host order. A
+ * slot is a journalRecord for a packet, except every indexEvery+1th 
+ * which is a journalIndex of the times of the records before it, so a
+ * time is found with a binary search over the index slots and a read
+ * of one block. The records are written as the packets come and a 
+ * journal that already exists is carried on, across restarts it is one
+ * record of the packets.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdio>
+#include <string>
+
+#include "efergy.h"
+
+#define PACKET_JOURNAL_MAGIC "EFJ1"
+// packet records between index slots
+#define JOURNAL_INDEX_EVERY (1024)
+
+// flags of a slot
+#define JOURNAL_CHECKSUM (1)     // passed the checksum
+#define JOURNAL_ACCEPTED (2)     // and the address filter
+#define JOURNAL_INDEX (0x80)     // an index slot
+
+struct journalHeader
+{
+    char magic[4];              // PACKET_JOURNAL_MAGIC, no terminator
+    unsigned int headerBytes;   // slots start here
+    unsigned int slotBytes;     // size of each slot
+    unsigned int indexEvery;    // records before each index slot
+    long long startTime;        // unix seconds the journal was created
+    long long reserved;
+};
+
+struct journalRecord
+{
+    double time;                // unix seconds the sink had the packet
+    double packetTime;          // the efergyPacket time, for the energy
+    unsigned char bytes[EFERGY_PACKET_BYTES];
+    float quality;              // mean pulse margin, in samples
+    signed char source;         // input it came from, -1 combined
+    unsigned char flags;        // JOURNAL_ flags
+    unsigned char reserved[2];
+};
+
+// the same size as a record with the flags in the same place
+struct journalIndex
+{
+    double first;               // times of the records in the block
+    double last;
+    unsigned long long records; // packet records before this slot
+    unsigned int count;         // records in the block
+    unsigned char reserved;
+    unsigned char flags;        // JOURNAL_INDEX
+    unsigned char reserved2[2];
+};
+
+struct packetJournal
+{
+    FILE *file;
+    unsigned int indexEvery;
+    unsigned int count;         // records since the last index slot
+    double first;               // and their times
+    double last;
+    unsigned long long records; // packet records in the file
+    unsigned long long written; // by this run
+};
+
+struct journalReader
+{
+    FILE *file;
+    journalHeader header;
+    unsigned long long slots;   // whole slots in the file
+    unsigned long long at;      // next slot to read
+};
+
+// carries on an existing journal, false with a message on failure
+bool openJournal(packetJournal *journal, const std::string &path);
+// time is the unix seconds the packet reached the sink
+void journalPacket(packetJournal *journal, const efergyPacket *packet,
+            double time);
+void closeJournal(packetJournal *journal);
+
+bool openJournalReader(journalReader *reader, const std::string &path);
+// to the start of the block that holds the first record at or after 
+// time, the records before time in it are still read
+void seekJournal(journalReader *reader, double time);
+// the next packet record, false at the end
+bool readJournal(journalReader *reader, journalRecord *record);
+void closeJournalReader(journalReader *reader);
+
+#endif // JOURNAL_H
@@ -0,0 +1,1414 @@
+/*
+ * libefergy.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* The C interface of efergy.h over the decoder in decoder.cpp, with the
+ * aggregation that used to live in the program, the address filter, 
+ * the per meter stats, the energy total and the maximum power for the 
+ * logging interval. The aggregation may be shared between decoders 
+ * running on different threads, so it has its own lock.
+ * 
+ * The combiner sits in front of the aggregation when receivers overlap.
+ */
+
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <vector>
+
+#include <pthread.h>
+
+#include "decoder.h"
+#include "formats.h"
+#include "efergy.h"
+
+// packets waiting for a poll before we start dropping them
+#define MAX_QUEUED_PACKETS (1024)
+// meters given stats, the slots are allocated with the aggregator so a
+// new meter doesn't allocate on a decoding thread. A false checksum 
+// makes a meter too, a few a day from a noisy input
+#define MAX_METERS (1024)
+// copies further apart than this are different transmissions
+#define MAX_COMBINE_DISTANCE (12)
+// most differing bits tried in the quality weighted search, and weak 
+// bits in a repair, it tries 2^n combinations and each is a 1 in 256
+// chance of a false checksum
+#define MAX_WEIGHTED_BITS (4)
+
+// the config fields of API 12, the first with sizes, a caller's config
+// must hold them all and any added since are left at their defaults
+#define MIN_CONFIG_BYTES (offsetof(efergyConfig, format)+sizeof(int))
+
+// one/zero thresholds a failed packet is sliced at by the hypothesis 
+// engine, in samples from the config's, nearest first
+static const int hypothesisOffsets[]={-1, 1, -2, 2, -3, 3};
+
+struct efergyAggregator
+{
+    efergyConfig config;        // voltage and address filter
+    pthread_mutex_t lock;
+
+    // addresses accepted when config.filterAddress is set, they and
+    // the voltage may be changed while the decoders run
+    std::set<unsigned int> addresses;
+
+    // meters seen, in order of first packet, and their addresses in 
+    // order with the meter's slot, both reserved to MAX_METERS
+    std::vector<efergyMeterStats> meters;
+    std::vector<std::pair<unsigned int, size_t> > meterIndex;
+
+    // logging thread takes the interval maximum
+    double intervalMax;
+};
+
+// what efergyDecoderPushStream() has found the input to be
+enum streamFormat
+{
+    STREAM_UNKNOWN,
+    STREAM_SAMPLES,             // in the sample format, rtl_fm default
+    STREAM_PACKED,
+    STREAM_RUNS,
+    STREAM_WAV,                 // a wav header up to its samples
+    STREAM_IGNORED              // a header we can't use
+};
+
+struct efergyDecoder
+{
+    efergyConfig config;
+    decoderState state;
+    int pendingByte;            // low byte of a split sample, or -1
+    streamFormat format;
+    unsigned char header[sizeof(efergyPackedHeader)];
+    size_t headerFill;
+    size_t headerSkip;          // header bytes beyond the ones we know
+    unsigned char word[8];      // part of a packed word
+    size_t wordFill;
+    unsigned long long packedLeft;  // samples still to come
+    unsigned long long runValue;    // varint of a run being read
+    int runShift;
+    bool runsEnded;                 // had the end marker
+    int sampleFormat;               // of the samples, EFERGY_FORMAT_
+    signKernel kernel;              // picked for it
+    int sampleBytes;
+    int frameBytes;                 // all the channels of a sample
+    unsigned char frame[MAX_FRAME_BYTES];   // part of a frame
+    int frameFill;
+    std::vector<unsigned char> wavHeader;   // up to the data chunk
+    unsigned long long dataLeft;    // bytes of the wav data chunk
+    unsigned char packet[LENGTH_PROTOCOL_BYTES];
+    // a ring allocated with the decoder, so decoding never allocates
+    efergyPacket queue[MAX_QUEUED_PACKETS];
+    size_t queueHead;
+    size_t queueCount;
+    efergyCounts counts;
+    int engine;                 // EFERGY_ENGINE_, the gate is in config
+    efergyAggregator *aggregator;
+    bool ownAggregator;         // created with the decoder
+};
+
+static unsigned int addressKey(const unsigned char *address)
+{
+    return((address[0]<<16)|(address[1]<<8)|address[2]);
+}
+
+static long findMeter(const efergyAggregator *aggregator, unsigned int key)
+{
+    // the meter's slot, or -1, called with the aggregator locked
+    std::vector<std::pair<unsigned int, size_t> >::const_iterator found;
+    found=std::lower_bound(aggregator->meterIndex.begin(), 
+                aggregator->meterIndex.end(), std::make_pair(key, 
+                static_cast<size_t>(0)));
+    if(found==aggregator->meterIndex.end() || found->first!=key)
+    {
+        return(-1);
+    }
+    return(static_cast<long>(found->second));
+}
+
+static void updateMeter(efergyAggregator *aggregator, efergyPacket *packet,
+            double power)
+{
+    // energy is counted in transmit periods since the meter's last 
+    // packet, so a missed packet is filled with the latest power
+    // called with the aggregator locked
+    unsigned int key=addressKey(packet->bytes);
+    long slot=findMeter(aggregator, key);
+    if(slot<0)
+    {
+        if(aggregator->meters.size()>=MAX_METERS)
+        {
+            // no slot left, the packet has no total
+            packet->energy=0;
+            packet->periods=0;
+            return;
+        }
+        // within the reserve, so neither allocates
+        efergyMeterStats stats;
+        memset(&stats, 0, sizeof(stats));
+        memcpy(stats.address, packet->bytes, EFERGY_ADDRESS_BYTES);
+        slot=static_cast<long>(aggregator->meters.size());
+        std::pair<unsigned int, size_t> entry(key, slot);
+        aggregator->meterIndex.insert(std::lower_bound(
+                    aggregator->meterIndex.begin(), 
+                    aggregator->meterIndex.end(), entry), entry);
+        aggregator->meters.push_back(stats);
+    }
+    efergyMeterStats *stats=&aggregator->meters[slot];
+
+    // a meter's first packet covers nothing before it, and a packet 
+    // from a clock behind the last one, another input's or the audited
+    // one taking over, covers nothing either
+    double seconds=packet->time-stats->lastTime;
+    double periods=0;
+    if(stats->packets>0 && seconds>0)
+    {
+        periods=floor((seconds+TRANSMIT_PERIOD/2)/TRANSMIT_PERIOD);
+    }
+
+    // totaling in kw/hr
+    stats->energy+=(power/(3600.0*1000.0/TRANSMIT_PERIOD))*periods;
+    stats->lastPeriods=periods;
+    stats->lastSample=packet->start;
+    stats->lastTime=packet->time;
+    stats->lastSource=packet->source;
+    stats->lastPower=power;
+    if(power>stats->maxPower)
+    {
+        stats->maxPower=power;
+    }
+    stats->packets++;
+
+    // the packet carries the running total so a consumer on another
+    // thread doesn't need to ask for the meter stats
+    packet->energy=stats->energy;
+    packet->periods=periods;
+}
+
+static void aggregatePacket(efergyAggregator *aggregator, 
+            efergyPacket *packet)
+{
+    // filter and aggregate a packet that passed its checksum
+    // the voltage and filter are read under the lock, so a change 
+    // between packets applies from the next whole packet
+    pthread_mutex_lock(&aggregator->lock);
+    double power=getPower(&packet->bytes[LENGTH_PROTOCOL_BYTES-4], 
+                    aggregator->config.voltage);
+    updateMeter(aggregator, packet, power);
+
+    if(!aggregator->config.filterAddress || 
+        aggregator->addresses.count(addressKey(packet->bytes)))
+    {
+        packet->accepted=1;
+        packet->power=power;
+
+        // we record the maximum power in the logging interval
+        if(power>aggregator->intervalMax)
+        {
+            aggregator->intervalMax=power;
+        }
+    }
+    pthread_mutex_unlock(&aggregator->lock);
+}
+
+static bool knownMeter(efergyAggregator *aggregator, 
+            const unsigned char *address)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    bool known=(findMeter(aggregator, addressKey(address))>=0);
+    pthread_mutex_unlock(&aggregator->lock);
+    return(known);
+}
+
+static bool flipSearch(efergyAggregator *aggregator, unsigned long long word,
+            const unsigned long long *bits, int count, unsigned char *bytes)
+{
+    // try the bits of word flipped, taking the fewest changes first. 
+    // Only accepted for a meter we have already heard, to hold down 
+    // false checksums. The packets are words so a trial is an xor and 
+    // the checksum a few word operations. bytes is only changed if a
+    // trial is accepted.
+    for(int changes=1; changes<=count; changes++)
+    {
+        for(unsigned int flips=1; flips<(1u<<count); flips++)
+        {
+            if(__builtin_popcount(flips)!=changes)
+                continue;
+            unsigned long long trial=word;
+            for(int d=0; d<count; d++)
+            {
+                if(flips&(1u<<d))
+                    trial^=bits[d];
+            }
+            if(!checksumWord(trial))
+                continue;
+            unsigned char trialBytes[EFERGY_PACKET_BYTES];
+            wordBytes(trial, trialBytes);
+            if(knownMeter(aggregator, trialBytes))
+            {
+                memcpy(bytes, trialBytes, EFERGY_PACKET_BYTES);
+                return(true);
+            }
+        }
+    }
+    return(false);
+}
+
+static bool slicePacket(efergyDecoder *decoder, unsigned char *bytes)
+{
+    // the edges don't depend on the one/zero threshold, so the pulses
+    // of a failed packet sliced at another threshold are another decode
+    // of the same bits, taken if it passes for a meter we have heard
+    const decoderState *state=&decoder->state;
+    const int hypotheses=sizeof(hypothesisOffsets)/
+                sizeof(hypothesisOffsets[0]);
+    for(int h=0; h<hypotheses; h++)
+    {
+        int threshold=state->config.oneWidth+hypothesisOffsets[h];
+        unsigned long long word=0;
+        for(int bit=0; bit<EFERGY_PACKET_BYTES*8; bit++)
+        {
+            word=(word<<1)|(state->widths[bit]>threshold);
+        }
+        if(word==state->packetBits || !checksumWord(word))
+            continue;
+        unsigned char trialBytes[EFERGY_PACKET_BYTES];
+        wordBytes(word, trialBytes);
+        if(knownMeter(decoder->aggregator, trialBytes))
+        {
+            memcpy(bytes, trialBytes, EFERGY_PACKET_BYTES);
+            return(true);
+        }
+    }
+    return(false);
+}
+
+static bool repairPacket(efergyDecoder *decoder, unsigned char *bytes)
+{
+    // the bits whose pulses came nearest the threshold are the likely 
+    // errors, the weakest few are flipped, the weakest first
+    const decoderState *state=&decoder->state;
+    int margins[MAX_WEIGHTED_BITS];
+    unsigned long long weakest[MAX_WEIGHTED_BITS];
+    int count=0;
+    for(int bit=0; bit<EFERGY_PACKET_BYTES*8; bit++)
+    {
+        // as decodeSample() has it, a zero is a sample clear of a one
+        int margin=state->widths[bit]-state->config.oneWidth;
+        if(margin<=0)
+            margin=1-margin;
+        if(count==MAX_WEIGHTED_BITS && margin>=margins[count-1])
+            continue;
+        int at=(count<MAX_WEIGHTED_BITS)?count++:count-1;
+        while(at>0 && margins[at-1]>margin)
+        {
+            margins[at]=margins[at-1];
+            weakest[at]=weakest[at-1];
+            at--;
+        }
+        margins[at]=margin;
+        // the first bit sent is at the top of the word
+        weakest[at]=1ULL<<(EFERGY_PACKET_BYTES*8-1-bit);
+    }
+    return(flipSearch(decoder->aggregator, state->packetBits, weakest, 
+                count, bytes));
+}
+
+static void processPacket(efergyDecoder *decoder)
+{
+    efergyPacket packet;
+    packet.size=sizeof(packet);
+    memcpy(packet.bytes, decoder->packet, EFERGY_PACKET_BYTES);
+    packet.start=decoder->state.packetStart;
+    packet.end=decoder->state.packetEnd;
+    packet.time=packet.start/decoder->config.sampleRate;
+    packet.source=decoder->config.source;
+    packet.quality=decoder->state.packetQuality;
+    // summed by the decoder as the bytes came in
+    packet.checksumOk=decoder->state.packetChecksum;
+    packet.accepted=0;
+    packet.power=0.0;
+    packet.energy=0.0;
+    packet.periods=0.0;
+    decoder->counts.total++;
+
+    if(!packet.checksumOk && decoder->engine>=EFERGY_ENGINE_HYPOTHESIS && 
+        decoder->aggregator)
+    {
+        if(slicePacket(decoder, packet.bytes))
+        {
+            decoder->counts.resliced++;
+            packet.checksumOk=1;
+        }
+        else if(decoder->engine>=EFERGY_ENGINE_REPAIR && 
+                repairPacket(decoder, packet.bytes))
+        {
+            decoder->counts.repaired++;
+            packet.checksumOk=1;
+        }
+    }
+
+    if(packet.checksumOk)
+    {
+        decoder->counts.passed++;
+        if(decoder->aggregator)
+        {
+            aggregatePacket(decoder->aggregator, &packet);
+        }
+        if(packet.accepted)
+        {
+            decoder->counts.accepted++;
+        }
+    }
+
+    if(decoder->queueCount>=MAX_QUEUED_PACKETS)
+    {
+        decoder->queueHead=(decoder->queueHead+1)%MAX_QUEUED_PACKETS;
+        decoder->queueCount--;
+        decoder->counts.dropped++;
+    }
+    decoder->queue[(decoder->queueHead+decoder->queueCount)%
+                MAX_QUEUED_PACKETS]=packet;
+    decoder->queueCount++;
+}
+
+// the public structures start with their size, a caller built with an
+// older header knows fewer of the fields and only those are filled
+template<typename T> 
+static void fillSized(T *caller, const T &full)
+{
+    size_t bytes=std::min(caller->size, sizeof(T));
+    if(bytes>sizeof(size_t))
+    {
+        memcpy(reinterpret_cast<char *>(caller)+sizeof(size_t), 
+            reinterpret_cast<const char *>(&full)+sizeof(size_t), 
+            bytes-sizeof(size_t));
+    }
+}
+
+// and read, over a full one already holding the rest
+template<typename T> 
+static void readSized(T *full, const T *caller)
+{
+    size_t bytes=std::min(caller->size, sizeof(T));
+    if(bytes>sizeof(size_t))
+    {
+        memcpy(reinterpret_cast<char *>(full)+sizeof(size_t), 
+            reinterpret_cast<const char *>(caller)+sizeof(size_t), 
+            bytes-sizeof(size_t));
+    }
+    full->size=sizeof(T);
+}
+
+static void defaultConfig(efergyConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->size=sizeof(*config);
+    config->syncWidth=defaultDecoderConfig.syncWidth;
+    config->oneWidth=defaultDecoderConfig.oneWidth;
+    config->voltage=DEFAULT_VOLTAGE;
+    config->sampleRate=DEFAULT_SAMPLE_RATE;
+    config->filterAddress=0;
+    config->source=0;
+    config->gate=1;
+    config->format=EFERGY_FORMAT_S16LE;
+}
+
+// false for a config too short to be one, eg its size never set
+static bool readConfig(efergyConfig *full, const efergyConfig *config)
+{
+    if(!config || config->size<MIN_CONFIG_BYTES)
+    {
+        return(false);
+    }
+    defaultConfig(full);
+    readSized(full, config);
+    return(true);
+}
+
+int efergyVersion(void)
+{
+    return(EFERGY_API_VERSION);
+}
+
+void efergyDefaultConfig(efergyConfig *config)
+{
+    efergyConfig full;
+    defaultConfig(&full);
+    fillSized(config, full);
+}
+
+efergyAggregator *efergyAggregatorCreate(const efergyConfig *config)
+{
+    efergyConfig full;
+    if(!readConfig(&full, config))
+    {
+        return(0);
+    }
+    efergyAggregator *aggregator=new efergyAggregator;
+    aggregator->config=full;
+    // a decoding thread may be real time, one waiting on the lock lends
+    // its priority to the thread holding it
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&aggregator->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    aggregator->meters.reserve(MAX_METERS);
+    aggregator->meterIndex.reserve(MAX_METERS);
+    if(full.filterAddress)
+    {
+        aggregator->addresses.insert(addressKey(full.address));
+    }
+    aggregator->intervalMax=0;
+    return(aggregator);
+}
+
+void efergyAggregatorDestroy(efergyAggregator *aggregator)
+{
+    if(aggregator)
+    {
+        pthread_mutex_destroy(&aggregator->lock);
+        delete aggregator;
+    }
+}
+
+double efergyAggregatorTakeIntervalMax(efergyAggregator *aggregator)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    double power=aggregator->intervalMax;
+    aggregator->intervalMax=0;
+    pthread_mutex_unlock(&aggregator->lock);
+    return(power);
+}
+
+void efergyAggregatorPush(efergyAggregator *aggregator, 
+            efergyPacket *packet)
+{
+    efergyPacket full;
+    memset(&full, 0, sizeof(full));
+    readSized(&full, packet);
+    full.accepted=0;
+    full.power=0.0;
+    full.energy=0.0;
+    full.periods=0.0;
+    if(full.checksumOk)
+    {
+        aggregatePacket(aggregator, &full);
+    }
+    fillSized(packet, full);
+}
+
+int efergyAggregatorAddAddress(efergyAggregator *aggregator, 
+            const unsigned char *address)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    bool added=aggregator->addresses.insert(addressKey(address)).second;
+    aggregator->config.filterAddress=1;
+    pthread_mutex_unlock(&aggregator->lock);
+    return(added?1:0);
+}
+
+int efergyAggregatorRemoveAddress(efergyAggregator *aggregator, 
+            const unsigned char *address)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    size_t removed=aggregator->addresses.erase(addressKey(address));
+    pthread_mutex_unlock(&aggregator->lock);
+    return(removed?1:0);
+}
+
+void efergyAggregatorAcceptAll(efergyAggregator *aggregator)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    aggregator->addresses.clear();
+    aggregator->config.filterAddress=0;
+    pthread_mutex_unlock(&aggregator->lock);
+}
+
+int efergyAggregatorAddresses(efergyAggregator *aggregator, 
+            unsigned char (*addresses)[EFERGY_ADDRESS_BYTES], int max)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    int count=-1;
+    if(aggregator->config.filterAddress)
+    {
+        count=static_cast<int>(aggregator->addresses.size());
+        int a=0;
+        std::set<unsigned int>::const_iterator key;
+        for(key=aggregator->addresses.begin(); 
+            key!=aggregator->addresses.end() && a<max; key++, a++)
+        {
+            addresses[a][0]=(*key>>16)&0xff;
+            addresses[a][1]=(*key>>8)&0xff;
+            addresses[a][2]=*key&0xff;
+        }
+    }
+    pthread_mutex_unlock(&aggregator->lock);
+    return(count);
+}
+
+void efergyAggregatorSetVoltage(efergyAggregator *aggregator, 
+            double voltage)
+{
+    pthread_mutex_lock(&aggregator->lock);
+    aggregator->config.voltage=voltage;
+    pthread_mutex_unlock(&aggregator->lock);
+}
+
+static void setSampleFormat(efergyDecoder *decoder, int format, 
+            int frameBytes)
+{
+    // picked once here rather than on every push
+    decoder->sampleFormat=format;
+    decoder->kernel=selectSignKernel(format);
+    decoder->sampleBytes=formatBytes(format);
+    decoder->frameBytes=frameBytes;
+    decoder->frameFill=0;
+}
+
+efergyDecoder *efergyDecoderCreateShared(const efergyConfig *config, 
+            efergyAggregator *aggregator)
+{
+    efergyConfig full;
+    if(!readConfig(&full, config) || full.syncWidth<=0 || 
+        full.oneWidth<=0 || full.sampleRate<=0 ||
+        formatBytes(full.format)==0)
+    {
+        return(0);
+    }
+    efergyDecoder *decoder=new efergyDecoder;
+    decoder->config=full;
+    decoderConfig thresholds={full.syncWidth, full.oneWidth};
+    initDecoder(&decoder->state, thresholds);
+    decoder->pendingByte=-1;
+    decoder->format=STREAM_UNKNOWN;
+    decoder->headerFill=0;
+    decoder->headerSkip=0;
+    decoder->wordFill=0;
+    decoder->packedLeft=ULLONG_MAX;
+    decoder->runValue=0;
+    decoder->runShift=0;
+    decoder->runsEnded=false;
+    setSampleFormat(decoder, full.format, formatBytes(full.format));
+    decoder->dataLeft=ULLONG_MAX;
+    decoder->queueHead=0;
+    decoder->queueCount=0;
+    memset(&decoder->counts, 0, sizeof(decoder->counts));
+    decoder->engine=full.gate?EFERGY_ENGINE_GATED:EFERGY_ENGINE_FULL;
+    decoder->aggregator=aggregator;
+    decoder->ownAggregator=false;
+    return(decoder);
+}
+
+efergyDecoder *efergyDecoderCreate(const efergyConfig *config)
+{
+    efergyAggregator *aggregator=efergyAggregatorCreate(config);
+    efergyDecoder *decoder=efergyDecoderCreateShared(config, aggregator);
+    if(!decoder)
+    {
+        efergyAggregatorDestroy(aggregator);
+        return(0);
+    }
+    decoder->ownAggregator=true;
+    return(decoder);
+}
+
+void efergyDecoderDestroy(efergyDecoder *decoder)
+{
+    if(decoder)
+    {
+        if(decoder->ownAggregator)
+        {
+            efergyAggregatorDestroy(decoder->aggregator);
+        }
+        delete decoder;
+    }
+}
+
+void efergyDecoderPush(efergyDecoder *decoder, const short *samples, 
+            size_t count)
+{
+    decoder->counts.samples+=count;
+    for(size_t i=0; i<count; i++)
+    {
+        if(decoder->config.gate && !decoder->state.sync)
+        {
+            size_t skipped=scanForSync(&decoder->state, &samples[i], 
+                                count-i);
+            decoder->counts.scanned+=skipped;
+            i+=skipped;
+            if(i>=count)
+                break;
+        }
+        if(decodeSample(&decoder->state, samples[i], decoder->packet, 
+                    LENGTH_PROTOCOL_BYTES))
+        {
+            processPacket(decoder);
+        }
+    }
+}
+
+void efergyDecoderPushBytes(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count)
+{
+    size_t i=0;
+    if(count>0 && decoder->pendingByte>=0)
+    {
+        // finish the sample split over the last push
+        short sample=static_cast<short>(decoder->pendingByte|(bytes[0]<<8));
+        decoder->pendingByte=-1;
+        decoder->counts.samples++;
+        i=1;
+        if(decodeSample(&decoder->state, sample, decoder->packet, 
+                    LENGTH_PROTOCOL_BYTES))
+        {
+            processPacket(decoder);
+        }
+    }
+    decoder->counts.samples+=(count-i)/2;
+    for(; i+1<count; i+=2)
+    {
+        if(decoder->config.gate && !decoder->state.sync)
+        {
+            // straight from the bytes, no samples are made while skipping
+            size_t skipped=scanForSync(&decoder->state, &bytes[i], 
+                                (count-i)/2);
+            decoder->counts.scanned+=skipped;
+            i+=2*skipped;
+            if(i+1>=count)
+                break;
+        }
+        short sample=static_cast<short>(bytes[i]|(bytes[i+1]<<8));
+        if(decodeSample(&decoder->state, sample, decoder->packet, 
+                    LENGTH_PROTOCOL_BYTES))
+        {
+            processPacket(decoder);
+        }
+    }
+    if(i<count)
+    {
+        decoder->pendingByte=bytes[i];
+    }
+}
+
+static void decodeWidth(efergyDecoder *decoder, bool high, 
+            unsigned long long width)
+{
+    while(width>0)
+    {
+        bool gotPacket;
+        width-=decodeRun(&decoder->state, high, width, decoder->packet,
+                    LENGTH_PROTOCOL_BYTES, &gotPacket);
+        if(gotPacket)
+        {
+            processPacket(decoder);
+        }
+    }
+}
+
+static void decodeWord(efergyDecoder *decoder, unsigned long long word, 
+            int samples)
+{
+    // split the word into runs at its edges, a run is found with one 
+    // count of the trailing zeros rather than a test per sample
+    int at=0;
+    while(at<samples)
+    {
+        bool high=(word>>at)&1;
+        unsigned long long changes=(high?~word:word)>>at;
+        int end=changes?at+__builtin_ctzll(changes):64;
+        if(end>samples)
+            end=samples;
+        decodeWidth(decoder, high, end-at);
+        at=end;
+    }
+}
+
+void efergyDecoderPushBits(efergyDecoder *decoder, 
+            const unsigned long long *words, size_t samples)
+{
+    decoder->counts.samples+=samples;
+    for(size_t w=0; samples>0; w++)
+    {
+        int bits=(samples<64)?static_cast<int>(samples):64;
+        decodeWord(decoder, words[w], bits);
+        samples-=bits;
+    }
+}
+
+static unsigned long long littleEndianWord(const unsigned char *bytes)
+{
+    unsigned long long word=0;
+    for(int b=7; b>=0; b--)
+    {
+        word=(word<<8)|bytes[b];
+    }
+    return(word);
+}
+
+static void pushPacked(efergyDecoder *decoder, const unsigned char *bytes, 
+            size_t count)
+{
+    // the words after the header, in whole words where the push allows
+    while(count>0 && decoder->packedLeft>0)
+    {
+        unsigned long long words[64];
+        size_t whole=0;
+        if(decoder->wordFill==0)
+        {
+            whole=count/8;
+            if(whole>sizeof(words)/sizeof(words[0]))
+                whole=sizeof(words)/sizeof(words[0]);
+            for(size_t w=0; w<whole; w++)
+            {
+                words[w]=littleEndianWord(&bytes[8*w]);
+            }
+            bytes+=whole*8;
+            count-=whole*8;
+        }
+        else
+        {
+            size_t take=8-decoder->wordFill;
+            if(take>count)
+                take=count;
+            memcpy(&decoder->word[decoder->wordFill], bytes, take);
+            decoder->wordFill+=take;
+            bytes+=take;
+            count-=take;
+            if(decoder->wordFill<8)
+            {
+                break;
+            }
+            words[0]=littleEndianWord(decoder->word);
+            decoder->wordFill=0;
+            whole=1;
+        }
+        if(whole==0)
+        {
+            // keep the end for the next push
+            memcpy(decoder->word, bytes, count);
+            decoder->wordFill=count;
+            break;
+        }
+        unsigned long long samples=64ULL*whole;
+        if(samples>decoder->packedLeft)
+            samples=decoder->packedLeft;
+        if(decoder->packedLeft!=ULLONG_MAX)
+            decoder->packedLeft-=samples;
+        efergyDecoderPushBits(decoder, words, samples);
+    }
+}
+
+void efergyDecoderPushRuns(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count)
+{
+    for(size_t i=0; i<count && !decoder->runsEnded; i++)
+    {
+        // seven bits at a time, low first, the top bit set on all but 
+        // the last byte
+        decoder->runValue|=
+            static_cast<unsigned long long>(bytes[i]&0x7f)<<decoder->runShift;
+        decoder->runShift+=7;
+        if((bytes[i]&0x80) && decoder->runShift<64)
+        {
+            continue;
+        }
+        unsigned long long value=decoder->runValue;
+        decoder->runValue=0;
+        decoder->runShift=0;
+        if(value==0)
+        {
+            // the index follows
+            decoder->runsEnded=true;
+            break;
+        }
+        unsigned long long width=value>>1;
+        decoder->counts.samples+=width;
+        decodeWidth(decoder, value&1, width);
+    }
+}
+
+static void startPacked(efergyDecoder *decoder)
+{
+    efergyPackedHeader header;
+    memcpy(&header, decoder->header, sizeof(header));
+    if(header.sampleRate>0)
+    {
+        decoder->config.sampleRate=header.sampleRate;
+    }
+    if(header.samples>0)
+    {
+        decoder->packedLeft=header.samples;
+    }
+    if(header.headerBytes>sizeof(header))
+    {
+        decoder->headerSkip=header.headerBytes-sizeof(header);
+    }
+}
+
+static void pushConverted(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count)
+{
+    // samples to sign bits a block at a time, then decoded as a packed
+    // capture is, only the first channel of a frame is used
+    unsigned long long words[64];
+    const size_t blockFrames=64*sizeof(words)/sizeof(words[0]);
+    const size_t frameBytes=decoder->frameBytes;
+    while(count>0 && decoder->frameFill>0)
+    {
+        // finish the frame split over the last push
+        decoder->frame[decoder->frameFill++]=*bytes++;
+        count--;
+        if(static_cast<size_t>(decoder->frameFill)==frameBytes)
+        {
+            words[0]=sampleHigh(decoder->sampleFormat, decoder->frame);
+            efergyDecoderPushBits(decoder, words, 1);
+            decoder->frameFill=0;
+        }
+    }
+    if(decoder->frameFill>0)
+    {
+        return;
+    }
+    size_t frames=count/frameBytes;
+    while(frames>0)
+    {
+        size_t block=(frames<blockFrames)?frames:blockFrames;
+        if(frameBytes==static_cast<size_t>(decoder->sampleBytes))
+        {
+            decoder->kernel(bytes, block, words);
+        }
+        else
+        {
+            memset(words, 0, sizeof(words));
+            for(size_t f=0; f<block; f++)
+            {
+                unsigned long long high=
+                    sampleHigh(decoder->sampleFormat, &bytes[f*frameBytes]);
+                words[f/64]|=high<<(f%64);
+            }
+        }
+        efergyDecoderPushBits(decoder, words, block);
+        bytes+=block*frameBytes;
+        count-=block*frameBytes;
+        frames-=block;
+    }
+    memcpy(decoder->frame, bytes, count);
+    decoder->frameFill=count;
+}
+
+static void pushSamples(efergyDecoder *decoder, const unsigned char *bytes,
+            size_t count)
+{
+    if(count>decoder->dataLeft)
+    {
+        // a wav can have more chunks after the samples
+        decoder->counts.ignored+=count-decoder->dataLeft;
+        count=decoder->dataLeft;
+    }
+    if(decoder->dataLeft!=ULLONG_MAX)
+    {
+        decoder->dataLeft-=count;
+    }
+    if(decoder->sampleFormat==EFERGY_FORMAT_S16LE && 
+        decoder->frameBytes==2)
+    {
+        // rtl_fm, the gated decoder takes the bytes as they are
+        efergyDecoderPushBytes(decoder, bytes, count);
+    }
+    else
+    {
+        pushConverted(decoder, bytes, count);
+    }
+}
+
+static size_t parseWav(efergyDecoder *decoder)
+{
+    // returns the header bytes once the samples start, or 0 for more
+    const std::vector<unsigned char> &header=decoder->wavHeader;
+    wavInfo wav;
+    wavStatus status=readWavHeader(&header[0], header.size(), &wav);
+    if(status==WAV_MORE && header.size()<MAX_WAV_HEADER)
+    {
+        return(0);
+    }
+    if(status!=WAV_OK)
+    {
+        decoder->format=STREAM_IGNORED;
+        return(0);
+    }
+    setSampleFormat(decoder, wav.format, wav.frameBytes);
+    if(wav.sampleRate>0)
+        decoder->config.sampleRate=wav.sampleRate;
+    decoder->dataLeft=wav.dataBytes;
+    return(wav.dataOffset);
+}
+
+static void pushWav(efergyDecoder *decoder, const unsigned char *bytes, 
+            size_t count)
+{
+    // the header is short, keep it all until the samples start
+    decoder->wavHeader.insert(decoder->wavHeader.end(), bytes, bytes+count);
+    size_t start=parseWav(decoder);
+    if(decoder->format==STREAM_IGNORED)
+    {
+        decoder->counts.ignored+=decoder->wavHeader.size();
+        decoder->wavHeader.clear();
+        return;
+    }
+    if(start>0)
+    {
+        decoder->format=STREAM_SAMPLES;
+        std::vector<unsigned char> samples(
+                    decoder->wavHeader.begin()+start, 
+                    decoder->wavHeader.end());
+        decoder->wavHeader.clear();
+        if(samples.size()>0)
+            pushSamples(decoder, &samples[0], samples.size());
+    }
+}
+
+void efergyDecoderPushStream(efergyDecoder *decoder, 
+            const unsigned char *bytes, size_t count)
+{
+    const size_t magic=sizeof(EFERGY_PACKED_MAGIC)-1;
+    while(count>0 && decoder->format==STREAM_UNKNOWN)
+    {
+        // enough of the start to see what it is
+        decoder->header[decoder->headerFill++]=*bytes++;
+        count--;
+        if(decoder->headerFill==magic)
+        {
+            if(memcmp(decoder->header, EFERGY_PACKED_MAGIC, magic)==0)
+            {
+                decoder->format=STREAM_PACKED;
+            }
+            else if(memcmp(decoder->header, EFERGY_RUNS_MAGIC, magic)==0)
+            {
+                decoder->format=STREAM_RUNS;
+            }
+            else if(memcmp(decoder->header, "RIFF", magic)==0)
+            {
+                decoder->format=STREAM_WAV;
+                pushWav(decoder, decoder->header, magic);
+            }
+            else
+            {
+                decoder->format=STREAM_SAMPLES;
+                pushSamples(decoder, decoder->header, magic);
+            }
+        }
+    }
+    if(decoder->format==STREAM_SAMPLES)
+    {
+        pushSamples(decoder, bytes, count);
+        return;
+    }
+    if(decoder->format==STREAM_WAV)
+    {
+        pushWav(decoder, bytes, count);
+        return;
+    }
+    if(decoder->format==STREAM_IGNORED)
+    {
+        decoder->counts.ignored+=count;
+        return;
+    }
+    while(count>0 && decoder->headerFill<sizeof(decoder->header))
+    {
+        decoder->header[decoder->headerFill++]=*bytes++;
+        count--;
+        if(decoder->headerFill==sizeof(decoder->header))
+        {
+            startPacked(decoder);
+        }
+    }
+    while(count>0 && decoder->headerSkip>0)
+    {
+        bytes++;
+        count--;
+        decoder->headerSkip--;
+    }
+    if(decoder->format==STREAM_RUNS)
+    {
+        efergyDecoderPushRuns(decoder, bytes, count);
+    }
+    else
+    {
+        pushPacked(decoder, bytes, count);
+    }
+}
+
+int efergyDecoderPoll(efergyDecoder *decoder, efergyPacket *packet)
+{
+    if(decoder->queueCount==0)
+    {
+        return(0);
+    }
+    fillSized(packet, decoder->queue[decoder->queueHead]);
+    decoder->queueHead=(decoder->queueHead+1)%MAX_QUEUED_PACKETS;
+    decoder->queueCount--;
+    return(1);
+}
+
+void efergyDecoderStartAt(efergyDecoder *decoder, unsigned long long sample)
+{
+    // anything part decoded belonged to the samples before
+    resetDecoder(&decoder->state);
+    decoder->state.sampleCount=sample;
+    decoder->pendingByte=-1;
+    decoder->wordFill=0;
+    decoder->runValue=0;
+    decoder->runShift=0;
+    decoder->runsEnded=false;
+    decoder->frameFill=0;
+}
+
+int efergyDecoderSetEngine(efergyDecoder *decoder, int engine)
+{
+    if(engine<0 || engine>=EFERGY_ENGINE_COUNT)
+    {
+        return(0);
+    }
+    // the gate only skips samples away from a packet, so it can change
+    // at any push without losing one
+    decoder->engine=engine;
+    decoder->config.gate=(engine==EFERGY_ENGINE_GATED);
+    return(1);
+}
+
+int efergyDecoderEngine(const efergyDecoder *decoder)
+{
+    return(decoder->engine);
+}
+
+void efergyDecoderCounts(const efergyDecoder *decoder, 
+            efergyCounts *counts)
+{
+    efergyCounts full=decoder->counts;
+    full.truncated=decoder->state.truncated;
+    fillSized(counts, full);
+}
+
+int efergyDecoderMeterCount(const efergyDecoder *decoder)
+{
+    efergyAggregator *aggregator=decoder->aggregator;
+    if(!aggregator)
+    {
+        return(0);
+    }
+    pthread_mutex_lock(&aggregator->lock);
+    int count=static_cast<int>(aggregator->meters.size());
+    pthread_mutex_unlock(&aggregator->lock);
+    return(count);
+}
+
+int efergyDecoderMeterStats(const efergyDecoder *decoder, int index, 
+            efergyMeterStats *stats)
+{
+    efergyAggregator *aggregator=decoder->aggregator;
+    int found=0;
+    if(!aggregator)
+    {
+        return(0);
+    }
+    pthread_mutex_lock(&aggregator->lock);
+    if(index>=0 && index<static_cast<int>(aggregator->meters.size()))
+    {
+        fillSized(stats, aggregator->meters[index]);
+        found=1;
+    }
+    pthread_mutex_unlock(&aggregator->lock);
+    return(found);
+}
+
+int efergyDecoderFindMeter(const efergyDecoder *decoder, 
+            const unsigned char *address, efergyMeterStats *stats)
+{
+    efergyAggregator *aggregator=decoder->aggregator;
+    int found=0;
+    if(!aggregator)
+    {
+        return(0);
+    }
+    pthread_mutex_lock(&aggregator->lock);
+    long slot=findMeter(aggregator, addressKey(address));
+    if(slot>=0)
+    {
+        fillSized(stats, aggregator->meters[slot]);
+        found=1;
+    }
+    pthread_mutex_unlock(&aggregator->lock);
+    return(found);
+}
+
+double efergyDecoderTakeIntervalMax(efergyDecoder *decoder)
+{
+    if(!decoder->aggregator)
+    {
+        return(0.0);
+    }
+    return(efergyAggregatorTakeIntervalMax(decoder->aggregator));
+}
+
+// Combining
+// =========
+// Copies of one transmission from several receivers are grouped by
+// arrival time and closeness of their bits. When the window closes the
+// group gives one packet, the best good copy, or a repair of the bad
+// copies, or failing that the best bad copy so debug still sees it.
+
+struct combineGroup
+{
+    double first;                   // arrival of the first copy
+    std::vector<efergyPacket> copies;
+};
+
+struct efergyCombiner
+{
+    double window;
+    efergyAggregator *aggregator;
+    std::deque<combineGroup> groups;   // open, in arrival order
+    efergyCombineCounts counts;
+};
+
+static int bitDistance(const unsigned char *a, const unsigned char *b)
+{
+    return(__builtin_popcountll(packetWord(a)^packetWord(b)));
+}
+
+static bool majorityVote(const combineGroup &group, efergyPacket *packet)
+{
+    // each bit is the one most copies agree on, ties go to the copy 
+    // with the best quality which is in packet already
+    // packet is only changed if the vote passes the checksum
+    unsigned char vote[EFERGY_PACKET_BYTES];
+    memcpy(vote, packet->bytes, EFERGY_PACKET_BYTES);
+    for(int bit=0; bit<EFERGY_PACKET_BYTES*8; bit++)
+    {
+        int byte=bit/8;
+        unsigned char mask=0x80>>(bit%8);
+        int ones=0;
+        for(size_t c=0; c<group.copies.size(); c++)
+        {
+            if(group.copies[c].bytes[byte]&mask)
+                ones++;
+        }
+        int zeros=group.copies.size()-ones;
+        if(ones>zeros)
+            vote[byte]|=mask;
+        else if(zeros>ones)
+            vote[byte]&=~mask;
+    }
+    if(!checksum(vote, EFERGY_PACKET_BYTES))
+    {
+        return(false);
+    }
+    memcpy(packet->bytes, vote, EFERGY_PACKET_BYTES);
+    return(true);
+}
+
+static bool weightedSearch(efergyAggregator *aggregator, 
+            const combineGroup &group, efergyPacket *packet)
+{
+    // start from the best copy, packet, and try the bits where the
+    // copies disagree
+    unsigned long long word=packetWord(packet->bytes);
+    unsigned long long differs=0;
+    for(size_t c=0; c<group.copies.size(); c++)
+    {
+        differs|=packetWord(group.copies[c].bytes)^word;
+    }
+    if(__builtin_popcountll(differs)>MAX_WEIGHTED_BITS)
+    {
+        return(false);
+    }
+    unsigned long long differing[MAX_WEIGHTED_BITS];
+    int count=0;
+    for(int bit=EFERGY_PACKET_BYTES*8-1; bit>=0; bit--)
+    {
+        // in the order the bits were sent
+        if((differs>>bit)&1)
+            differing[count++]=1ULL<<bit;
+    }
+    return(flipSearch(aggregator, word, differing, count, packet->bytes));
+}
+
+static void closeGroup(efergyCombiner *combiner, const combineGroup &group,
+            efergyPacket *packet)
+{
+    // best copy, good ones before bad, then by quality
+    size_t best=0;
+    int goodCopies=0;
+    for(size_t c=0; c<group.copies.size(); c++)
+    {
+        const efergyPacket &copy=group.copies[c];
+        if(copy.checksumOk)
+        {
+            goodCopies++;
+            // the source is the caller's, only inputs counted for
+            if(copy.source>=0 && copy.source<EFERGY_MAX_SOURCES)
+                combiner->counts.sourceGood[copy.source]++;
+        }
+        const efergyPacket &current=group.copies[best];
+        if((copy.checksumOk && !current.checksumOk) ||
+           (copy.checksumOk==current.checksumOk && 
+            copy.quality>current.quality))
+        {
+            best=c;
+        }
+    }
+    *packet=group.copies[best];
+    packet->time=group.first;
+    combiner->counts.groups++;
+
+    if(goodCopies>0)
+    {
+        combiner->counts.duplicates+=goodCopies-1;
+    }
+    else if(group.copies.size()>=3 && majorityVote(group, packet))
+    {
+        combiner->counts.majority++;
+        packet->checksumOk=1;
+    }
+    else if(group.copies.size()>=2 && 
+            weightedSearch(combiner->aggregator, group, packet))
+    {
+        combiner->counts.weighted++;
+        packet->checksumOk=1;
+    }
+    else
+    {
+        // the best copy goes out as it was
+        combiner->counts.failed++;
+    }
+
+    if(packet->checksumOk)
+    {
+        combiner->counts.good++;
+        aggregatePacket(combiner->aggregator, packet);
+    }
+}
+
+efergyCombiner *efergyCombinerCreate(double window, 
+            efergyAggregator *aggregator)
+{
+    if(!aggregator || window<=0)
+    {
+        return(0);
+    }
+    efergyCombiner *combiner=new efergyCombiner;
+    combiner->window=window;
+    combiner->aggregator=aggregator;
+    memset(&combiner->counts, 0, sizeof(combiner->counts));
+    return(combiner);
+}
+
+void efergyCombinerDestroy(efergyCombiner *combiner)
+{
+    delete combiner;
+}
+
+void efergyCombinerPush(efergyCombiner *combiner, 
+            const efergyPacket *packet, double now)
+{
+    // join the open group this is a copy for, a source only gives one
+    // copy to a group so a repeat from it is a new transmission
+    combiner->counts.copies++;
+    efergyPacket copy;
+    memset(&copy, 0, sizeof(copy));
+    readSized(&copy, packet);
+    copy.accepted=0;
+    copy.power=0.0;
+    std::deque<combineGroup>::iterator group;
+    for(group=combiner->groups.begin(); group!=combiner->groups.end(); 
+            group++)
+    {
+        if(now-group->first>combiner->window)
+            continue;
+        bool sameSource=false;
+        for(size_t c=0; c<group->copies.size(); c++)
+        {
+            if(group->copies[c].source==copy.source)
+                sameSource=true;
+        }
+        if(!sameSource && bitDistance(group->copies[0].bytes, 
+                            copy.bytes)<=MAX_COMBINE_DISTANCE)
+        {
+            group->copies.push_back(copy);
+            return;
+        }
+    }
+    combineGroup fresh;
+    fresh.first=now;
+    fresh.copies.push_back(copy);
+    combiner->groups.push_back(fresh);
+}
+
+int efergyCombinerPoll(efergyCombiner *combiner, efergyPacket *packet, 
+            double now)
+{
+    if(combiner->groups.empty())
+    {
+        return(0);
+    }
+    const combineGroup &oldest=combiner->groups.front();
+    if(now>=0 && now-oldest.first<=combiner->window)
+    {
+        return(0);
+    }
+    efergyPacket full;
+    closeGroup(combiner, oldest, &full);
+    fillSized(packet, full);
+    combiner->groups.pop_front();
+    return(1);
+}
+
+int efergyCombinerPending(const efergyCombiner *combiner)
+{
+    return(static_cast<int>(combiner->groups.size()));
+}
+
+void efergyCombinerCounts(const efergyCombiner *combiner, 
+            efergyCombineCounts *counts)
+{
+    fillSized(counts, combiner->counts);
+}
+
+int efergyChecksum(const unsigned char *packet)
+{
+    return(checksumWord(packetWord(packet)));
+}
+
+int efergyCheckAddress(const unsigned char *packet, 
+            const unsigned char *address)
+{
+    return(checkAddress(packet, address, EFERGY_ADDRESS_BYTES));
+}
+
+double efergyPacketPower(const unsigned char *packet, double voltage)
+{
+    return(getPower(&packet[EFERGY_PACKET_BYTES-4], voltage));
+}
@@ -0,0 +1,162 @@
+/*
+ * packetindex.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+
+#include "formats.h"
+#include "packetindex.h"
+
+bool openPacketIndex(packetIndex *index, const std::string &path,
+            const std::string &sigmfPath, int format, double sampleRate)
+{
+    index->file=0;
+    index->sigmfPath=sigmfPath;
+    index->format=format;
+    index->sampleRate=sampleRate;
+    index->annotations.clear();
+    index->records=0;
+    if(path.size()==0)
+    {
+        return(true);
+    }
+
+    index->file=fopen(path.c_str(), "wb");
+    if(!index->file)
+    {
+        fprintf(stderr, "Failed, can't open packet index '%s', %s\n",
+                    path.c_str(), strerror(errno));
+        return(false);
+    }
+    packetIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKET_INDEX_MAGIC, sizeof(header.magic));
+    header.headerBytes=sizeof(header);
+    header.recordBytes=sizeof(packetIndexRecord);
+    header.sampleRate=sampleRate;
+    header.startTime=time(0);
+    fwrite(&header, 1, sizeof(header), index->file);
+    return(true);
+}
+
+void indexPacket(packetIndex *index, const efergyPacket *packet)
+{
+    packetIndexRecord record;
+    memset(&record, 0, sizeof(record));
+    record.start=packet->start;
+    record.end=packet->end;
+    memcpy(record.bytes, packet->bytes, EFERGY_PACKET_BYTES);
+    record.quality=packet->quality;
+    record.source=packet->source;
+    record.flags=(packet->checksumOk?PACKET_INDEX_CHECKSUM:0)|
+                 (packet->accepted?PACKET_INDEX_ACCEPTED:0);
+    index->records++;
+    if(index->file)
+    {
+        // a whole record at a time for anyone reading as it grows
+        fwrite(&record, 1, sizeof(record), index->file);
+        fflush(index->file);
+    }
+    if(index->sigmfPath.size()>0)
+    {
+        index->annotations.push_back(record);
+    }
+}
+
+static bool earlierRecord(const packetIndexRecord &a, 
+            const packetIndexRecord &b)
+{
+    return(a.start<b.start);
+}
+
+static bool writeAnnotations(packetIndex *index)
+{
+    // SigMF wants the annotations in sample order
+    std::stable_sort(index->annotations.begin(), index->annotations.end(),
+                earlierRecord);
+    FILE *meta=fopen(index->sigmfPath.c_str(), "w");
+    if(!meta)
+    {
+        fprintf(stderr, "Failed, can't write SigMF metadata '%s', %s\n",
+                    index->sigmfPath.c_str(), strerror(errno));
+        return(false);
+    }
+    fprintf(meta, "{\n");
+    fprintf(meta, "    \"global\": {\n");
+    fprintf(meta, "        \"core:datatype\": \"%s\",\n", 
+                formatSigmfName(index->format));
+    fprintf(meta, "        \"core:sample_rate\": %.0f,\n", index->sampleRate);
+    fprintf(meta, "        \"core:version\": \"1.0.0\",\n");
+    fprintf(meta, "        \"core:description\": \"efergy packets\",\n");
+    fprintf(meta, "        \"core:extensions\": [{\"name\": \"efergy\", "
+                "\"version\": \"1.0.0\", \"optional\": true}]\n");
+    fprintf(meta, "    },\n");
+    fprintf(meta, "    \"captures\": [{\"core:sample_start\": 0}],\n");
+    fprintf(meta, "    \"annotations\": [");
+    for(size_t a=0; a<index->annotations.size(); a++)
+    {
+        const packetIndexRecord &record=index->annotations[a];
+        fprintf(meta, "%s\n        {\"core:sample_start\": %llu, "
+                    "\"core:sample_count\": %llu, \"core:label\": \"",
+                    a?",":"", record.start, record.end-record.start+1);
+        for(int b=0; b<EFERGY_PACKET_BYTES; b++)
+        {
+            fprintf(meta, "%02x", record.bytes[b]);
+        }
+        fprintf(meta, "\", \"efergy:checksum\": %s, "
+                    "\"efergy:accepted\": %s, \"efergy:quality\": %.2f, "
+                    "\"efergy:source\": %d}",
+                    (record.flags&PACKET_INDEX_CHECKSUM)?"true":"false",
+                    (record.flags&PACKET_INDEX_ACCEPTED)?"true":"false",
+                    record.quality, record.source);
+    }
+    fprintf(meta, "\n    ]\n}\n");
+    bool ok=(ferror(meta)==0);
+    if(fclose(meta)!=0)
+        ok=false;
+    if(!ok)
+    {
+        fprintf(stderr, "Failed, writing SigMF metadata '%s'\n",
+                    index->sigmfPath.c_str());
+    }
+    return(ok);
+}
+
+bool closePacketIndex(packetIndex *index)
+{
+    bool ok=true;
+    if(index->file)
+    {
+        fclose(index->file);
+        index->file=0;
+    }
+    if(index->sigmfPath.size()>0)
+    {
+        ok=writeAnnotations(index);
+    }
+    index->annotations.clear();
+    return(ok);
+}
@@ -0,0 +1,89 @@
+/*
+ * packetindex.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Where each decoded packet was in its input, so a tool can go 
+ * straight to a burst in a capture rather than decoding all of it.
+ * 
+ * The index file is a packetIndexHeader then a packetIndexRecord for
+ * each packet in the order they were decoded, both in host order. It 
+ * is written as the packets come so it can be read while the decoder
+ * is still running. The same records can also be written as the 
+ * annotations of a SigMF metadata file, which pairs with a capture of
+ * the same name in the given sample format.
+ */
+
+#ifndef PACKETINDEX_H
+#define PACKETINDEX_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "efergy.h"
+
+#define PACKET_INDEX_MAGIC "EFX1"
+
+// flags of a record
+#define PACKET_INDEX_CHECKSUM (1)     // passed the checksum
+#define PACKET_INDEX_ACCEPTED (2)     // and the address filter
+
+struct packetIndexHeader
+{
+    char magic[4];              // PACKET_INDEX_MAGIC, no terminator
+    unsigned int headerBytes;   // records start here
+    unsigned int recordBytes;   // size of each record
+    unsigned int reserved;
+    double sampleRate;          // of the sample offsets
+    long long startTime;        // unix seconds the decoding started
+};
+
+struct packetIndexRecord
+{
+    unsigned long long start;   // sample offset of the start pulse
+    unsigned long long end;     // and of the last bit
+    unsigned char bytes[EFERGY_PACKET_BYTES];
+    float quality;              // mean pulse margin, in samples
+    signed char source;         // input it came from, -1 combined
+    unsigned char flags;        // PACKET_INDEX_ flags
+    unsigned char reserved[2];
+};
+
+struct packetIndex
+{
+    FILE *file;                 // 0 if no binary index
+    std::string sigmfPath;      // empty if no annotations
+    int format;                 // EFERGY_FORMAT_ of the capture
+    double sampleRate;
+    std::vector<packetIndexRecord> annotations;
+    unsigned long long records;
+};
+
+// either path may be empty, false with a message if a file can't be 
+// opened
+bool openPacketIndex(packetIndex *index, const std::string &path,
+            const std::string &sigmfPath, int format, double sampleRate);
+void indexPacket(packetIndex *index, const efergyPacket *packet);
+// writes the annotations, false with a message if they can't be
+bool closePacketIndex(packetIndex *index);
+
+#endif // PACKETINDEX_H
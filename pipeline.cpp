@@ -0,0 +1,599 @@
+/*
+ * pipeline.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <unistd.h>
+#include <sched.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "pipeline.h"
+
+const char *stageNames[STAGE_COUNT]=
+{
+    "ingest",
+    "decode",
+    "sink",
+    "log"
+};
+
+static double monotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec+now.tv_nsec/1e9);
+}
+
+static double threadCpuTime(pthread_t thread)
+{
+    clockid_t clock;
+    struct timespec used;
+    if(pthread_getcpuclockid(thread, &clock)!=0 || 
+        clock_gettime(clock, &used)!=0)
+    {
+        return(0.0);
+    }
+    return(used.tv_sec+used.tv_nsec/1e9);
+}
+
+void initPipeline(pipeline *pipe)
+{
+    pipe->sink=0;
+    pipe->sinkArg=0;
+    pipe->combiner=0;
+    pipe->exitNow=0;
+    for(int s=0; s<STAGE_COUNT; s++)
+    {
+        pipe->settings[s].cpu=-1;
+        pipe->settings[s].nice=0;
+        pipe->settings[s].priority=0;
+    }
+    memset(&pipe->sinkStats, 0, sizeof(pipe->sinkStats));
+    memset(&pipe->logStats, 0, sizeof(pipe->logStats));
+    pipe->sourceCount=0;
+}
+
+bool addSource(pipeline *pipe, const char *name, efergyDecoder *decoder)
+{
+    if(pipe->sourceCount>=MAX_SOURCES)
+    {
+        return(false);
+    }
+    pipelineSource *source=new pipelineSource;
+    source->pipe=pipe;
+    source->index=pipe->sourceCount;
+    snprintf(source->name, sizeof(source->name), "%s", name);
+    source->decoder=decoder;
+    source->capture=0;
+    memset(&source->ingestStats, 0, sizeof(source->ingestStats));
+    memset(&source->decodeStats, 0, sizeof(source->decodeStats));
+    source->byteRate=0;
+    source->maxLatency=0;
+    source->wakeups=0;
+    source->late=0;
+    source->maxLate=0;
+    initRateAudit(&source->audit, source->index, 0, 1);
+    initGovernor(&source->governor, source->index, decoder, 0, 
+                efergyDecoderEngine(decoder));
+    pthread_mutex_init(&source->snapshotLock, 0);
+    source->auditSnapshot=source->audit;
+    source->governorSnapshot=source->governor;
+    source->countsSnapshot.size=sizeof(source->countsSnapshot);
+    efergyDecoderCounts(decoder, &source->countsSnapshot);
+    pipe->sources[pipe->sourceCount++]=source;
+    return(true);
+}
+
+void freePipeline(pipeline *pipe)
+{
+    for(int s=0; s<pipe->sourceCount; s++)
+    {
+        pthread_mutex_destroy(&pipe->sources[s]->snapshotLock);
+        delete pipe->sources[s];
+    }
+    pipe->sourceCount=0;
+}
+
+void sourceSnapshot(pipelineSource *source, rateAudit *audit, 
+            engineGovernor *governor, efergyCounts *counts)
+{
+    pthread_mutex_lock(&source->snapshotLock);
+    *audit=source->auditSnapshot;
+    *governor=source->governorSnapshot;
+    *counts=source->countsSnapshot;
+    pthread_mutex_unlock(&source->snapshotLock);
+}
+
+bool parseStageSettings(const char *text, stageSettings *settings)
+{
+    // stage=cpu, stage=cpu:nice or stage=cpu:nice:priority, cpu of -1
+    // leaves it unpinned, a priority runs it SCHED_FIFO
+    char name[20]={0};
+    int cpu=-1;
+    int nice=0;
+    int priority=0;
+    int fields=sscanf(text, "%19[a-z]=%d:%d:%d", name, &cpu, &nice, 
+                &priority);
+    if(fields<2 || priority<0 || 
+        priority>sched_get_priority_max(SCHED_FIFO))
+    {
+        return(false);
+    }
+    for(int s=0; s<STAGE_COUNT; s++)
+    {
+        if(strcmp(name, stageNames[s])==0)
+        {
+            settings[s].cpu=cpu;
+            settings[s].nice=nice;
+            settings[s].priority=priority;
+            return(true);
+        }
+    }
+    return(false);
+}
+
+void applyStageSettings(pipeline *pipe, pipelineStage stage, 
+            stageStats *stats)
+{
+    // called on the stage's own thread as it starts
+    const stageSettings &settings=pipe->settings[stage];
+    stats->thread=pthread_self();
+    stats->running=true;
+    stats->startTime=monotonicTime();
+
+    if(settings.cpu>=0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(settings.cpu, &cpus);
+        int err=pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(err!=0)
+        {
+            fprintf(stderr, "Failed, can't pin %s stage to cpu %d, %s\n", 
+                        stageNames[stage], settings.cpu, strerror(err));
+        }
+    }
+    if(settings.nice!=0)
+    {
+        // nice is per thread on linux, by thread id
+        pid_t tid=static_cast<pid_t>(syscall(SYS_gettid));
+        if(setpriority(PRIO_PROCESS, tid, settings.nice)!=0)
+        {
+            fprintf(stderr, "Failed, can't set %s stage nice %d, %s\n", 
+                        stageNames[stage], settings.nice, strerror(errno));
+        }
+    }
+    if(settings.priority>0)
+    {
+        // needs CAP_SYS_NICE or an RLIMIT_RTPRIO, otherwise it runs on
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority=settings.priority;
+        int err=pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err!=0)
+        {
+            fprintf(stderr, "Failed, can't give %s stage real time "
+                        "priority %d, %s\n", stageNames[stage], 
+                        settings.priority, strerror(err));
+        }
+    }
+}
+
+bool startRealtime()
+{
+    // freed memory is kept rather than handed back and faulted in 
+    // again, big blocks come from the heap rather than fresh mappings
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    // every thread's stack is locked in, so not the 8MB default
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, REALTIME_STACK_SIZE);
+    pthread_setattr_default_np(&attr);
+    pthread_attr_destroy(&attr);
+
+    // what is mapped now and later stays in memory, later mappings are
+    // faulted in as they are made
+    if(mlockall(MCL_CURRENT | MCL_FUTURE)!=0)
+    {
+        fprintf(stderr, "Failed, can't lock the process in memory, %s\n", 
+                    strerror(errno));
+        return(false);
+    }
+    return(true);
+}
+
+void stageStopped(stageStats *stats)
+{
+    // called on the stage's own thread as it finishes
+    stats->cpuTime=threadCpuTime(pthread_self());
+    stats->stopTime=monotonicTime();
+    stats->running=false;
+}
+
+static void *ingestStage(void *arg)
+{
+    // read blocks from the input until it ends or we are told to stop
+    pipelineSource *source=static_cast<pipelineSource *>(arg);
+    pipeline *pipe=source->pipe;
+    stageStats *stats=&source->ingestStats;
+    applyStageSettings(pipe, STAGE_INGEST, stats);
+
+    // opened here as a fifo blocks until its writer turns up
+    FILE *input=stdin;
+    if(strcmp(source->name, "-")!=0)
+    {
+        input=fopen(source->name, "r");
+        if(!input)
+        {
+            fprintf(stderr, "Failed, can't open input '%s', %s\n", 
+                        source->name, strerror(errno));
+        }
+    }
+
+    bool more=true;
+    while(more)
+    {
+        sampleBlock *block=queueProducerSlot(&source->blocks, 
+                            &stats->waits);
+        block->count=0;
+        if(input && !*pipe->exitNow)
+        {
+            block->count=fread(block->bytes, 1, sizeof(block->bytes), 
+                            input);
+        }
+        block->ready=monotonicTime();
+        more=(block->count>0);
+        queueProducerCommit(&source->blocks);
+        stats->items++;
+    }
+
+    if(input && input!=stdin)
+    {
+        fclose(input);
+    }
+    stageStopped(stats);
+    return(NULL);
+}
+
+static void sendPacket(pipelineSource *source, const efergyPacket *packet, 
+            bool end)
+{
+    pipelinePacket *slot=queueProducerSlot(&source->packets, 
+                        &source->decodeStats.waits);
+    slot->end=end;
+    if(packet)
+    {
+        slot->packet=*packet;
+    }
+    queueProducerCommit(&source->packets);
+    sem_post(&source->pipe->packetsReady);
+}
+
+static void publishSnapshot(pipelineSource *source, bool wait)
+{
+    // skipped if a reader has the lock, the next block brings it up
+    // to date
+    if(wait)
+        pthread_mutex_lock(&source->snapshotLock);
+    else if(pthread_mutex_trylock(&source->snapshotLock)!=0)
+        return;
+    source->auditSnapshot=source->audit;
+    source->governorSnapshot=source->governor;
+    efergyDecoderCounts(source->decoder, &source->countsSnapshot);
+    pthread_mutex_unlock(&source->snapshotLock);
+}
+
+static void *decodeStage(void *arg)
+{
+    // run the decoder over each block and pass on the packets found
+    pipelineSource *source=static_cast<pipelineSource *>(arg);
+    stageStats *stats=&source->decodeStats;
+    applyStageSettings(source->pipe, STAGE_DECODE, stats);
+
+    bool more=true;
+    while(more)
+    {
+        // a block already waiting says nothing of the scheduling, one 
+        // waited for is the time for decode to be woken
+        sampleBlock *block=queueTryConsumerSlot(&source->blocks);
+        if(!block)
+        {
+            block=queueConsumerSlot(&source->blocks);
+            double latency=monotonicTime()-block->ready;
+            if(latency>source->maxLatency)
+                source->maxLatency=latency;
+            source->wakeups++;
+        }
+        more=(block->count>0);
+        double ready=block->ready;
+        size_t count=block->count;
+        auditBlock(&source->audit, count, ready);
+        double began=monotonicTime();
+        efergyDecoderPushStream(source->decoder, block->bytes, block->count);
+        double cost=monotonicTime()-began;
+        if(source->capture)
+        {
+            captureBytes(source->capture, block->bytes, block->count);
+        }
+        queueConsumerRelease(&source->blocks);
+        stats->items++;
+
+        if(source->governor.byteRate>0)
+        {
+            int waiting=0;
+            sem_getvalue(&source->blocks.filled, &waiting);
+            governBlock(&source->governor, count, cost, 
+                        static_cast<double>(waiting)/BLOCK_QUEUE_LENGTH, 
+                        began+cost);
+        }
+        // the last is waited for so the stats at the end are whole
+        publishSnapshot(source, !more);
+
+        if(source->byteRate>0 && count>0)
+        {
+            // the samples of a live input come in real time, the block
+            // must be decoded in the time they span or decode is behind
+            double took=monotonicTime()-ready;
+            if(took>count/source->byteRate)
+                source->late++;
+            if(took>source->maxLate)
+                source->maxLate=took;
+        }
+
+        efergyPacket packet;
+        packet.size=sizeof(packet);
+        while(efergyDecoderPoll(source->decoder, &packet))
+        {
+            if(source->audit.ppmReady)
+            {
+                // on the monotonic clock, the dongle's error taken out
+                packet.time=auditedTime(&source->audit, packet.start);
+            }
+            if(source->capture)
+            {
+                capturePacket(source->capture, &packet);
+            }
+            sendPacket(source, &packet, false);
+        }
+        if(source->capture)
+        {
+            captureDecoder(source->capture, source->decoder);
+        }
+    }
+    if(source->capture)
+    {
+        captureEnd(source->capture);
+    }
+    sendPacket(source, 0, true);
+
+    stageStopped(stats);
+    return(NULL);
+}
+
+static void combinePackets(pipeline *pipe, double now)
+{
+    // sink the packets from the groups that have closed
+    efergyPacket packet;
+    packet.size=sizeof(packet);
+    while(efergyCombinerPoll(pipe->combiner, &packet, now))
+    {
+        pipe->sink(&packet, pipe->sinkArg);
+        pipe->sinkStats.items++;
+    }
+}
+
+int runPipeline(pipeline *pipe)
+{
+    // ingest and decode get their own threads for each source, the sink
+    // stage runs on the calling thread until every input ends
+    sem_init(&pipe->packetsReady, 0, 0);
+    int started=0;
+    int err=0;
+    for(int s=0; s<pipe->sourceCount && err==0; s++)
+    {
+        pipelineSource *source=pipe->sources[s];
+        queueInit(&source->blocks);
+        queueInit(&source->packets);
+        err=pthread_create(&source->decodeTid, NULL, &decodeStage, source);
+        if(err==0)
+        {
+            err=pthread_create(&source->ingestTid, NULL, &ingestStage, 
+                        source);
+            if(err!=0)
+            {
+                // no ingest, end the decode stage with an empty block
+                // and its thread is cleaned up like the rest
+                sampleBlock *block=queueProducerSlot(&source->blocks, 
+                                    &source->ingestStats.waits);
+                block->count=0;
+                queueProducerCommit(&source->blocks);
+                source->ingestTid=pthread_self();
+            }
+            started++;
+        }
+    }
+    if(err!=0)
+    {
+        fprintf(stderr, "Failed, can't create pipeline thread, %s\n", 
+                    strerror(err));
+        *pipe->exitNow=true;
+    }
+
+    applyStageSettings(pipe, STAGE_SINK, &pipe->sinkStats);
+    stageStats *stats=&pipe->sinkStats;
+    int ended=0;
+    int next=0;
+    while(ended<started)
+    {
+        if(pipe->combiner && efergyCombinerPending(pipe->combiner))
+        {
+            // groups are waiting for their window to close, so wake
+            // up to close them even if no more packets come
+            struct timespec wake;
+            clock_gettime(CLOCK_REALTIME, &wake);
+            wake.tv_nsec+=COMBINE_WAKE_NS;
+            wake.tv_sec+=wake.tv_nsec/1000000000;
+            wake.tv_nsec%=1000000000;
+            int got=sem_timedwait(&pipe->packetsReady, &wake);
+            if(got!=0)
+            {
+                combinePackets(pipe, monotonicTime());
+                continue;
+            }
+        }
+        else
+        {
+            while(sem_wait(&pipe->packetsReady)!=0)
+                ;   // interrupted by a signal
+        }
+        // one packet is waiting, take sources in turn so a busy one
+        // can't hold up the rest
+        for(int n=0; n<started; n++)
+        {
+            pipelineSource *source=pipe->sources[(next+n)%started];
+            pipelinePacket *slot=queueTryConsumerSlot(&source->packets);
+            if(slot)
+            {
+                if(slot->end)
+                {
+                    ended++;
+                }
+                else if(pipe->combiner)
+                {
+                    efergyCombinerPush(pipe->combiner, &slot->packet, 
+                                monotonicTime());
+                }
+                else
+                {
+                    pipe->sink(&slot->packet, pipe->sinkArg);
+                    stats->items++;
+                }
+                queueConsumerRelease(&source->packets);
+                next=(next+n+1)%started;
+                break;
+            }
+        }
+        if(pipe->combiner)
+        {
+            combinePackets(pipe, monotonicTime());
+        }
+    }
+    if(pipe->combiner)
+    {
+        // input has ended, close every group
+        combinePackets(pipe, -1.0);
+    }
+    stageStopped(stats);
+
+    for(int s=0; s<started; s++)
+    {
+        pipelineSource *source=pipe->sources[s];
+        if(!pthread_equal(source->ingestTid, pthread_self()))
+        {
+            pthread_join(source->ingestTid, 0);
+        }
+        pthread_join(source->decodeTid, 0);
+        queueDestroy(&source->blocks);
+        queueDestroy(&source->packets);
+    }
+    sem_destroy(&pipe->packetsReady);
+    return(err);
+}
+
+static void outputStage(FILE *out, const char *name, 
+            const stageSettings &settings, const stageStats *stats)
+{
+    double wall;
+    double cpu;
+    if(stats->running)
+    {
+        wall=monotonicTime()-stats->startTime;
+        cpu=threadCpuTime(stats->thread);
+    }
+    else
+    {
+        wall=stats->stopTime-stats->startTime;
+        cpu=stats->cpuTime;
+    }
+    fprintf(out, "%-8s %4d %5d %4d %8llu %8llu %6.2f\n", name, 
+                settings.cpu, settings.nice, settings.priority, stats->items,
+                stats->waits, (wall>0)?(100.0*cpu/wall):0.0);
+}
+
+static void outputDecodeLatency(FILE *out, int index, 
+            const pipelineSource *source)
+{
+    fprintf(out, "\tdecode%d wakeup latency, worst %.2fms of %llu\n", 
+                index, 1000*source->maxLatency, source->wakeups);
+    if(source->byteRate>0)
+    {
+        fprintf(out, "\tdecode%d deadlines, %llu of %llu blocks late, "
+                    "worst %.2fms for %.2fms of samples\n", index, 
+                    source->late, source->decodeStats.items, 
+                    1000*source->maxLate, 
+                    1000*INPUT_BLOCK_SIZE/source->byteRate);
+    }
+}
+
+void outputStageStats(FILE *out, pipeline *pipe)
+{
+    // cpu use of each stage as a percentage of the time it has run
+    fprintf(out, "Stage     cpu  nice   rt    items    waits  util%%\n");
+    for(int s=0; s<pipe->sourceCount; s++)
+    {
+        pipelineSource *source=pipe->sources[s];
+        char name[20];
+        snprintf(name, sizeof(name), "%s%d", stageNames[STAGE_INGEST], s);
+        outputStage(out, name, pipe->settings[STAGE_INGEST], 
+                    &source->ingestStats);
+        snprintf(name, sizeof(name), "%s%d", stageNames[STAGE_DECODE], s);
+        outputStage(out, name, pipe->settings[STAGE_DECODE], 
+                    &source->decodeStats);
+    }
+    for(int s=0; s<pipe->sourceCount; s++)
+    {
+        // the stats may be written while decode runs
+        rateAudit audit;
+        engineGovernor governor;
+        efergyCounts counts;
+        sourceSnapshot(pipe->sources[s], &audit, &governor, &counts);
+        outputDecodeLatency(out, s, pipe->sources[s]);
+        outputRateAudit(out, &audit);
+        const stageStats *decode=&pipe->sources[s]->decodeStats;
+        outputGovernor(out, &governor, 
+                    decode->running?monotonicTime():decode->stopTime);
+    }
+    outputStage(out, stageNames[STAGE_SINK], pipe->settings[STAGE_SINK], 
+                &pipe->sinkStats);
+    outputStage(out, stageNames[STAGE_LOG], pipe->settings[STAGE_LOG], 
+                &pipe->logStats);
+}
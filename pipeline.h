@@ -0,0 +1,265 @@
+/*
+ * pipeline.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* The processing as explicit stages, each on its own thread, joined by
+ * single producer single consumer queues
+ * 
+ *  input 0 -> ingest -> blocks -> decode -> packets -\
+ *  input 1 -> ingest -> blocks -> decode -> packets --> sink
+ *  ...                                              -/
+ * 
+ * Each source, stdin, a fifo or a file, has its own ingest and decode
+ * stages. ingest reads the rtl_fm samples in blocks and decode runs a
+ * libefergy decoder over them, all the decoders share one aggregation.
+ * sink does the per packet output for every source. With more than 
+ * one source the sink first passes the packets through an 
+ * efergyCombiner, so copies of a transmission heard by several 
+ * receivers come out once. The interval logging thread is the log 
+ * stage. The fm demodulation itself is 
+ * upstream in rtl_fm.
+ * 
+ * Each stage can be pinned to a cpu and given a nice value, and the
+ * cpu time of each stage is kept so we can see where the load is.
+ * 
+ * On a busy box a page fault or another process preempting decode can
+ * leave rtl_fm's pipe to overrun. Real time mode locks the process in
+ * memory, keeps what malloc frees and gives ingest and decode a 
+ * SCHED_FIFO priority, while the sink and log stay with the normal 
+ * scheduler. The buffers on the way to the sink are all allocated
+ * before the stages start. Decode's wakeup latency is measured, and
+ * a block decoded later than the time its samples span, on a live 
+ * input, has missed its deadline. Decode also audits the rate of a
+ * live input, see rateaudit.h, and can pick the decoder's engine for
+ * the cpu it gets, see governor.h.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstdio>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "efergy.h"
+#include "capture.h"
+#include "rateaudit.h"
+#include "governor.h"
+
+// size of the reads from stdin, in bytes
+#define INPUT_BLOCK_SIZE (4096)
+// queue lengths, powers of two
+#define BLOCK_QUEUE_LENGTH (64)
+#define PACKET_QUEUE_LENGTH (256)
+#define MAX_SOURCES (EFERGY_MAX_SOURCES)
+// sink wakes this often while combining groups are open
+#define COMBINE_WAKE_NS (100000000)
+// thread stacks in real time mode, locked in memory so kept small
+#define REALTIME_STACK_SIZE (256*1024)
+
+enum pipelineStage
+{
+    STAGE_INGEST,
+    STAGE_DECODE,
+    STAGE_SINK,
+    STAGE_LOG,
+    STAGE_COUNT
+};
+
+extern const char *stageNames[STAGE_COUNT];
+
+// placement of a stage, cpu -1 for anywhere
+struct stageSettings
+{
+    int cpu;
+    int nice;
+    int priority;           // SCHED_FIFO, 0 for the normal scheduler
+};
+
+struct stageStats
+{
+    pthread_t thread;
+    bool running;
+    unsigned long long items;   // blocks or packets handled
+    unsigned long long waits;   // times the stage blocked on a full queue
+    double startTime;           // monotonic seconds
+    double stopTime;
+    double cpuTime;             // thread cpu seconds when it stopped
+};
+
+// single producer single consumer ring, the semaphores count the 
+// filled and free slots so each index is only written by one side
+template<typename T, int length> struct spscQueue
+{
+    T items[length];
+    unsigned int head;      // consumer
+    unsigned int tail;      // producer
+    sem_t filled;
+    sem_t space;
+};
+
+template<typename T, int length> 
+void queueInit(spscQueue<T, length> *queue)
+{
+    queue->head=0;
+    queue->tail=0;
+    sem_init(&queue->filled, 0, 0);
+    sem_init(&queue->space, 0, length);
+}
+
+template<typename T, int length> 
+void queueDestroy(spscQueue<T, length> *queue)
+{
+    sem_destroy(&queue->filled);
+    sem_destroy(&queue->space);
+}
+
+// slot to write in, blocks while the queue is full
+template<typename T, int length> 
+T *queueProducerSlot(spscQueue<T, length> *queue, unsigned long long *waits)
+{
+    if(sem_trywait(&queue->space)!=0)
+    {
+        (*waits)++;
+        while(sem_wait(&queue->space)!=0)
+            ;   // interrupted by a signal
+    }
+    return(&queue->items[queue->tail%length]);
+}
+
+template<typename T, int length> 
+void queueProducerCommit(spscQueue<T, length> *queue)
+{
+    queue->tail++;
+    sem_post(&queue->filled);
+}
+
+// slot to read from, or 0 if the queue is empty
+template<typename T, int length> 
+T *queueTryConsumerSlot(spscQueue<T, length> *queue)
+{
+    if(sem_trywait(&queue->filled)!=0)
+    {
+        return(0);
+    }
+    return(&queue->items[queue->head%length]);
+}
+
+// slot to read from, blocks while the queue is empty
+template<typename T, int length> 
+T *queueConsumerSlot(spscQueue<T, length> *queue)
+{
+    while(sem_wait(&queue->filled)!=0)
+        ;   // interrupted by a signal
+    return(&queue->items[queue->head%length]);
+}
+
+template<typename T, int length> 
+void queueConsumerRelease(spscQueue<T, length> *queue)
+{
+    queue->head++;
+    sem_post(&queue->space);
+}
+
+struct sampleBlock
+{
+    double ready;           // monotonic seconds ingest read it
+    size_t count;           // zero marks the end of input
+    unsigned char bytes[INPUT_BLOCK_SIZE];
+};
+
+struct pipelinePacket
+{
+    bool end;               // no more packets
+    efergyPacket packet;
+};
+
+// called on the sink stage for each packet
+typedef void (*packetSink)(const efergyPacket *packet, void *arg);
+
+struct pipeline;
+
+struct pipelineSource
+{
+    pipeline *pipe;
+    int index;
+    char name[256];         // "-" for stdin
+    efergyDecoder *decoder;
+    captureRing *capture;   // 0 unless keeping the raw samples
+    stageStats ingestStats;
+    stageStats decodeStats;
+    double byteRate;        // input bytes a second if live, else 0
+    double maxLatency;      // worst seconds from a block to decode waking
+    unsigned long long wakeups;     // blocks decode waited for
+    unsigned long long late;        // blocks decoded past their deadline
+    double maxLate;         // worst seconds a block took to decode
+    rateAudit audit;        // of the samples as ingest read them
+    engineGovernor governor;    // of the decoder's engine
+    // copies of the two and the decoder's counts for other threads, 
+    // decode updates them after a block unless a reader has the lock,
+    // so it never waits
+    pthread_mutex_t snapshotLock;
+    rateAudit auditSnapshot;
+    engineGovernor governorSnapshot;
+    efergyCounts countsSnapshot;
+    pthread_t ingestTid;
+    pthread_t decodeTid;
+    spscQueue<sampleBlock, BLOCK_QUEUE_LENGTH> blocks;
+    spscQueue<pipelinePacket, PACKET_QUEUE_LENGTH> packets;
+};
+
+struct pipeline
+{
+    packetSink sink;
+    void *sinkArg;
+    efergyCombiner *combiner;   // 0 unless combining receivers
+    volatile bool *exitNow;
+
+    stageSettings settings[STAGE_COUNT];
+    stageStats sinkStats;
+    stageStats logStats;
+
+    pipelineSource *sources[MAX_SOURCES];
+    int sourceCount;
+    sem_t packetsReady;     // posted for a packet on any source
+};
+
+void initPipeline(pipeline *pipe);
+// returns false if there are already MAX_SOURCES
+bool addSource(pipeline *pipe, const char *name, efergyDecoder *decoder);
+void freePipeline(pipeline *pipe);
+// the audit, governor and decoder counts as of a recent block, from 
+// any thread
+void sourceSnapshot(pipelineSource *source, rateAudit *audit, 
+            engineGovernor *governor, efergyCounts *counts);
+bool parseStageSettings(const char *text, stageSettings *settings);
+void applyStageSettings(pipeline *pipe, pipelineStage stage, 
+            stageStats *stats);
+// the whole process, before any thread starts, false if the memory
+// can't be locked
+bool startRealtime();
+void stageStopped(stageStats *stats);
+int runPipeline(pipeline *pipe);
+void outputStageStats(FILE *out, pipeline *pipe);
+
+#endif // PIPELINE_H
@@ -5,6 +5,7 @@
 OPTIONS="-a0x0230ad -s -rpower.rrd power.log"
 
 cd ../bin
-rtl_fm -Alut -f433550000 -s200000 -r96000 -g10 2> /dev/null | ./efergy $OPTIONS >> pwr  
- 
-
+# efergy runs rtl_fm itself and restarts it if the dongle wedges, the
+# old way was to pipe it in
+#rtl_fm -Alut -f433550000 -s200000 -r96000 -g10 2> /dev/null | ./efergy $OPTIONS >> pwr
+./efergy -I"rtl_fm -Alut -f433550000 -s200000 -r96000 -g10 2> /dev/null" $OPTIONS >> pwr
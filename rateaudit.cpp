@@ -0,0 +1,223 @@
+/*
+ * rateaudit.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cmath>
+#include <ctime>
+
+#include "rateaudit.h"
+
+// a window's least lead starts above any real one
+#define NO_LEAD (1e30)
+
+void initRateAudit(rateAudit *audit, int index, double rate, 
+            int frameBytes)
+{
+    audit->index=index;
+    audit->rate=rate;
+    audit->frameBytes=(frameBytes>0)?frameBytes:1;
+    audit->start=0;
+    audit->bytes=0;
+    audit->windowStart=0;
+    audit->windowLead=NO_LEAD;
+    audit->haveWindow=false;
+    audit->lastLead=0;
+    audit->lastTime=0;
+    audit->pending=false;
+    audit->pendingStep=0;
+    audit->pendingTime=0;
+    audit->pendingLead=0;
+    audit->stepping=false;
+    audit->windows=0;
+    audit->drops=0;
+    audit->dropped=0;
+    audit->deviations=0;
+    audit->warnedRate=false;
+    audit->points=0;
+    audit->sumT=0;
+    audit->sumL=0;
+    audit->sumTT=0;
+    audit->sumTL=0;
+    audit->ppm=0;
+    audit->ppmReady=false;
+}
+
+static void addPoint(rateAudit *audit, double t, double lead)
+{
+    // the lead falls as a fast dongle gets ahead of the clock
+    audit->points++;
+    audit->sumT+=t;
+    audit->sumL+=lead;
+    audit->sumTT+=t*t;
+    audit->sumTL+=t*lead;
+    double n=static_cast<double>(audit->points);
+    double spread=n*audit->sumTT-audit->sumT*audit->sumT;
+    if(audit->points>=AUDIT_MIN_WINDOWS && spread>0)
+    {
+        double slope=(n*audit->sumTL-audit->sumT*audit->sumL)/spread;
+        audit->ppm=-slope*1e6;
+        audit->ppmReady=true;
+    }
+}
+
+static void clockTime(double t, double now, char *text, size_t size)
+{
+    // wall clock of monotonic t seconds into the input, now being t
+    // for the latest block
+    time_t when=time(0)-static_cast<time_t>(now-t);
+    strftime(text, size, "%H:%M:%S", localtime(&when));
+}
+
+static void warnRate(rateAudit *audit, double step, double seconds)
+{
+    if(audit->warnedRate || seconds<=0)
+    {
+        return;
+    }
+    audit->warnedRate=true;
+    fprintf(stderr, "Warning, input %d samples are coming %.2f%% %s than "
+                "%.0f a second\n", audit->index, 100*fabs(step)/seconds, 
+                (step>0)?"slower":"faster", audit->rate);
+}
+
+static void endWindow(rateAudit *audit, double t)
+{
+    // the first window may have a backlog of samples queued before we
+    // started, it only warms up
+    audit->windows++;
+    double lead=audit->windowLead;
+    if(audit->windows==1)
+    {
+        return;
+    }
+    if(!audit->haveWindow)
+    {
+        audit->haveWindow=true;
+        audit->lastLead=lead;
+        audit->lastTime=t;
+        addPoint(audit, t, lead);
+        return;
+    }
+
+    double step=lead-audit->lastLead;
+    double seconds=t-audit->lastTime;
+    if(step>AUDIT_STEP_SECONDS)
+    {
+        if(audit->pending || audit->stepping)
+        {
+            // a second step in a row, the rate is off not samples lost
+            if(audit->pending)
+            {
+                audit->deviations++;
+                addPoint(audit, audit->pendingTime, 
+                            audit->pendingLead-audit->dropped);
+                audit->pending=false;
+            }
+            audit->deviations++;
+            audit->stepping=true;
+            warnRate(audit, step, seconds);
+            addPoint(audit, t, lead-audit->dropped);
+        }
+        else
+        {
+            // a drop if the next window doesn't step as well
+            audit->pending=true;
+            audit->pendingStep=step;
+            audit->pendingTime=t;
+            audit->pendingLead=lead;
+        }
+    }
+    else
+    {
+        if(audit->pending)
+        {
+            audit->drops++;
+            audit->dropped+=audit->pendingStep;
+            addPoint(audit, audit->pendingTime, 
+                        audit->pendingLead-audit->dropped);
+            audit->pending=false;
+            char from[16];
+            char to[16];
+            clockTime(audit->pendingTime-seconds, t, from, sizeof(from));
+            clockTime(audit->pendingTime, t, to, sizeof(to));
+            fprintf(stderr, "Warning, input %d lost about %.0fms of samples "
+                        "between %s and %s\n", audit->index, 
+                        1000*audit->pendingStep, from, to);
+        }
+        audit->stepping=false;
+        if(step<-AUDIT_STEP_SECONDS)
+        {
+            audit->deviations++;
+            warnRate(audit, step, seconds);
+        }
+        addPoint(audit, t, lead-audit->dropped);
+    }
+    audit->lastLead=lead;
+    audit->lastTime=t;
+}
+
+void auditBlock(rateAudit *audit, size_t count, double when)
+{
+    if(audit->rate<=0 || count==0)
+    {
+        return;
+    }
+    if(audit->bytes==0)
+    {
+        audit->start=when;
+        audit->windowStart=when;
+    }
+    audit->bytes+=count;
+    double t=when-audit->start;
+    double lead=t-(audit->bytes/audit->frameBytes)/audit->rate;
+    if(lead<audit->windowLead)
+    {
+        audit->windowLead=lead;
+    }
+    if(when-audit->windowStart>=AUDIT_WINDOW_SECONDS)
+    {
+        endWindow(audit, t);
+        audit->windowStart=when;
+        audit->windowLead=NO_LEAD;
+    }
+}
+
+double auditedTime(const rateAudit *audit, unsigned long long sample)
+{
+    double rate=audit->rate*(1+audit->ppm*1e-6);
+    return(sample/rate+audit->dropped);
+}
+
+void outputRateAudit(FILE *out, const rateAudit *audit)
+{
+    if(audit->rate<=0)
+    {
+        return;
+    }
+    if(audit->ppmReady)
+        fprintf(out, "\tinput %d clock %+.1f ppm", audit->index, audit->ppm);
+    else
+        fprintf(out, "\tinput %d clock unknown", audit->index);
+    fprintf(out, ", %llu drops, %.3fs lost, %llu of %llu windows off "
+                "rate\n", audit->drops, audit->dropped, audit->deviations, 
+                audit->windows);
+}
@@ -0,0 +1,103 @@
+/*
+ * rateaudit.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* A check that a live input really delivers its sample rate.
+ * 
+ * rtl_fm writes its samples in bursts, but a sample can't come before
+ * it was taken, so the earliest a block of samples arrives, in each 
+ * 10 second window, sits on a line of the dongle's clock against the
+ * monotonic one. The lead of the clock over the samples
+ * 
+ *  lead = seconds since the first block - samples / nominal rate
+ * 
+ * is taken at its least in each window. From window to window it
+ * - drifts slowly with the dongle's crystal, the slope of a least 
+ *   squares fit is its error in ppm, 
+ * - steps up and stays up when upstream drops USB buffers, a
+ *   discontinuity, the step is the time of the samples lost,
+ * - steps every window when the rate is wrong, eg rtl_fm run with 
+ *   another -r, a rate deviation.
+ * A step up is only taken as a drop once the next window doesn't step
+ * too. The fit takes out the drops so it still finds the ppm.
+ * 
+ * With the ppm known, a packet's time in samples can be put on the
+ * monotonic clock, with the drops before it added back.
+ */
+
+#ifndef RATEAUDIT_H
+#define RATEAUDIT_H
+
+#include <cstdio>
+#include <cstddef>
+
+#define AUDIT_WINDOW_SECONDS (10.0)
+// a step in the least lead bigger than this is samples lost
+#define AUDIT_STEP_SECONDS (0.010)
+// windows before the ppm is trusted
+#define AUDIT_MIN_WINDOWS (6)
+
+struct rateAudit
+{
+    int index;                  // of the input, for the warnings
+    double rate;                // nominal samples a second, 0 when off
+    int frameBytes;
+    double start;               // monotonic seconds of the first block
+    unsigned long long bytes;
+
+    double windowStart;
+    double windowLead;          // least lead in the window
+    bool haveWindow;            // a window before this one
+    double lastLead;            // the last window's least lead
+    double lastTime;            // and its end, seconds since start
+    bool pending;               // last window stepped up, drop or rate
+    double pendingStep;
+    double pendingTime;
+    double pendingLead;
+    bool stepping;              // windows in a row have stepped up
+
+    unsigned long long windows;
+    unsigned long long drops;   // discontinuities
+    double dropped;             // seconds of samples lost in them
+    unsigned long long deviations;  // windows of a wrong rate
+    bool warnedRate;
+
+    // least squares of the least lead, less the drops, on time
+    unsigned long long points;
+    double sumT;
+    double sumL;
+    double sumTT;
+    double sumTL;
+    double ppm;                 // the dongle's clock error, + is fast
+    bool ppmReady;
+};
+
+// rate of zero leaves it off, for inputs that aren't live
+void initRateAudit(rateAudit *audit, int index, double rate, 
+            int frameBytes);
+// count bytes arrived at monotonic seconds when
+void auditBlock(rateAudit *audit, size_t count, double when);
+// seconds from the first sample to sample, on the monotonic clock
+double auditedTime(const rateAudit *audit, unsigned long long sample);
+void outputRateAudit(FILE *out, const rateAudit *audit);
+
+#endif // RATEAUDIT_H
@@ -0,0 +1,302 @@
+/*
+ * recorder.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <cfloat>
+
+#include "efergy.h"
+#include "recorder.h"
+
+// samples read at a time
+#define RECORD_BLOCK_SAMPLES (4096)
+
+static void writeWords(FILE *out, const unsigned long long *words, 
+            size_t count)
+{
+    // little endian whatever the host
+    for(size_t w=0; w<count; w++)
+    {
+        unsigned char bytes[8];
+        for(int b=0; b<8; b++)
+        {
+            bytes[b]=(words[w]>>(8*b))&0xff;
+        }
+        fwrite(bytes, 1, sizeof(bytes), out);
+    }
+}
+
+unsigned long long recordPacked(FILE *in, FILE *out, double sampleRate)
+{
+    efergyPackedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EFERGY_PACKED_MAGIC, sizeof(header.magic));
+    header.headerBytes=sizeof(header);
+    header.sampleRate=sampleRate;
+    header.startTime=time(0);
+    header.samples=0;
+    fwrite(&header, 1, sizeof(header), out);
+
+    unsigned char bytes[2*RECORD_BLOCK_SAMPLES];
+    unsigned long long words[RECORD_BLOCK_SAMPLES/64+1];
+    unsigned long long word=0;      // filling from bit 0
+    int bits=0;
+    unsigned long long samples=0;
+    size_t got;
+    while((got=fread(bytes, 1, sizeof(bytes), in))>=2)
+    {
+        // a part sample at the end is dropped, as getPacket() does
+        size_t count=0;
+        for(size_t i=0; i+1<got; i+=2)
+        {
+            // the sign is the top bit of the high byte, set is low
+            unsigned long long high=((bytes[i+1]&0x80)==0);
+            word|=high<<bits;
+            if(++bits==64)
+            {
+                words[count++]=word;
+                word=0;
+                bits=0;
+            }
+        }
+        writeWords(out, words, count);
+        samples+=got/2;
+    }
+    if(bits>0)
+    {
+        writeWords(out, &word, 1);
+    }
+
+    // the count in the header if we can go back to it, a pipe can't
+    // so it stays zero and the last word may carry some padding
+    header.samples=samples;
+    if(fseek(out, 0, SEEK_SET)==0)
+    {
+        fwrite(&header, 1, sizeof(header), out);
+    }
+    fflush(out);
+    return(samples);
+}
+
+// Run captures
+// ============
+
+struct runsWriter
+{
+    FILE *out;
+    unsigned char buffer[4096];
+    size_t fill;
+    unsigned long long offset;      // file offset of buffer[fill]
+};
+
+static void flushRuns(runsWriter *writer)
+{
+    fwrite(writer->buffer, 1, writer->fill, writer->out);
+    writer->fill=0;
+}
+
+static void writeVarint(runsWriter *writer, unsigned long long value)
+{
+    if(writer->fill+10>sizeof(writer->buffer))
+    {
+        flushRuns(writer);
+    }
+    do
+    {
+        unsigned char byte=value&0x7f;
+        value>>=7;
+        writer->buffer[writer->fill++]=byte|(value?0x80:0);
+        writer->offset++;
+    }
+    while(value);
+}
+
+unsigned long long recordRuns(FILE *in, FILE *out, double sampleRate,
+            double indexSeconds)
+{
+    efergyPackedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EFERGY_RUNS_MAGIC, sizeof(header.magic));
+    header.headerBytes=sizeof(header);
+    header.sampleRate=sampleRate;
+    header.startTime=time(0);
+    header.samples=0;
+    fwrite(&header, 1, sizeof(header), out);
+
+    runsWriter writer;
+    writer.out=out;
+    writer.fill=0;
+    writer.offset=sizeof(header);
+
+    std::vector<efergyRunsIndexEntry> index;
+    unsigned long long indexSamples=
+        static_cast<unsigned long long>(indexSeconds*sampleRate);
+    if(indexSamples==0)
+        indexSamples=1;
+    unsigned long long nextIndex=0;
+
+    unsigned char bytes[2*RECORD_BLOCK_SAMPLES];
+    bool level=false;
+    unsigned long long runStart=0;
+    unsigned long long samples=0;
+    size_t got;
+    while((got=fread(bytes, 1, sizeof(bytes), in))>=2)
+    {
+        // a part sample at the end is dropped, as getPacket() does
+        for(size_t i=0; i+1<got; i+=2, samples++)
+        {
+            bool high=((bytes[i+1]&0x80)==0);
+            if(high==level && samples>0)
+            {
+                continue;
+            }
+            if(samples>0)
+            {
+                writeVarint(&writer, ((samples-runStart)<<1)|level);
+            }
+            // the index points at runs, a reader starts on a whole one
+            if(samples>=nextIndex)
+            {
+                efergyRunsIndexEntry entry={samples, writer.offset};
+                index.push_back(entry);
+                nextIndex=samples+indexSamples;
+            }
+            level=high;
+            runStart=samples;
+        }
+    }
+    if(samples>runStart)
+    {
+        writeVarint(&writer, ((samples-runStart)<<1)|level);
+    }
+    writeVarint(&writer, 0);
+    flushRuns(&writer);
+
+    efergyRunsFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.indexOffset=writer.offset;
+    footer.entries=index.size();
+    footer.indexSeconds=indexSeconds;
+    memcpy(footer.magic, EFERGY_RUNS_INDEX_MAGIC, sizeof(footer.magic));
+    footer.footerBytes=sizeof(footer);
+    if(index.size()>0)
+    {
+        fwrite(&index[0], sizeof(index[0]), index.size(), out);
+    }
+    fwrite(&footer, 1, sizeof(footer), out);
+
+    // the count in the header if we can go back to it, the footer 
+    // does without it
+    header.samples=samples;
+    if(fseek(out, 0, SEEK_SET)==0)
+    {
+        fwrite(&header, 1, sizeof(header), out);
+    }
+    fflush(out);
+    return(samples);
+}
+
+bool openRuns(FILE *file, runsCapture *capture)
+{
+    capture->file=file;
+    capture->index.clear();
+    if(fseek(file, 0, SEEK_SET)!=0 ||
+        fread(&capture->header, sizeof(capture->header), 1, file)!=1 ||
+        memcmp(capture->header.magic, EFERGY_RUNS_MAGIC, 
+                sizeof(capture->header.magic))!=0)
+    {
+        fprintf(stderr, "Failed, not a seekable run capture\n");
+        return(false);
+    }
+    const efergyPackedHeader *header=&capture->header;
+    if(header->headerBytes<sizeof(*header) || 
+        !(header->sampleRate>0 && header->sampleRate<=DBL_MAX))
+    {
+        fprintf(stderr, "Failed, the run capture header is damaged\n");
+        return(false);
+    }
+    efergyRunsFooter *footer=&capture->footer;
+    if(fseek(file, -static_cast<long>(sizeof(*footer)), SEEK_END)!=0 ||
+        fread(footer, sizeof(*footer), 1, file)!=1 ||
+        memcmp(footer->magic, EFERGY_RUNS_INDEX_MAGIC, 
+                sizeof(footer->magic))!=0)
+    {
+        fprintf(stderr, "Failed, the run capture has no index, was it "
+                    "cut short?\n");
+        return(false);
+    }
+    // the index is all that lies between its offset and the footer, 
+    // so its size is checked before anything is allocated for it
+    long size=ftell(file);
+    unsigned long long indexBytes=footer->entries*
+                sizeof(efergyRunsIndexEntry);
+    if(size<0 || footer->footerBytes!=sizeof(*footer) ||
+        footer->entries>static_cast<unsigned long long>(size)/
+                sizeof(efergyRunsIndexEntry) ||
+        footer->indexOffset<header->headerBytes ||
+        footer->indexOffset+indexBytes+sizeof(*footer)!=
+                static_cast<unsigned long long>(size))
+    {
+        fprintf(stderr, "Failed, the run capture index is damaged\n");
+        return(false);
+    }
+    capture->index.resize(footer->entries);
+    if(footer->entries==0)
+    {
+        return(true);
+    }
+    if(fseek(file, footer->indexOffset, SEEK_SET)!=0 ||
+        fread(&capture->index[0], sizeof(capture->index[0]), 
+                footer->entries, file)!=footer->entries)
+    {
+        fprintf(stderr, "Failed, can't read the run capture index, %s\n",
+                    strerror(errno));
+        capture->index.clear();
+        return(false);
+    }
+    return(true);
+}
+
+unsigned long long seekRuns(runsCapture *capture, unsigned long long sample)
+{
+    // the entries are in sample order, find the last at or before
+    size_t low=0;
+    size_t high=capture->index.size();
+    while(high-low>1)
+    {
+        size_t middle=(low+high)/2;
+        if(capture->index[middle].sample<=sample)
+            low=middle;
+        else
+            high=middle;
+    }
+    if(capture->index.size()==0)
+    {
+        fseek(capture->file, capture->header.headerBytes, SEEK_SET);
+        return(0);
+    }
+    fseek(capture->file, capture->index[low].offset, SEEK_SET);
+    return(capture->index[low].sample);
+}
@@ -0,0 +1,76 @@
+/*
+ * recorder.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* Recording of rtl_fm samples in the compact capture formats, the
+ * decoder reads them back directly.
+ * 
+ * packed   one bit a sample, the sign, 64 to a word after an
+ *          efergyPackedHeader, see efergy.h. 1/16 of the rtl_fm size,
+ *          a day is about 1GB rather than 16GB.
+ * runs     each run of samples on one side of zero as a varint of its
+ *          width and level, the same header, then an index of sample
+ *          to file offset every so often and an efergyRunsFooter. A 
+ *          quiet band is a few bytes a pulse, noise can be more than
+ *          packed. The index lets a reader go straight to a time in a
+ *          long capture and decode just that.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdio>
+#include <vector>
+
+#include "efergy.h"
+
+// index entries at least this far apart by default
+#define RUNS_INDEX_SECONDS (10.0)
+// decode from this far before a time, longer than a packet, so one 
+// whose start pulse an index entry cuts is still found
+#define RUNS_LEAD_SECONDS (1.0)
+
+// rtl_fm samples from in to a packed capture on out, returns the 
+// samples written
+unsigned long long recordPacked(FILE *in, FILE *out, double sampleRate);
+// rtl_fm samples from in to a run capture on out, an index entry at 
+// least every indexSeconds, returns the samples written
+unsigned long long recordRuns(FILE *in, FILE *out, double sampleRate,
+            double indexSeconds);
+
+// a run capture open for reading, which must be seekable
+struct runsCapture
+{
+    FILE *file;
+    efergyPackedHeader header;
+    efergyRunsFooter footer;
+    std::vector<efergyRunsIndexEntry> index;
+};
+
+// reads the header and the index, false with a message if it isn't a 
+// run capture or has no index
+bool openRuns(FILE *file, runsCapture *capture);
+// moves the file to the last run starting at or before sample, ready
+// for efergyDecoderPushRuns(), returns the sample that run starts at
+unsigned long long seekRuns(runsCapture *capture, unsigned long long sample);
+
+#endif // RECORDER_H
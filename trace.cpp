@@ -0,0 +1,207 @@
+/*
+ * trace.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "trace.h"
+
+// The ring indexes only increase, each is stored by one side with
+// release and loaded by the other with acquire, so a record is complete
+// before its index says it is there and isn't reused until it is out.
+// The writer stores sleeping then loads tail, the sink stores tail then
+// loads sleeping, all sequentially consistent, so one of them sees the
+// other and a record can't be left in the ring with the writer asleep.
+
+static void recordValues(const traceRecord *record, lineValues *values)
+{
+    initLineValues(values);
+    values->when=record->when;
+    values->power=record->power;
+    values->energy=record->energy;
+    values->periods=record->periods;
+    values->quality=record->quality;
+    values->bytes=record->bytes;
+    values->checksumOk=record->checksumOk;
+    values->source=record->source;
+}
+
+static void writeAllLine(traceQueue *queue, const traceRecord *record)
+{
+    // Packet: 0a 1b ... input 1
+    char *at=queue->line.text;
+    memcpy(at, "Packet: ", 8);
+    at+=8;
+    for(int b=0; b<EFERGY_PACKET_BYTES; b++)
+    {
+        at=formatHex(at, &record->bytes[b], 1);
+        *at++=' ';
+    }
+    if(queue->showSource)
+    {
+        memcpy(at, "input ", 6);
+        at+=6;
+        at=formatUnsigned(at, (record->source<0)?0:record->source);
+    }
+    *at++='\n';
+    fwrite(queue->line.text, 1, at-queue->line.text, queue->out);
+}
+
+static void writeRecord(traceQueue *queue, const traceRecord *record)
+{
+    lineValues values;
+    recordValues(record, &values);
+    if(record->lines&TRACE_ALL)
+    {
+        writeAllLine(queue, record);
+    }
+    if(record->lines&TRACE_TOTAL)
+    {
+        formatLine(queue->totalLine, &values, &queue->line);
+        fwrite(queue->line.text, 1, queue->line.length, queue->out);
+    }
+    if(record->lines&TRACE_PASSED)
+    {
+        formatLine(queue->debugLine, &values, &queue->line);
+        fwrite(queue->line.text, 1, queue->line.length, queue->out);
+    }
+    queue->written++;
+}
+
+static void *traceWriterThread(void *arg)
+{
+    traceQueue *queue=static_cast<traceQueue *>(arg);
+    unsigned int head=queue->head;
+    while(true)
+    {
+        // stop before tail, everything pushed before the stop is seen
+        bool stop=__atomic_load_n(&queue->stop, __ATOMIC_ACQUIRE);
+        unsigned int tail=__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if(head==tail)
+        {
+            fflush(queue->out);
+            if(stop)
+                break;
+            __atomic_store_n(&queue->sleeping, true, __ATOMIC_SEQ_CST);
+            if(__atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST)==head &&
+                !__atomic_load_n(&queue->stop, __ATOMIC_SEQ_CST))
+            {
+                uint64_t count;
+                while(read(queue->wake, &count, sizeof(count))<0 && 
+                        errno==EINTR)
+                    ;
+            }
+            __atomic_store_n(&queue->sleeping, false, __ATOMIC_RELAXED);
+            continue;
+        }
+        while(head!=tail)
+        {
+            writeRecord(queue, &queue->records[head%TRACE_QUEUE_LENGTH]);
+            head++;
+            __atomic_store_n(&queue->head, head, __ATOMIC_RELEASE);
+        }
+    }
+    return(NULL);
+}
+
+bool startTrace(traceQueue *queue, FILE *out, const lineTemplate *totalLine,
+            const lineTemplate *debugLine, bool showSource)
+{
+    queue->head=0;
+    queue->tail=0;
+    queue->stop=false;
+    queue->sleeping=false;
+    queue->running=false;
+    queue->wake=eventfd(0, EFD_CLOEXEC);
+    if(queue->wake<0)
+    {
+        fprintf(stderr, "Failed, can't create debug output wakeup, %s\n",
+                    strerror(errno));
+        return(false);
+    }
+    queue->pushed=0;
+    queue->dropped=0;
+    queue->written=0;
+    queue->out=out;
+    queue->showSource=showSource;
+    queue->totalLine=totalLine;
+    queue->debugLine=debugLine;
+    initLineBuffer(&queue->line);
+    int err=pthread_create(&queue->thread, NULL, &traceWriterThread, queue);
+    if(err!=0)
+    {
+        fprintf(stderr, "Failed, can't create debug output thread, %s\n", 
+                    strerror(err));
+    }
+    queue->running=(err==0);
+    return(queue->running);
+}
+
+static void wakeWriter(traceQueue *queue)
+{
+    // the counter only fails to add when it is already huge, the 
+    // writer is woken either way
+    uint64_t one=1;
+    ssize_t wrote=write(queue->wake, &one, sizeof(one));
+    (void)wrote;
+}
+
+bool tracePush(traceQueue *queue, const traceRecord *record)
+{
+    unsigned int tail=queue->tail;
+    unsigned int head=__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if(tail-head>=TRACE_QUEUE_LENGTH)
+    {
+        queue->dropped++;
+        return(false);
+    }
+    queue->records[tail%TRACE_QUEUE_LENGTH]=*record;
+    __atomic_store_n(&queue->tail, tail+1, __ATOMIC_SEQ_CST);
+    queue->pushed++;
+    if(__atomic_load_n(&queue->sleeping, __ATOMIC_SEQ_CST))
+    {
+        wakeWriter(queue);
+    }
+    return(true);
+}
+
+void stopTrace(traceQueue *queue)
+{
+    if(queue->running)
+    {
+        __atomic_store_n(&queue->stop, true, __ATOMIC_SEQ_CST);
+        wakeWriter(queue);
+        pthread_join(queue->thread, 0);
+        queue->running=false;
+    }
+    if(queue->wake>=0)
+    {
+        close(queue->wake);
+        queue->wake=-1;
+    }
+}
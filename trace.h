@@ -0,0 +1,103 @@
+/*
+ * trace.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* The debug output of -d and -D off the sink stage.
+ * 
+ * The sink puts a small binary record for each packet into a lock free
+ * single producer single consumer ring and a writer thread formats the
+ * lines and writes them to stdout. A slow terminal or ssh session then
+ * only holds up the writer. The sink never waits, when the ring is 
+ * full the record is dropped and counted, so debug output can't back
+ * up the decoding and overrun rtl_fm. The writer sleeps on an eventfd
+ * when the ring is empty, the sink only signals it when it says it is
+ * asleep, so a busy writer costs the sink no system call.
+ * 
+ * With debug on the TOTAL lines go through the ring as well, to keep
+ * the lines of a packet in the order they always came out. With it off
+ * they are written by the sink and never dropped.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdio>
+#include <ctime>
+
+#include <pthread.h>
+
+#include "efergy.h"
+#include "formatter.h"
+
+// records the ring holds, a power of two
+#define TRACE_QUEUE_LENGTH (1024)
+
+// lines a record writes, in this order
+enum traceLines
+{
+    TRACE_ALL=1,        // -D, every packet
+    TRACE_TOTAL=2,      // the energy total of an accepted packet
+    TRACE_PASSED=4      // -d, packets that passed the checksum
+};
+
+struct traceRecord
+{
+    unsigned char lines;
+    unsigned char checksumOk;
+    unsigned char bytes[EFERGY_PACKET_BYTES];
+    int source;
+    time_t when;
+    double power;
+    double energy;
+    double periods;
+    double quality;
+};
+
+struct traceQueue
+{
+    traceRecord records[TRACE_QUEUE_LENGTH];
+    unsigned int head;              // written by the writer
+    unsigned int tail;              // written by the sink
+    bool stop;
+    bool sleeping;                  // writer is waiting on wake
+    int wake;                       // eventfd
+    unsigned long long pushed;      // sink side
+    unsigned long long dropped;     // sink side, the ring was full
+    unsigned long long written;     // writer side
+
+    FILE *out;
+    bool showSource;                // -D adds the input
+    const lineTemplate *totalLine;
+    const lineTemplate *debugLine;
+    lineBuffer line;                // the writer's
+    pthread_t thread;
+    bool running;
+};
+
+bool startTrace(traceQueue *queue, FILE *out, const lineTemplate *totalLine,
+            const lineTemplate *debugLine, bool showSource);
+// never waits, false and counted as dropped when the writer is behind
+bool tracePush(traceQueue *queue, const traceRecord *record);
+// writes out what is queued then stops the thread
+void stopTrace(traceQueue *queue);
+
+#endif // TRACE_H
@@ -0,0 +1,336 @@
+/*
+ * upstream.cpp
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "upstream.h"
+
+// bytes passed on at a time
+#define RELAY_BLOCK_SIZE (65536)
+
+static double monotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec+now.tv_nsec/1e9);
+}
+
+static bool stopping(upstreamSupervisor *upstream)
+{
+    return(__atomic_load_n(&upstream->stop, __ATOMIC_ACQUIRE) || 
+                *upstream->exitNow);
+}
+
+static int growPipe(int fd)
+{
+    // as big as pipe-max-size lets us without privilege
+    for(int size=UPSTREAM_PIPE_SIZE; size>4096; size/=2)
+    {
+        if(fcntl(fd, F_SETPIPE_SZ, size)>=0)
+            break;
+    }
+    return(fcntl(fd, F_GETPIPE_SZ));
+}
+
+static bool spawnCommand(upstreamSupervisor *upstream)
+{
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC)!=0)
+    {
+        fprintf(stderr, "Failed, can't make a pipe for '%s', %s\n", 
+                    upstream->command.c_str(), strerror(errno));
+        return(false);
+    }
+    upstream->pipeSize=growPipe(fds[1]);
+
+    pid_t child=fork();
+    if(child<0)
+    {
+        fprintf(stderr, "Failed, can't start '%s', %s\n", 
+                    upstream->command.c_str(), strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return(false);
+    }
+    if(child==0)
+    {
+        // only async signal safe calls until the exec, the signals we
+        // block and ignore go back to normal for the command
+        setpgid(0, 0);
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, 0);
+        signal(SIGPIPE, SIG_DFL);
+        int null=open("/dev/null", O_RDONLY);
+        if(null>=0)
+            dup2(null, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", upstream->command.c_str(), 
+                    static_cast<char *>(0));
+        _exit(127);
+    }
+    // also here so the group exists before we might kill it
+    setpgid(child, child);
+    close(fds[1]);
+    upstream->child=child;
+    upstream->childFd=fds[0];
+    upstream->starts++;
+    return(true);
+}
+
+static int killCommand(upstreamSupervisor *upstream)
+{
+    // the whole group, the command may be a pipeline of its own
+    // returns the wait status
+    int status=0;
+    if(upstream->child<0)
+    {
+        return(status);
+    }
+    kill(-upstream->child, SIGTERM);
+    pid_t gone=0;
+    for(int waited=0; waited<UPSTREAM_KILL_MS && gone==0; waited+=10)
+    {
+        gone=waitpid(upstream->child, &status, WNOHANG);
+        if(gone==0)
+            usleep(10000);
+    }
+    if(gone==0)
+    {
+        kill(-upstream->child, SIGKILL);
+        waitpid(upstream->child, &status, 0);
+    }
+    close(upstream->childFd);
+    upstream->childFd=-1;
+    upstream->child=-1;
+    return(status);
+}
+
+static bool passOn(upstreamSupervisor *upstream, const unsigned char *bytes,
+            size_t count)
+{
+    // our stdin doesn't block, so a stop isn't missed while the 
+    // decoding is behind
+    while(count>0)
+    {
+        ssize_t wrote=write(upstream->outFd, bytes, count);
+        if(wrote>0)
+        {
+            bytes+=wrote;
+            count-=wrote;
+            continue;
+        }
+        if(wrote<0 && errno!=EAGAIN && errno!=EINTR)
+        {
+            return(false);
+        }
+        if(stopping(upstream))
+        {
+            return(false);
+        }
+        struct pollfd wait;
+        wait.fd=upstream->outFd;
+        wait.events=POLLOUT;
+        poll(&wait, 1, UPSTREAM_WAKE_MS);
+    }
+    return(true);
+}
+
+static void waitBackoff(upstreamSupervisor *upstream)
+{
+    double until=monotonicTime()+upstream->backoff;
+    while(!stopping(upstream) && monotonicTime()<until)
+    {
+        usleep(UPSTREAM_WAKE_MS*1000);
+    }
+    upstream->backoff*=2;
+    if(upstream->backoff>UPSTREAM_BACKOFF_MAX)
+        upstream->backoff=UPSTREAM_BACKOFF_MAX;
+}
+
+static void *supervisorThread(void *arg)
+{
+    upstreamSupervisor *upstream=static_cast<upstreamSupervisor *>(arg);
+    unsigned char block[RELAY_BLOCK_SIZE];
+    while(!stopping(upstream))
+    {
+        if(!spawnCommand(upstream))
+        {
+            waitBackoff(upstream);
+            continue;
+        }
+        double started=monotonicTime();
+        double lastData=started;
+        unsigned long long runBytes=0;
+        bool stalled=false;
+        bool ended=false;
+        while(!stopping(upstream) && !stalled && !ended)
+        {
+            struct pollfd wait;
+            wait.fd=upstream->childFd;
+            wait.events=POLLIN;
+            int ready=poll(&wait, 1, UPSTREAM_WAKE_MS);
+            double now=monotonicTime();
+            if(ready>0)
+            {
+                ssize_t got=read(upstream->childFd, block, sizeof(block));
+                if(got>0)
+                {
+                    lastData=now;
+                    runBytes+=got;
+                    upstream->bytes+=got;
+                    ended=!passOn(upstream, block, got);
+                }
+                else if(got==0 || (errno!=EINTR && errno!=EAGAIN))
+                {
+                    ended=true;
+                }
+            }
+            else if(now-lastData>UPSTREAM_STALL_SECONDS)
+            {
+                stalled=true;
+            }
+        }
+        int status=killCommand(upstream);
+
+        // the next run starts on a whole sample
+        size_t part=runBytes%upstream->frameBytes;
+        if(part>0)
+        {
+            unsigned char zeros[8]={0};
+            passOn(upstream, zeros, upstream->frameBytes-part);
+            upstream->padded+=upstream->frameBytes-part;
+        }
+        if(stopping(upstream))
+        {
+            break;
+        }
+        if(stalled)
+            upstream->stalls++;
+        else
+            upstream->exits++;
+        if(lastData-started>=UPSTREAM_HEALTHY_SECONDS)
+        {
+            upstream->backoff=UPSTREAM_BACKOFF_MIN;
+        }
+        if(stalled)
+            fprintf(stderr, "Warning, upstream sent nothing for %ds, "
+                        "restarting in %.0fs\n", UPSTREAM_STALL_SECONDS, 
+                        upstream->backoff);
+        else
+            fprintf(stderr, "Warning, upstream ended, status %d, "
+                        "restarting in %.0fs\n", WIFEXITED(status)?
+                        WEXITSTATUS(status):-1, upstream->backoff);
+        waitBackoff(upstream);
+    }
+    // the end of our stdin
+    close(upstream->outFd);
+    upstream->outFd=-1;
+    return(NULL);
+}
+
+bool startUpstream(upstreamSupervisor *upstream, const std::string &command,
+            int frameBytes, volatile bool *exitNow)
+{
+    upstream->command=command;
+    upstream->frameBytes=(frameBytes>0 && frameBytes<=8)?frameBytes:1;
+    upstream->exitNow=exitNow;
+    upstream->child=-1;
+    upstream->childFd=-1;
+    upstream->pipeSize=0;
+    upstream->starts=0;
+    upstream->stalls=0;
+    upstream->exits=0;
+    upstream->bytes=0;
+    upstream->padded=0;
+    upstream->backoff=UPSTREAM_BACKOFF_MIN;
+    upstream->running=false;
+    upstream->stop=false;
+
+    // the decoding reads our end as stdin
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC)!=0)
+    {
+        fprintf(stderr, "Failed, can't make the upstream pipe, %s\n", 
+                    strerror(errno));
+        return(false);
+    }
+    growPipe(fds[1]);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    if(dup2(fds[0], STDIN_FILENO)<0)
+    {
+        fprintf(stderr, "Failed, can't read upstream as stdin, %s\n", 
+                    strerror(errno));
+        return(false);
+    }
+    close(fds[0]);
+    upstream->outFd=fds[1];
+
+    // a write after the decoding has gone is an error, not a signal,
+    // and SIGINT and SIGTERM are left to the main thread
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t signals;
+    sigset_t oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+    int err=pthread_create(&upstream->thread, NULL, &supervisorThread, 
+                upstream);
+    pthread_sigmask(SIG_SETMASK, &oldSignals, 0);
+    if(err!=0)
+    {
+        fprintf(stderr, "Failed, can't create upstream thread, %s\n", 
+                    strerror(err));
+        return(false);
+    }
+    upstream->running=true;
+    return(true);
+}
+
+void stopUpstream(upstreamSupervisor *upstream)
+{
+    if(upstream->running)
+    {
+        __atomic_store_n(&upstream->stop, true, __ATOMIC_RELEASE);
+        pthread_join(upstream->thread, 0);
+        upstream->running=false;
+    }
+}
+
+void outputUpstreamStats(FILE *out, const upstreamSupervisor *upstream)
+{
+    fprintf(out, "Upstream     : %llu starts, %llu stalls, %llu ended, "
+                "%llu bytes\n", upstream->starts, upstream->stalls, 
+                upstream->exits, upstream->bytes);
+    fprintf(out, "\tpipe %d bytes, %llu bytes padded, backoff %.0fs\n", 
+                upstream->pipeSize, upstream->padded, upstream->backoff);
+}
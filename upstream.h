@@ -0,0 +1,95 @@
+/*
+ * upstream.h
+ * 
+ * Copyright 2014 neil johnston 
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+/* rtl_fm run and watched by the decoder, in place of a shell pipe
+ * 
+ *  efergy -I"rtl_fm -f433550000 -s200000 -r96000 -g10" power.log
+ * 
+ * The command runs under /bin/sh in a process group of its own. Its 
+ * stdout is a pipe made as big as the system allows, so a hiccup here 
+ * doesn't block rtl_fm and lose USB buffers. A supervisor thread
+ * passes what comes down that pipe on to a second one, which becomes
+ * our stdin. The decoding sees one stream that only ends when we stop.
+ * 
+ * A wedged dongle sends nothing. When nothing comes for a stall 
+ * timeout, or the command ends, the group is killed and the command 
+ * started again. The restarts back off, 1s doubling to a minute, and 
+ * the backoff resets once a run has lasted a minute. A part sample 
+ * left by a killed command is padded, so the samples of the next run 
+ * stay aligned.
+ * 
+ * Any command writing samples does for testing, a fake upstream
+ *  efergy -I"cat efergy.raw; sleep 60" -e power.log
+ * stalls 10 seconds after the capture and is restarted.
+ */
+
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <cstdio>
+#include <string>
+
+#include <sys/types.h>
+#include <pthread.h>
+
+// pipe size asked for, halved until the system allows it
+#define UPSTREAM_PIPE_SIZE (1024*1024)
+// seconds with no samples before the command is restarted
+#define UPSTREAM_STALL_SECONDS (10)
+#define UPSTREAM_BACKOFF_MIN (1.0)
+#define UPSTREAM_BACKOFF_MAX (60.0)
+// a run this long resets the backoff
+#define UPSTREAM_HEALTHY_SECONDS (60.0)
+// the supervisor wakes this often to see if it should stop
+#define UPSTREAM_WAKE_MS (200)
+// a killed command has this long to go before SIGKILL
+#define UPSTREAM_KILL_MS (1000)
+
+struct upstreamSupervisor
+{
+    std::string command;
+    int frameBytes;             // of a sample, the padding for a kill
+    volatile bool *exitNow;
+    pid_t child;                // -1 when none running
+    int childFd;                // read end of the command's stdout
+    int outFd;                  // write end of our stdin
+    int pipeSize;               // got for the command's stdout
+    unsigned long long starts;
+    unsigned long long stalls;  // restarts after no samples came
+    unsigned long long exits;   // restarts after it ended by itself
+    unsigned long long bytes;
+    unsigned long long padded;  // bytes added to finish a sample
+    double backoff;             // seconds before the next start
+    pthread_t thread;
+    bool running;
+    bool stop;
+};
+
+// starts the command with its output as stdin, false if it can't
+bool startUpstream(upstreamSupervisor *upstream, const std::string &command,
+            int frameBytes, volatile bool *exitNow);
+// kills the command and ends our stdin
+void stopUpstream(upstreamSupervisor *upstream);
+void outputUpstreamStats(FILE *out, const upstreamSupervisor *upstream);
+
+#endif // UPSTREAM_H